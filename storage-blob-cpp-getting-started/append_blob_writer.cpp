@@ -0,0 +1,406 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#include "stdafx.h"
+#include "task_util.h"
+#include "append_blob_writer.h"
+
+using namespace azure::storage;
+
+namespace
+{
+  // An append blob accepts blocks of up to 4 MiB
+  const size_t max_append_block_size = 4 * 1024 * 1024;
+
+  enum class block_state
+  {
+    free,
+    open,
+    sealed
+  };
+
+  ///
+  /// One buffer of the ring. Producers reserve their part of the buffer under the lock, and copy their
+  /// record outside of it, so 'written' reaches 'reserved' once all the copies are done.
+  ///
+  struct block_buffer
+  {
+    block_buffer() : state(block_state::free), reserved(0), written(0) {}
+
+    block_state state;
+    std::vector<uint8_t> data;
+    size_t reserved;
+    std::atomic<size_t> written;
+    std::chrono::steady_clock::time_point first_write;
+  };
+}
+
+struct append_blob_writer::writer_state
+{
+  writer_state(cloud_append_blob append_blob, size_t block_size, size_t buffered_blocks, std::chrono::milliseconds flush_interval)
+    : append_blob(append_blob), block_size(block_size), block_count(buffered_blocks), flush_interval(flush_interval),
+    blocks(new block_buffer[buffered_blocks]), fill_index(0), flush_index(0), position(0), accepted(0), appended(0),
+    flush_target(0), requests(0), opened(false), closing(false)
+  {
+  }
+
+  block_buffer& reserve(size_t length, size_t& offset);
+  void seal(block_buffer& block);
+  void run();
+  void append(const block_buffer& block);
+
+  cloud_append_blob append_blob;
+  size_t block_size;
+  size_t block_count;
+  std::chrono::milliseconds flush_interval;
+
+  std::mutex mutex;
+  std::condition_variable space_available;
+  std::condition_variable work_available;
+  std::condition_variable flushed;
+
+  std::unique_ptr<block_buffer[]> blocks;
+  size_t fill_index;
+  size_t flush_index;
+
+  utility::size64_t position;
+  utility::size64_t accepted;
+  utility::size64_t appended;
+  utility::size64_t flush_target;
+  size_t requests;
+  std::chrono::steady_clock::time_point start;
+  bool opened;
+  bool closing;
+  std::exception_ptr error;
+};
+
+///
+/// Creates a writer that gathers the records of many threads in a ring of 'buffered_blocks' buffers of 'block_size'
+/// bytes, and appends each buffer with a single Append Block request once it is full, or once its first record
+/// is 'flush_interval' old. Writers wait when every buffer is in use, so memory stays bounded when the service
+/// is slower than the producers.
+///
+append_blob_writer::append_blob_writer(cloud_append_blob append_blob, size_t block_size, size_t buffered_blocks, std::chrono::milliseconds flush_interval)
+{
+  if (block_size == 0 || block_size > max_append_block_size)
+  {
+    throw std::invalid_argument("The block size must be between 1 byte and 4 MiB");
+  }
+
+  m_state = std::make_shared<writer_state>(append_blob, block_size, buffered_blocks > 1 ? buffered_blocks : 2, flush_interval);
+}
+
+append_blob_writer::~append_blob_writer()
+{
+  try
+  {
+    close();
+  }
+  catch (...)
+  {
+  }
+}
+
+///
+/// Reads the current size of the append blob, which must exist, and starts appending after it. Records can only be
+/// written and flushed once the writer is open.
+///
+void append_blob_writer::open()
+{
+  if (m_flusher.joinable())
+  {
+    throw std::logic_error("The writer is already open");
+  }
+
+  cloud_append_blob append_blob = m_state->append_blob;
+  append_blob.download_attributes();
+
+  {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->position = append_blob.properties().size();
+    m_state->start = std::chrono::steady_clock::now();
+    m_state->opened = true;
+  }
+
+  std::shared_ptr<writer_state> state = m_state;
+  m_flusher = std::thread([state]()
+  {
+    state->run();
+  });
+}
+
+///
+/// Adds a record to the blob. A record is never split between two blocks, so it must not be larger than
+/// the block size. This can be called from any number of threads.
+///
+void append_blob_writer::write(const void* data, size_t length)
+{
+  if (length == 0)
+  {
+    return;
+  }
+
+  if (length > m_state->block_size)
+  {
+    throw std::invalid_argument("The record is larger than the block size");
+  }
+
+  size_t offset;
+  block_buffer& block = m_state->reserve(length, offset);
+
+  std::memcpy(block.data.data() + offset, data, length);
+  block.written.fetch_add(length, std::memory_order_release);
+}
+
+void append_blob_writer::write(const std::string& record)
+{
+  write(record.data(), record.size());
+}
+
+///
+/// Waits until every record written before the call has been appended to the blob, without waiting for the flush interval
+///
+void append_blob_writer::flush()
+{
+  std::unique_lock<std::mutex> lock(m_state->mutex);
+  if (!m_state->opened)
+  {
+    throw std::logic_error("The writer is not open");
+  }
+
+  utility::size64_t target = m_state->accepted;
+  if (m_state->flush_target < target)
+  {
+    m_state->flush_target = target;
+    m_state->work_available.notify_one();
+  }
+
+  writer_state* state = m_state.get();
+  m_state->flushed.wait(lock, [state, target]()
+  {
+    return state->appended >= target || state->error;
+  });
+
+  if (m_state->error)
+  {
+    std::rethrow_exception(m_state->error);
+  }
+}
+
+///
+/// Appends the records still buffered, stops the writer and returns the number of bytes and requests sent.
+/// Writes are rejected once the writer is closed.
+///
+transfer_stats append_blob_writer::close()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->closing = true;
+  }
+
+  m_state->work_available.notify_all();
+  m_state->space_available.notify_all();
+
+  if (m_flusher.joinable())
+  {
+    m_flusher.join();
+  }
+
+  if (m_state->error)
+  {
+    std::rethrow_exception(m_state->error);
+  }
+
+  transfer_stats stats;
+  stats.bytes = m_state->appended;
+  stats.requests = m_state->requests;
+  stats.seconds = task_util::seconds_since(m_state->start);
+  return stats;
+}
+
+///
+/// Reserves room for a record in the block being filled. When the record does not fit, the block is handed to the
+/// flusher and the next buffer of the ring is used, waiting for it to be appended if needed.
+///
+block_buffer& append_blob_writer::writer_state::reserve(size_t length, size_t& offset)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true)
+  {
+    if (error)
+    {
+      std::rethrow_exception(error);
+    }
+
+    if (!opened)
+    {
+      throw std::logic_error("The writer is not open");
+    }
+
+    if (closing)
+    {
+      throw std::logic_error("The writer is closed");
+    }
+
+    block_buffer& block = blocks[fill_index];
+    if (block.state == block_state::free)
+    {
+      block.state = block_state::open;
+      block.data.resize(block_size);
+      block.first_write = std::chrono::steady_clock::now();
+
+      // The flusher waits for this block to be old enough
+      work_available.notify_one();
+    }
+
+    if (block.state == block_state::open)
+    {
+      if (block.reserved + length <= block_size)
+      {
+        offset = block.reserved;
+        block.reserved += length;
+        accepted += length;
+        if (block.reserved == block_size)
+        {
+          seal(block);
+        }
+
+        return block;
+      }
+
+      seal(block);
+      continue;
+    }
+
+    // Every buffer is waiting to be appended
+    space_available.wait(lock);
+  }
+}
+
+void append_blob_writer::writer_state::seal(block_buffer& block)
+{
+  block.state = block_state::sealed;
+  fill_index = (fill_index + 1) % block_count;
+  work_available.notify_one();
+}
+
+///
+/// Appends the sealed blocks in order, one request at a time since each one starts where the previous one ended.
+/// The block being filled is sealed when it is old enough, when a flush needs it, or when the writer closes.
+///
+void append_blob_writer::writer_state::run()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true)
+  {
+    block_buffer& block = blocks[flush_index];
+    if (block.state == block_state::open && block.reserved > 0 &&
+      (closing || flush_target > appended || std::chrono::steady_clock::now() >= block.first_write + flush_interval))
+    {
+      seal(block);
+    }
+
+    if (block.state == block_state::sealed)
+    {
+      lock.unlock();
+
+      // The last producers may still be copying their records
+      while (block.written.load(std::memory_order_acquire) != block.reserved)
+      {
+        std::this_thread::yield();
+      }
+
+      std::exception_ptr failure;
+      try
+      {
+        append(block);
+      }
+      catch (...)
+      {
+        failure = std::current_exception();
+      }
+
+      lock.lock();
+
+      if (failure)
+      {
+        error = failure;
+        space_available.notify_all();
+        flushed.notify_all();
+        return;
+      }
+
+      appended += block.reserved;
+      block.state = block_state::free;
+      block.reserved = 0;
+      block.written.store(0, std::memory_order_relaxed);
+      flush_index = (flush_index + 1) % block_count;
+
+      space_available.notify_all();
+      flushed.notify_all();
+      continue;
+    }
+
+    if (closing)
+    {
+      return;
+    }
+
+    if (block.state == block_state::open && block.reserved > 0)
+    {
+      work_available.wait_until(lock, block.first_write + flush_interval);
+    }
+    else
+    {
+      work_available.wait(lock);
+    }
+  }
+}
+
+///
+/// Appends a block at the position where the previous one ended, so a block is never appended twice or out of order.
+///
+void append_blob_writer::writer_state::append(const block_buffer& block)
+{
+  concurrency::streams::rawptr_buffer<uint8_t> buffer(block.data.data(), block.reserved, std::ios::in);
+  concurrency::streams::istream block_stream(buffer);
+
+  access_condition condition = access_condition::generate_if_append_position_equal_condition(static_cast<int64_t>(position));
+  try
+  {
+    append_blob.append_block_async(block_stream, utility::string_t(), condition, blob_request_options(), operation_context()).get();
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    if (e.result().http_status_code() != web::http::status_codes::PreconditionFailed)
+    {
+      throw;
+    }
+
+    // When a request is retried after its first attempt succeeded, the retry fails the position condition.
+    // The block was appended if the blob ends where it would end with it.
+    cloud_append_blob current = append_blob.container().get_append_blob_reference(append_blob.name());
+    current.download_attributes();
+    if (current.properties().size() != position + block.reserved)
+    {
+      throw;
+    }
+  }
+
+  position += block.reserved;
+  requests++;
+}
@@ -0,0 +1,41 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+using namespace azure::storage;
+
+#pragma once
+class append_blob_writer
+{
+public:
+  append_blob_writer(cloud_append_blob append_blob, size_t block_size, size_t buffered_blocks, std::chrono::milliseconds flush_interval);
+  ~append_blob_writer();
+
+  void open();
+  void write(const void* data, size_t length);
+  void write(const std::string& record);
+  void flush();
+  transfer_stats close();
+
+private:
+  append_blob_writer(const append_blob_writer&);
+  append_blob_writer& operator=(const append_blob_writer&);
+
+  struct writer_state;
+
+  std::shared_ptr<writer_state> m_state;
+  std::thread m_flusher;
+};
@@ -16,7 +16,30 @@
 
 #include "stdafx.h"
 #include "string_util.h"
+#include "md5.h"
+#include "integrity_pipeline.h"
+#include "concurrency_controller.h"
+#include "request_tracer.h"
+#include "client_context.h"
 #include "blob_advanced.h"
+#include "task_util.h"
+#include "container_manager.h"
+#include "parallel_block_uploader.h"
+#include "sparse_page_uploader.h"
+#include "blob_lister.h"
+#include "copy_orchestrator.h"
+#include "lease_manager.h"
+#include "local_directory.h"
+#include "directory_sync.h"
+#include "blob_range_cache.h"
+#ifdef BUILD_GZIP_TRANSFER
+#include "compressed_transfer.h"
+#endif
+#include "bulk_property_updater.h"
+#include "prefix_deleter.h"
+#ifdef BUILD_PAGE_BLOB_BACKUP
+#include "page_blob_backup.h"
+#endif
 
 using namespace azure::storage;
 
@@ -28,45 +51,39 @@ blob_advanced::~blob_advanced()
 {
 }
 
-///
-/// Creates a container in the blob storage
-///
-cloud_blob_container blob_advanced::create_container(cloud_blob_client blob_client, utility::string_t container_name)
-{
-  // Get a reference to the container
-  cloud_blob_container container = blob_client.get_container_reference(container_name);
-  try
-  {
-    // Create the container if it does not exist yet
-    container.create_if_not_exists();
-
-    return container;
-  }
-  catch (const azure::storage::storage_exception& e)
-  {
-    ucout << U("Error:") << e.what() << std::endl << U("If you are running with the default configuration, make sure the storage emulator is started.") << std::endl;
-    throw;
-  }
-}
-
 ///
 /// This sample shows how to list all the available containers in an storage account.
 ///
-void blob_advanced::list_containers(cloud_blob_client blob_client)
+void blob_advanced::list_containers(const client_context& context)
 {
   // Generate a few containers using a 'sample-list-container' prefix
   utility::string_t container_prefix = U("sample-list-container-");
 
+  // Bulk operations run up to 8 requests at a time, and listings return up to 1000 containers per page
+  container_manager manager(8, 1000);
+
   // Try to generate 5 containers with random name using the prefix
+  std::vector<utility::string_t> container_names;
   for (int i = 0; i < 5; i++)
   {
-    create_container(blob_client, container_prefix + string_util::random_string());
+    container_names.push_back(container_prefix + string_util::random_string());
+  }
+
+  try
+  {
+    transfer_stats stats = manager.create_containers(context.blob_client(), container_names);
+    task_util::print_stats(U("Create containers"), stats);
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("If you are running with the default configuration, make sure the storage emulator is started.") << std::endl;
+    throw;
   }
 
   ucout << U("Listing all the available containers with prefix ") << container_prefix << std::endl;
   container_result_iterator end_of_results;
   // List the containers using the prefix. Passing in no prefix will list all the containers in the account.
-  for (auto it = blob_client.list_containers(container_prefix); it != end_of_results; ++it)
+  for (auto it = context.blob_client().list_containers(container_prefix); it != end_of_results; ++it)
   {
     ucout << U("Container, Name = ") << it->name() << ", URI = " << it->uri().primary_uri().to_string() << std::endl;
   }
@@ -74,11 +91,8 @@ void blob_advanced::list_containers(cloud_blob_client blob_client)
   ucout << U("Deleting all the containers with prefix ") << container_prefix << std::endl;
   try
   {
-    for (auto it = blob_client.list_containers(container_prefix); it != end_of_results; ++it)
-    {
-      cloud_blob_container container = blob_client.get_container_reference(it->name());
-      container.delete_container_if_exists();
-    }
+    transfer_stats stats = manager.delete_containers(context.blob_client(), container_prefix);
+    task_util::print_stats(U("Delete containers"), stats);
   }
   catch (const azure::storage::storage_exception& e)
   {
@@ -89,14 +103,14 @@ void blob_advanced::list_containers(cloud_blob_client blob_client)
 ///
 /// This sample shows how to set cors rules for the blob service so it can be accessed from a different domain in a web browser.
 ///
-void blob_advanced::set_cors_rules(cloud_blob_client blob_client)
+void blob_advanced::set_cors_rules(const client_context& context)
 {
   ucout << U("Setting cors rules for account") << std::endl;
 
   service_properties service_properties;
   try
   {
-    service_properties = blob_client.download_service_properties();
+    service_properties = context.blob_client().download_service_properties();
   }
   catch (const azure::storage::storage_exception& e)
   {
@@ -121,13 +135,13 @@ void blob_advanced::set_cors_rules(cloud_blob_client blob_client)
     service_properties_includes includes;
     includes.set_cors(true);
 
-    blob_client.upload_service_properties(service_properties, includes);
+    context.blob_client().upload_service_properties(service_properties, includes);
 
     // reverts the CORS rules back to the original ones
     service_properties.cors().clear();
     service_properties.cors().insert(service_properties.cors().end(), current_cors_rules.begin(), current_cors_rules.end());
 
-    blob_client.upload_service_properties(service_properties, includes);
+    context.blob_client().upload_service_properties(service_properties, includes);
   }
   catch (const azure::storage::storage_exception& e)
   {
@@ -136,29 +150,36 @@ void blob_advanced::set_cors_rules(cloud_blob_client blob_client)
 }
 
 ///
-/// This sample shows how a lease can be acquired on a blob for exclusive access.
+/// This sample shows how a lease can be acquired on a blob for exclusive access, and kept for longer than its
+/// duration by a lease manager renewing it in the background.
 ///
-void blob_advanced::lease_blob(cloud_blob_client blob_client)
+void blob_advanced::lease_blob(const client_context& context)
 {
   // Generate unique container name
   utility::string_t container_name = U("sample-lease-container-") + string_util::random_string();
 
   ucout << U("Creating container") << std::endl;
 
-  cloud_blob_container container = create_container(blob_client, container_name);
+  cloud_blob_container container = context.create_container(container_name);
 
   ucout << U("Creating blob") << std::endl;
 
   cloud_block_blob block_blob = container.get_block_blob_reference(U("exclusive"));
   block_blob.upload_text(U("Blob created"));
 
+  // The manager renews its 15 second leases every 7.5 seconds, whatever the number of leases held
+  lease_manager leases(std::chrono::seconds(15), 4);
+  leases.set_tracer(context.tracer());
   utility::string_t lease;
 
   try
   {
     ucout << U("Acquiring blob lease") << std::endl;
 
-    lease = block_blob.acquire_lease(lease_time(std::chrono::seconds(15)), U(""));
+    lease = leases.acquire(block_blob, [](const utility::string_t& lost_lease)
+    {
+      ucout << U("Lost lease ") << lost_lease << std::endl;
+    });
   }
   catch (const azure::storage::storage_exception& e)
   {
@@ -168,9 +189,6 @@ void blob_advanced::lease_blob(cloud_blob_client blob_client)
 
   access_condition access = access_condition::generate_lease_condition(lease);
 
-  blob_request_options options;
-  operation_context context;
-
   try
   {
     ucout << U("Trying to update blob without lease") << std::endl;
@@ -187,7 +205,7 @@ void blob_advanced::lease_blob(cloud_blob_client blob_client)
   {
     ucout << U("Trying to update blob with a lease ") << lease << std::endl;
 
-    block_blob.upload_text(U("Blob updated"), access, options, context);
+    block_blob.upload_text(U("Blob updated"), access, blob_request_options(), context.tracer()->create_context(U("upload_text")));
 
     ucout << U("Blob updated successfully") << std::endl;
   }
@@ -200,7 +218,7 @@ void blob_advanced::lease_blob(cloud_blob_client blob_client)
   {
     ucout << U("Releasing lease") << std::endl;
 
-    block_blob.release_lease(access);
+    leases.release(lease);
   }
   catch (const azure::storage::storage_exception& e)
   {
@@ -211,14 +229,14 @@ void blob_advanced::lease_blob(cloud_blob_client blob_client)
 ///
 /// This sample shows how a lease can be acquired on a container for exclusive access.
 ///
-void blob_advanced::lease_container(cloud_blob_client blob_client)
+void blob_advanced::lease_container(const client_context& context)
 {
   // Generate unique container name
   utility::string_t container_name = U("sample-lease-container-") + string_util::random_string();
 
   ucout << U("Creating container") << std::endl;
 
-  cloud_blob_container container = create_container(blob_client, container_name);
+  cloud_blob_container container = context.create_container(container_name);
 
   utility::string_t lease;
   try
@@ -247,14 +265,11 @@ void blob_advanced::lease_container(cloud_blob_client blob_client)
 
   access_condition access = access_condition::generate_lease_condition(lease);
 
-  blob_request_options options;
-  operation_context context;
-
   try
   {
     ucout << U("Trying to delete container with a lease ") << lease << std::endl;
 
-    container.delete_container(access, options, context);
+    container.delete_container(access, blob_request_options(), context.tracer()->create_context(U("delete_container")));
 
     ucout << U("Container deleted successfully") << std::endl;
   }
@@ -267,14 +282,14 @@ void blob_advanced::lease_container(cloud_blob_client blob_client)
 ///
 /// This sample shows how to copy a blob from one location to another and how to cancel an existing copy operation.
 ///
-void blob_advanced::copy_blob(cloud_blob_client blob_client)
+void blob_advanced::copy_blob(const client_context& context)
 {
   // Generate unique container name
   utility::string_t container_name = U("sample-copy-container-") + string_util::random_string();
 
   ucout << U("Creating container") << std::endl;
 
-  cloud_blob_container container = create_container(blob_client, container_name);
+  cloud_blob_container container = context.create_container(container_name);
 
   cloud_block_blob source_blob = container.get_block_blob_reference(U("source"));
   try
@@ -353,10 +368,32 @@ void blob_advanced::copy_blob(cloud_blob_client blob_client)
     }
   }
 
+  cloud_blob_container target_container = context.create_container(U("sample-copy-target-") + string_util::random_string());
+  try
+  {
+    ucout << U("Copying all the blobs of the container") << std::endl;
+
+    // Up to 8 copies are started at once, and the pending ones are checked after 100 ms, then at most every 5 s
+    copy_orchestrator orchestrator(8, std::chrono::milliseconds(100), std::chrono::milliseconds(5000));
+    orchestrator.set_tracer(context.tracer());
+    transfer_stats stats = orchestrator.copy_container(container, target_container, utility::string_t(), [](const copy_progress& progress)
+    {
+      ucout << U("Copied ") << progress.succeeded << U(" of ") << progress.started << U(" blobs, ") << progress.failed << U(" failed, ")
+        << progress.bytes_copied << U(" of ") << progress.total_bytes << U(" bytes") << std::endl;
+    });
+
+    task_util::print_stats(U("Container copy"), stats);
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("The container could not be copied.") << std::endl;
+  }
+
   try
   {
     ucout << U("Deleting container") << std::endl;
     container.delete_container_if_exists();
+    target_container.delete_container_if_exists();
   }
   catch (const azure::storage::storage_exception& e)
   {
@@ -368,7 +405,7 @@ void blob_advanced::copy_blob(cloud_blob_client blob_client)
 ///
 /// This sample shows how to upload and commit a batch of blocks with data in a block blob.
 ///
-void blob_advanced::file_upload_with_blocks(cloud_blob_client blob_client)
+void blob_advanced::file_upload_with_blocks(const client_context& context)
 {
   const utility::string_t image_file(U("HelloWorld.png"));
 
@@ -377,42 +414,50 @@ void blob_advanced::file_upload_with_blocks(cloud_blob_client blob_client)
 
   ucout << U("Creating container") << std::endl;
 
-  cloud_blob_container container = create_container(blob_client, container_name);
+  cloud_blob_container container = context.create_container(container_name);
 
   ucout << U("Creating blob") << std::endl;
 
   cloud_block_blob block_blob = container.get_block_blob_reference(image_file);
 
-  std::vector<block_list_item> blocks;
-
-  ucout << U("Creating block id") << std::endl;
-
-  utility::string_t block_id = utility::uuid_to_string(utility::new_uuid());
-  std::vector<unsigned char> block_id_as_array(block_id.cbegin(), block_id.cend());
-  utility::string_t encoded_block_id(utility::conversions::to_base64(block_id_as_array));
-
-  concurrency::streams::istream file_stream = concurrency::streams::file_stream<uint8_t>::open_istream(image_file).get();
+  // Small blocks are used so the sample file is split in a few of them. Use a few MB per block for large files.
+  const size_t block_size = 4 * 1024;
+  const size_t parallelism = 4;
 
   try
   {
-    ucout << U("Pushing file content in block with id ") << encoded_block_id << std::endl;
-
-    block_blob.upload_block(encoded_block_id, file_stream, utility::string_t(U("")));
-    blocks.push_back(block_list_item(encoded_block_id));
+    ucout << U("Pushing file content in blocks of ") << block_size << U(" bytes") << std::endl;
+
+    // The uploaded blocks are recorded in a journal, so an upload that fails can be resumed
+    // without sending the blocks already uploaded again.
+    // The number of blocks in flight is chosen by the concurrency controller shared by the block uploads.
+    parallel_block_uploader uploader(block_size, parallelism);
+    uploader.set_controller(context.block_controller());
+    uploader.set_pipeline(context.pipeline());
+    uploader.set_tracer(context.tracer());
+    const utility::string_t journal_file = image_file + U(".journal");
+
+    transfer_stats stats;
+    try
+    {
+      stats = uploader.upload_file_resumable(block_blob, image_file, journal_file);
+    }
+    catch (const azure::storage::storage_exception& e)
+    {
+      ucout << U("Error:") << e.what() << std::endl << U("Resuming the upload") << std::endl;
+      stats = uploader.upload_file_resumable(block_blob, image_file, journal_file);
+    }
 
-    ucout << U("Commiting block with id ") << encoded_block_id << std::endl;
-    block_blob.upload_block_list(blocks);
+    task_util::print_stats(U("Block upload"), stats);
   }
   catch (const azure::storage::storage_exception& e)
   {
     ucout << U("Error:") << e.what() << std::endl << "The file could not be uploaded" << std::endl;
   }
 
-  file_stream.close();
-
   ucout << U("Enumerating block list") << std::endl;
 
-  blocks = block_blob.download_block_list();
+  std::vector<block_list_item> blocks = block_blob.download_block_list();
 
   std::vector<block_list_item>::iterator it;
 
@@ -434,58 +479,324 @@ void blob_advanced::file_upload_with_blocks(cloud_blob_client blob_client)
 }
 
 ///
-/// This sample shows the usage of a page blob. 
-/// A file in disk is splitted in several pages and uploaded to the storage using a page blob.
+/// This sample shows how to mirror a local directory tree to a container and back, transferring only the files
+/// that changed since the last synchronization.
 ///
-void blob_advanced::page_blob_operations(cloud_blob_client blob_client)
+void blob_advanced::sync_directory(const client_context& context)
 {
   const utility::string_t image_file(U("HelloWorld.png"));
-  const int page_size = 1024;
+  const utility::string_t local_tree(U("sync-sample"));
 
   // Generate unique container name
-  utility::string_t container_name = U("blobpagedemocontainer") + string_util::random_string();
+  utility::string_t container_name = U("sample-sync-container-") + string_util::random_string();
 
   ucout << U("Creating container") << std::endl;
 
-  cloud_blob_container container = create_container(blob_client, container_name);
+  cloud_blob_container container = context.create_container(container_name);
 
-  ucout << U("Creating blob") << std::endl;
+  ucout << U("Creating a local directory tree") << std::endl;
 
-  cloud_page_blob page_blob = container.get_page_blob_reference(image_file);
-  page_blob.create(1024 * 1024);
+  local_directory::create_parent_directories(U("."), local_tree + U("/images/") + image_file);
+  local_directory::create_parent_directories(U("."), local_tree + U("/notes/readme.txt"));
+  {
+    std::ifstream image(utility::conversions::to_utf8string(image_file), std::ios::binary);
+    std::ofstream copy(utility::conversions::to_utf8string(local_tree + U("/images/") + image_file), std::ios::binary);
+    copy << image.rdbuf();
+  }
 
-  std::ifstream file;
-  std::vector<char> vector_buffer;
-  int read_buffer[page_size];
-  int index = 0;
+  for (int i = 0; i < 10; i++)
+  {
+    std::ofstream note(utility::conversions::to_utf8string(local_tree + U("/notes/note-") + utility::conversions::print_string(i) + U(".txt")));
+    note << "note " << i << std::endl;
+  }
 
-  vector_buffer.reserve(page_size);
+  // Small blocks are used so the sample image is uploaded in a few of them
+  directory_sync sync(4 * 1024, 4);
+  sync.set_pipeline(context.pipeline());
+  sync.set_tracer(context.tracer());
+  try
+  {
+    ucout << U("Uploading the directory tree") << std::endl;
+    task_util::print_stats(U("First upload"), sync.upload(local_tree, container, U("backup/")));
 
-  ucout << U("Uploading file content in pages. Every page must be a multiple of 512 bytes") << std::endl;
+    // Nothing changed, the tree and the container are compared without sending any file
+    ucout << U("Uploading the directory tree again") << std::endl;
+    task_util::print_stats(U("Unchanged upload"), sync.upload(local_tree, container, U("backup/")));
 
-  file.open(image_file, std::ios::binary);
+    {
+      std::ofstream note(utility::conversions::to_utf8string(local_tree + U("/notes/note-0.txt")), std::ios::app);
+      note << "changed" << std::endl;
+    }
 
-  while (file.read((char *)&read_buffer, sizeof(read_buffer)))
+    ucout << U("Uploading the directory tree with one file changed") << std::endl;
+    task_util::print_stats(U("Changed upload"), sync.upload(local_tree, container, U("backup/")));
+
+    ucout << U("Downloading the container to another directory") << std::endl;
+    local_directory::create_parent_directories(U("."), U("sync-sample-copy/"));
+    sync_download download = sync.download(container, U("backup/"), U("sync-sample-copy"));
+    task_util::print_stats(U("Download"), download.stats);
+    for (const utility::string_t& name : download.rejected_names)
+    {
+      ucout << U("Skipped blob with an unsafe name: ") << name << std::endl;
+    }
+  }
+  catch (const azure::storage::storage_exception& e)
   {
-    vector_buffer.insert(vector_buffer.end(), &read_buffer[0], &read_buffer[page_size]);
+    ucout << U("Error:") << e.what() << std::endl << U("The directory could not be synchronized.") << std::endl;
+  }
 
-    concurrency::streams::istream page_stream = concurrency::streams::bytestream::open_istream(vector_buffer);
-    azure::storage::page_range range(index * page_size, index * page_size + page_size - 1);
+  ucout << U("Deleting container") << std::endl;
+  try
+  {
+    container.delete_container_if_exists();
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("The container could not be deleted.") << std::endl;
+  }
+}
 
-    try
+///
+/// This sample shows how to serve repeated reads of the same blob ranges from a local cache, without ever
+/// returning data of a previous version of the blob.
+///
+void blob_advanced::cached_range_reads(const client_context& context)
+{
+  const utility::string_t image_file(U("HelloWorld.png"));
+
+  // Generate unique container name
+  utility::string_t container_name = U("sample-cache-container-") + string_util::random_string();
+
+  ucout << U("Creating container") << std::endl;
+
+  cloud_blob_container container = context.create_container(container_name);
+
+  try
+  {
+    cloud_block_blob block_blob = container.get_block_blob_reference(image_file);
+    block_blob.upload_from_file(image_file);
+
+    // Pages of 1 KiB, 16 of them in memory and 64 more in a file. The version of the blob is trusted
+    // for one second after the service last confirmed it.
+    blob_range_cache cache(1024, 16, std::chrono::milliseconds(1000));
+    cache.set_disk_tier(U("blob-range-cache.tmp"), 64);
+
+    ucout << U("Reading the same ranges of the blob several times") << std::endl;
+    for (int pass = 0; pass < 3; pass++)
     {
-      page_blob.upload_pages(page_stream, range.start_offset(), utility::string_t(U("")));
+      for (utility::size64_t offset = 0; offset < 8192; offset += 2048)
+      {
+        cache.read(block_blob, offset, 3000);
+      }
     }
-    catch (const azure::storage::storage_exception& e)
+
+    ucout << U("Replacing the blob and reading it again") << std::endl;
+    cloud_block_blob writer = container.get_block_blob_reference(image_file);
+    writer.upload_text(U("The blob was replaced"));
+
+    // The version is checked again once the validation interval has elapsed
+    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    std::vector<uint8_t> content = cache.read(block_blob, 0, 3000);
+    ucout << U("Read after the change: ") << utility::conversions::to_string_t(std::string(content.begin(), content.end())) << std::endl;
+
+    cache_stats stats = cache.stats();
+    ucout << U("Cache: ") << stats.memory_hits << U(" memory hits, ") << stats.disk_hits << U(" disk hits, ")
+      << stats.misses << U(" misses, ") << stats.requests << U(" requests, ") << stats.evictions << U(" evictions, ")
+      << stats.invalidations << U(" invalidations, hit ratio ") << std::fixed << std::setprecision(2) << stats.hit_ratio() << std::endl;
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("The blob could not be read through the cache.") << std::endl;
+  }
+
+  ucout << U("Deleting container") << std::endl;
+  try
+  {
+    container.delete_container_if_exists();
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("The container could not be deleted.") << std::endl;
+  }
+}
+
+#ifdef BUILD_GZIP_TRANSFER
+///
+/// This sample shows how to upload a compressible file compressed with gzip, and download it decompressed.
+///
+void blob_advanced::compressed_upload(const client_context& context)
+{
+  const utility::string_t log_file(U("sample-log.csv"));
+  const utility::string_t copy_file(U("copy of sample-log.csv"));
+
+  // Generate unique container name
+  utility::string_t container_name = U("sample-gzip-container-") + string_util::random_string();
+
+  ucout << U("Creating container") << std::endl;
+
+  cloud_blob_container container = context.create_container(container_name);
+
+  ucout << U("Writing a log file") << std::endl;
+  utility::size64_t log_size = 0;
+  {
+    std::ofstream log(utility::conversions::to_utf8string(log_file), std::ios::binary);
+    for (int record = 0; record < 50000; record++)
+    {
+      log << "2016-01-01T00:00:" << std::setw(2) << std::setfill('0') << record % 60 << "Z,sample-host," << record % 7 << ",request served in " << record % 100 << " ms\n";
+    }
+
+    log_size = static_cast<utility::size64_t>(log.tellp());
+  }
+
+  try
+  {
+    // Blocks of 256 KiB are compressed on up to 8 threads, at the default zlib level
+    compressed_transfer transfer(256 * 1024, 8, 6);
+
+    ucout << U("Uploading the log compressed") << std::endl;
+    cloud_block_blob block_blob = container.get_block_blob_reference(log_file);
+    transfer_stats stats = transfer.upload_file(block_blob, log_file);
+    task_util::print_stats(U("Compressed upload"), stats);
+    ucout << U("Compression ratio: ") << std::fixed << std::setprecision(2) << static_cast<double>(log_size) / stats.bytes << std::endl;
+
+    ucout << U("Downloading the log decompressed") << std::endl;
+    stats = transfer.download_to_file(container.get_blob_reference(log_file), copy_file);
+    task_util::print_stats(U("Decompressed download"), stats);
+
+    std::ifstream copy(utility::conversions::to_utf8string(copy_file), std::ios::binary | std::ios::ate);
+    ucout << U("Downloaded ") << static_cast<utility::size64_t>(copy.tellg()) << U(" bytes of ") << log_size << std::endl;
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("The compressed file could not be transferred.") << std::endl;
+  }
+
+  ucout << U("Deleting container") << std::endl;
+  try
+  {
+    container.delete_container_if_exists();
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("The container could not be deleted.") << std::endl;
+  }
+}
+#endif
+
+///
+/// This sample shows how to delete the blobs under a prefix with their snapshots, leaving the rest of the container.
+///
+void blob_advanced::delete_by_prefix(const client_context& context)
+{
+  // Generate unique container name
+  utility::string_t container_name = U("sample-purge-container-") + string_util::random_string();
+
+  ucout << U("Creating container") << std::endl;
+
+  cloud_blob_container container = context.create_container(container_name);
+
+  ucout << U("Uploading blobs under two prefixes") << std::endl;
+  try
+  {
+    std::vector<pplx::task<void>> uploads;
+    for (int i = 0; i < 500; i++)
     {
-      ucout << U("Error:") << e.what() << std::endl;
+      utility::string_t prefix = i < 450 ? U("logs/2016/") : U("logs/2017/");
+      cloud_block_blob log_blob = container.get_block_blob_reference(prefix + utility::conversions::print_string(i));
+      uploads.push_back(log_blob.upload_text_async(U("log entry")).then([log_blob, i]() mutable -> pplx::task<void>
+      {
+        // Some of the blobs have a snapshot, which has to go with them
+        if (i % 50 == 0)
+        {
+          return log_blob.create_snapshot_async().then([](cloud_blob)
+          {
+          });
+        }
+
+        return pplx::task_from_result();
+      }));
     }
 
-    vector_buffer.clear();
-    index++;
+    pplx::when_all(uploads.begin(), uploads.end()).wait();
   }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("The blobs could not be uploaded.") << std::endl;
+  }
+
+  ucout << U("Deleting the blobs under logs/2016/") << std::endl;
+  try
+  {
+    // The checkpoint is called after each page of up to 5000 blobs with the token of the next page. An application
+    // would save the token, and pass it back to resume a deletion that was interrupted.
+    prefix_deleter deleter(16);
+    deleter.set_controller(context.delete_controller());
+    continuation_token saved_token;
+    delete_stats stats = deleter.delete_prefix(container, U("logs/2016/"), continuation_token(), [&saved_token](const continuation_token& token)
+    {
+      saved_token = token;
+    });
 
-  file.close();
+    ucout << U("Deleted ") << stats.blobs << U(" blobs and ") << stats.snapshots << U(" snapshots in ") << stats.seconds << U(" s (")
+      << stats.deletes_per_second() << U(" per second), ") << stats.failed << U(" failed, ") << (stats.complete ? U("complete") : U("to be resumed"))
+      << std::endl;
+
+    list_blob_item_segment remaining = container.list_blobs_segmented(U("logs/"), true, blob_listing_details::none, task_util::max_listing_results, continuation_token(),
+      blob_request_options(), operation_context());
+    ucout << U("Blobs left under logs/: ") << remaining.results().size() << std::endl;
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("The blobs could not be deleted.") << std::endl;
+  }
+
+  ucout << U("Deleting container") << std::endl;
+  try
+  {
+    container.delete_container_if_exists();
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("The container could not be deleted.") << std::endl;
+  }
+}
+
+///
+/// This sample shows the usage of a page blob. 
+/// A file in disk is splitted in several pages and uploaded to the storage using a page blob.
+///
+void blob_advanced::page_blob_operations(const client_context& context)
+{
+  const utility::string_t image_file(U("HelloWorld.png"));
+
+  // Generate unique container name
+  utility::string_t container_name = U("blobpagedemocontainer") + string_util::random_string();
+
+  ucout << U("Creating container") << std::endl;
+
+  cloud_blob_container container = context.create_container(container_name);
+
+  cloud_page_blob page_blob = container.get_page_blob_reference(image_file);
+
+  ucout << U("Uploading file content in pages. Every page must be a multiple of 512 bytes") << std::endl;
+
+  try
+  {
+    // Contiguous pages are sent together in writes of up to 4 MB, pages with only zeros are skipped.
+    // The number and the size of the writes in flight are chosen by the concurrency controller shared by the
+    // page writes.
+    sparse_page_uploader uploader(4 * 1024 * 1024, 4);
+    uploader.set_controller(context.page_controller());
+    uploader.set_pipeline(context.pipeline());
+    uploader.set_tracer(context.tracer());
+    transfer_stats stats = uploader.upload_file(page_blob, image_file);
+
+    task_util::print_stats(U("Page upload"), stats);
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl;
+  }
 
   ucout << U("Listing pages") << std::endl;
 
@@ -498,6 +809,40 @@ void blob_advanced::page_blob_operations(cloud_blob_client blob_client)
     ucout << U("Page ") << it->start_offset() << " - " << it->end_offset() << std::endl;
   }
 
+#ifdef BUILD_PAGE_BLOB_BACKUP
+  ucout << U("Backing up the page blob through snapshots") << std::endl;
+
+  try
+  {
+    const utility::string_t backup_file(U("backup of HelloWorld.png"));
+    page_blob_backup backup(1024 * 1024, 4);
+    backup.set_controller(context.range_controller());
+
+    // The first backup downloads every written page of a snapshot of the blob
+    page_backup full = backup.backup(page_blob, backup_file, utility::string_t());
+    task_util::print_stats(U("Full backup"), full.stats);
+
+    // One page is written and another one cleared, as a disk changes between two backups
+    std::vector<uint8_t> page(512, 0x5a);
+    concurrency::streams::istream page_stream = concurrency::streams::bytestream::open_istream(page);
+    page_blob.upload_pages(page_stream, 0, utility::string_t());
+    page_stream.close().wait();
+    page_blob.clear_pages(512, 512);
+
+    // The next backup only downloads the pages changed since the snapshot of the first one, which is not needed
+    // anymore. The snapshot of the latest backup is kept as the base of the next one.
+    page_backup incremental = backup.backup(page_blob, backup_file, full.snapshot_time);
+    task_util::print_stats(U("Incremental backup"), incremental.stats);
+    ucout << U("Changed ranges: ") << incremental.changed_ranges << U(", cleared ranges: ") << incremental.cleared_ranges << std::endl;
+
+    container.get_page_blob_reference(image_file, full.snapshot_time).delete_blob();
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("The page blob could not be backed up.") << std::endl;
+  }
+#endif
+
   ucout << U("Deleting container") << std::endl;
 
   try
@@ -513,14 +858,14 @@ void blob_advanced::page_blob_operations(cloud_blob_client blob_client)
 ///
 /// This sample shows how to set the service properties (logging and metrics) for the blob service.
 ///
-void blob_advanced::set_service_properties(cloud_blob_client blob_client)
+void blob_advanced::set_service_properties(const client_context& context)
 {
   ucout << U("Setting service properties for the account") << std::endl;
 
   service_properties service_properties;
   try
   {
-    service_properties = blob_client.download_service_properties();
+    service_properties = context.blob_client().download_service_properties();
   }
   catch (const azure::storage::storage_exception& e)
   {
@@ -568,7 +913,7 @@ void blob_advanced::set_service_properties(cloud_blob_client blob_client)
 
   try
   {
-    blob_client.upload_service_properties(service_properties, includes);
+    context.blob_client().upload_service_properties(service_properties, includes);
   }
   catch (const azure::storage::storage_exception& e)
   {
@@ -582,7 +927,7 @@ void blob_advanced::set_service_properties(cloud_blob_client blob_client)
 
   try
   {
-    blob_client.upload_service_properties(service_properties, includes);
+    context.blob_client().upload_service_properties(service_properties, includes);
   }
   catch (const azure::storage::storage_exception& e)
   {
@@ -593,7 +938,7 @@ void blob_advanced::set_service_properties(cloud_blob_client blob_client)
 ///
 /// This sample shows how to set additional properties and metadata on a container and blob.
 ///
-void blob_advanced::set_metadata_and_properties(cloud_blob_client blob_client)
+void blob_advanced::set_metadata_and_properties(const client_context& context)
 {
   const utility::string_t image_file(U("HelloWorld.png"));
 
@@ -602,7 +947,7 @@ void blob_advanced::set_metadata_and_properties(cloud_blob_client blob_client)
 
   ucout << U("Creating container") << std::endl;
 
-  cloud_blob_container container = create_container(blob_client, container_name);
+  cloud_blob_container container = context.create_container(container_name);
 
   ucout << U("Uploading container metadata") << std::endl;
 
@@ -652,6 +997,60 @@ void blob_advanced::set_metadata_and_properties(cloud_blob_client blob_client)
     ucout << U("Error:") << e.what() << std::endl << U("The metadata could not be uploaded.") << std::endl;
   }
 
+  ucout << U("Retagging blobs in bulk") << std::endl;
+
+  try
+  {
+    std::vector<pplx::task<void>> uploads;
+    for (int i = 0; i < 100; i++)
+    {
+      cloud_block_blob log_blob = container.get_block_blob_reference(U("logs/log-") + utility::conversions::print_string(i));
+      uploads.push_back(log_blob.upload_text_async(U("log entry")));
+    }
+
+    pplx::when_all(uploads.begin(), uploads.end()).wait();
+
+    // The updates are read one at a time, as they would be from a file. Every log gets the same content type and a
+    // retention tag, and every tenth one is also marked for review by a second update, merged with its first one.
+    // Applied a second time, the updates find every blob already tagged and write nothing.
+    bulk_property_updater updater(16, 3);
+    for (int pass = 0; pass < 2; pass++)
+    {
+      int next = 0;
+      update_stats stats = updater.apply(container, U("logs/"), [&next](blob_update& update)
+      {
+        if (next >= 110)
+        {
+          return false;
+        }
+
+        int log = next < 100 ? next : (next - 100) * 10;
+        update.blob_name = U("logs/log-") + utility::conversions::print_string(log);
+        if (next < 100)
+        {
+          update.content_type = U("text/plain; charset=utf-8");
+          update.metadata[U("retention")] = U("30d");
+        }
+        else
+        {
+          update.metadata[U("review")] = U("true");
+        }
+
+        next++;
+        return true;
+      });
+
+      ucout << U("Updates: ") << stats.updates << U(" (") << stats.merged << U(" merged), written: ") << stats.written
+        << U(", unchanged: ") << stats.unchanged << U(", missing: ") << stats.missing << U(", failed: ") << stats.failed
+        << U(", requests: ") << stats.requests << U(", updates/s: ") << stats.updates_per_second()
+        << U(", conflict rate: ") << stats.conflict_rate() << std::endl;
+    }
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("The blobs could not be retagged.") << std::endl;
+  }
+
   ucout << U("Deleting container") << std::endl;
   try
   {
@@ -667,14 +1066,14 @@ void blob_advanced::set_metadata_and_properties(cloud_blob_client blob_client)
 ///
 /// This sample shows how to set the a named permissions on a container.
 ///
-void blob_advanced::set_container_acl(cloud_blob_client blob_client)
+void blob_advanced::set_container_acl(const client_context& context)
 {
   // Generate unique container name
   utility::string_t container_name = U("sample-block-container-") + string_util::random_string();
 
   ucout << U("Creating container") << std::endl;
 
-  cloud_blob_container container = create_container(blob_client, container_name);
+  cloud_blob_container container = context.create_container(container_name);
 
   // Permission expires in 1 hour
   utility::datetime expiry = utility::datetime::utc_now() + utility::datetime::from_hours(1);
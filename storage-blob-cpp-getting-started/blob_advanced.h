@@ -23,17 +23,21 @@ public:
   blob_advanced();
   ~blob_advanced();
 
-  static void list_containers(cloud_blob_client blob_client);
-  static void set_cors_rules(cloud_blob_client blob_client);
-  static void lease_blob(cloud_blob_client blob_client);
-  static void lease_container(cloud_blob_client blob_client);
-  static void copy_blob(cloud_blob_client blob_client);
-  static void file_upload_with_blocks(cloud_blob_client blob_client);
-  static void page_blob_operations(cloud_blob_client blob_client);
-  static void set_service_properties(cloud_blob_client blob_client);
-  static void set_metadata_and_properties(cloud_blob_client blob_client);
-  static void set_container_acl(cloud_blob_client blob_client);
-private:
-  static cloud_blob_container create_container(cloud_blob_client blob_client, utility::string_t container_name);
+  static void list_containers(const client_context& context);
+  static void set_cors_rules(const client_context& context);
+  static void lease_blob(const client_context& context);
+  static void lease_container(const client_context& context);
+  static void copy_blob(const client_context& context);
+  static void file_upload_with_blocks(const client_context& context);
+  static void sync_directory(const client_context& context);
+  static void cached_range_reads(const client_context& context);
+#ifdef BUILD_GZIP_TRANSFER
+  static void compressed_upload(const client_context& context);
+#endif
+  static void delete_by_prefix(const client_context& context);
+  static void page_blob_operations(const client_context& context);
+  static void set_service_properties(const client_context& context);
+  static void set_metadata_and_properties(const client_context& context);
+  static void set_container_acl(const client_context& context);
 };
 
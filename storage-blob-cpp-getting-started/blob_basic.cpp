@@ -16,7 +16,17 @@
 
 #include "stdafx.h"
 #include "string_util.h"
+#include "md5.h"
+#include "integrity_pipeline.h"
+#include "concurrency_controller.h"
+#include "request_tracer.h"
+#include "client_context.h"
 #include "blob_basic.h"
+#include "task_util.h"
+#include "delta_block_uploader.h"
+#include "parallel_range_downloader.h"
+#include "blob_lister.h"
+#include "append_blob_writer.h"
 
 using namespace azure::storage;
 
@@ -29,31 +39,10 @@ blob_basic::~blob_basic()
 {
 }
 
-///
-/// Creates a container in the blob storage
-///
-cloud_blob_container blob_basic::create_container(cloud_blob_client blob_client, utility::string_t container_name)
-{
-  // Get a reference to the container
-  cloud_blob_container container = blob_client.get_container_reference(container_name);
-  try
-  {
-    // Create the container if it does not exist yet
-    container.create_if_not_exists();
-
-    return container;
-  }
-  catch (const azure::storage::storage_exception& e)
-  {
-    ucout << U("Error:") << e.what() << std::endl << U("If you are running with the default configuration, make sure the storage emulator is started.") << std::endl;
-    throw;
-  }
-}
-
 ///
 /// This sample shows how to perform basic operations on block blobs.
 ///
-void blob_basic::block_blob_operations(cloud_blob_client blob_client)
+void blob_basic::block_blob_operations(const client_context& context)
 {
   const utility::string_t image_file(U("HelloWorld.png"));
 
@@ -62,7 +51,7 @@ void blob_basic::block_blob_operations(cloud_blob_client blob_client)
 
   ucout << U("Creating container") << std::endl;
 
-  cloud_blob_container container = create_container(blob_client, container_name);
+  cloud_blob_container container = context.create_container(container_name);
 
   ucout << U("Uploading BlockBlob") << std::endl;
 
@@ -80,16 +69,37 @@ void blob_basic::block_blob_operations(cloud_blob_client blob_client)
     ucout << U("Error:") << e.what() << std::endl << U("The file could not uploaded.") << std::endl;
   }
 
+  ucout << U("Uploading BlockBlob in content-defined chunks") << std::endl;
+  try
+  {
+    //Push the file again, in content-defined chunks. Uploading a new version of the file only sends the chunks
+    //that changed, here none the second time. Small chunks are used so the sample file is split in a few of them.
+    delta_block_uploader uploader(4 * 1024, 4);
+    uploader.set_pipeline(context.pipeline());
+    uploader.set_tracer(context.tracer());
+    transfer_stats stats = uploader.upload_file(block_blob, image_file);
+    task_util::print_stats(U("Delta upload"), stats);
+
+    stats = uploader.upload_file(block_blob, image_file);
+    task_util::print_stats(U("Repeated delta upload"), stats);
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("The file could not be uploaded in chunks.") << std::endl;
+  }
+
   ucout << U("Listing all blobs and directories in container ") << std::endl;
   try
   {
-    //Enumerate all the blobs in the container
-    list_blob_item_iterator end_of_results;
-    for (auto it = container.list_blobs(); it != end_of_results; ++it)
+    //Enumerate all the blobs in the container, one page of up to 1000 results at a time.
+    //The next two pages are requested while the current one is processed.
+    blob_lister lister(container, utility::string_t(), true, utility::string_t(), 1000, 2);
+    blob_listing page;
+    while (lister.next_page(page))
     {
-      if (it->is_blob())
+      for (size_t i = 0; i < page.size(); i++)
       {
-        ucout << U("Blob: ") << it->as_blob().uri().primary_uri().to_string() << std::endl;
+        ucout << U("Blob: ") << page.name(i) << U(", Size = ") << page[i].size << std::endl;
       }
     }
   }
@@ -117,6 +127,24 @@ void blob_basic::block_blob_operations(cloud_blob_client blob_client)
     ucout << U("Error:") << e.what() << std::endl << U("The file could not be downloaded.") << std::endl;
   }
 
+  ucout << U("Downloading blob in ranges from ") << block_blob.uri().primary_uri().to_string() << std::endl;
+  try
+  {
+    // Pull the data again into another file, several ranges at a time. Small ranges are used so the sample file
+    // is split in a few of them, and the concurrency controller shared by the range reads chooses how many are
+    // in flight.
+    parallel_range_downloader downloader(4 * 1024, 4);
+    downloader.set_controller(context.range_controller());
+    downloader.set_tracer(context.tracer());
+    transfer_stats stats = downloader.download_to_file(block_blob, U("ranged copy of hello_world.png"));
+
+    task_util::print_stats(U("Ranged download"), stats);
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("The file could not be downloaded in ranges.") << std::endl;
+  }
+
   ucout << U("Creating a read-only snapshot of the blob") << std::endl;
   try
   {
@@ -133,7 +161,7 @@ void blob_basic::block_blob_operations(cloud_blob_client blob_client)
   {
     // Delete the block blob and all the associated snapshots
     block_blob.delete_blob(delete_snapshots_option::include_snapshots,
-      access_condition::generate_empty_condition(), *new blob_request_options(), *new operation_context());
+      access_condition::generate_empty_condition(), blob_request_options(), context.tracer()->create_context(U("delete_blob")));
 
   }
   catch (const azure::storage::storage_exception& e)
@@ -157,14 +185,14 @@ void blob_basic::block_blob_operations(cloud_blob_client blob_client)
 ///
 /// This sample shows how to perform basic operations on append blobs.
 ///
-void blob_basic::append_blob_operations(cloud_blob_client blob_client)
+void blob_basic::append_blob_operations(const client_context& context)
 {
   // Generate unique container name
   utility::string_t container_name = U("sample-append-container-") + string_util::random_string();
 
   ucout << U("Creating container") << std::endl;
 
-  cloud_blob_container container = create_container(blob_client, container_name);
+  cloud_blob_container container = context.create_container(container_name);
 
   ucout << U("Uploading AppendBlob") << std::endl;
   cloud_append_blob append_blob = container.get_append_blob_reference(U("my-append-blob"));
@@ -197,8 +225,16 @@ void blob_basic::append_blob_operations(cloud_blob_client blob_client)
   ucout << U("Downloading AppendBlob") << std::endl;
   try
   {
-    // Download all the data in append blob as text
-    utility::string_t append_text = append_blob.download_text();
+    // Download all the data in append blob as text. The download is traced as a whole, so its duration and the
+    // transfer of the response body are recorded besides the requests.
+    utility::string_t append_text;
+    context.tracer()->trace_async(U("download_text"), [&append_blob, &append_text](operation_context operation)
+    {
+      return append_blob.download_text_async(access_condition(), blob_request_options(), operation).then([&append_text](utility::string_t text)
+      {
+        append_text = text;
+      });
+    }).get();
     ucout << U("Append Text: ") << append_text << std::endl;
   }
   catch (const azure::storage::storage_exception& e)
@@ -206,6 +242,50 @@ void blob_basic::append_blob_operations(cloud_blob_client blob_client)
     ucout << U("Error:") << e.what() << std::endl << U("The appendblob could not be downloaded.") << std::endl;
   }
 
+  ucout << U("Appending log records in batches") << std::endl;
+  try
+  {
+    cloud_append_blob log_blob = container.get_append_blob_reference(U("my-log-blob"));
+    log_blob.properties().set_content_type(U("text/plain; charset=utf-8"));
+    log_blob.create_or_replace();
+
+    // The records written by several threads are gathered in blocks of up to 4 MiB,
+    // and a block is appended at the latest 200 ms after its first record was written.
+    append_blob_writer writer(log_blob, 4 * 1024 * 1024, 4, std::chrono::milliseconds(200));
+    writer.open();
+
+    std::vector<std::thread> producers;
+    for (int producer = 0; producer < 4; producer++)
+    {
+      producers.push_back(std::thread([&writer, producer]()
+      {
+        try
+        {
+          for (int record = 0; record < 10000; record++)
+          {
+            writer.write("producer " + std::to_string(producer) + " record " + std::to_string(record) + "\n");
+          }
+        }
+        catch (const std::exception&)
+        {
+          // The failure is reported when the writer is closed
+        }
+      }));
+    }
+
+    for (std::thread& producer : producers)
+    {
+      producer.join();
+    }
+
+    transfer_stats stats = writer.close();
+    task_util::print_stats(U("Batched append"), stats);
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("The log records could not be appended.") << std::endl;
+  }
+
   ucout << U("Deleting AppendBlob") << std::endl;
   try
   {
@@ -23,9 +23,7 @@ public:
 	blob_basic();
 	~blob_basic();
 
-	static void block_blob_operations(cloud_blob_client blob_client);
-	static void append_blob_operations(cloud_blob_client blob_client);
-private:
-  static cloud_blob_container create_container(cloud_blob_client blob_client, utility::string_t container_name);
+	static void block_blob_operations(const client_context& context);
+	static void append_blob_operations(const client_context& context);
 };
 
@@ -0,0 +1,222 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "blob_lister.h"
+
+using namespace azure::storage;
+
+struct blob_lister::listing_state
+{
+  listing_state() : use_flat_blob_listing(true), max_results(0), prefetch_pages(1), fetching(false), done(false) {}
+
+  cloud_blob_container container;
+  utility::string_t prefix;
+  bool use_flat_blob_listing;
+  int max_results;
+  size_t prefetch_pages;
+
+  std::mutex mutex;
+  std::condition_variable page_ready;
+  std::deque<list_blob_item_segment> pages;
+  continuation_token token;
+  bool fetching;
+  bool done;
+  std::exception_ptr error;
+};
+
+size_t blob_listing::size() const
+{
+  return m_records.size();
+}
+
+const blob_record& blob_listing::operator[](size_t index) const
+{
+  return m_records[index];
+}
+
+utility::string_t blob_listing::name(size_t index) const
+{
+  const blob_record& record = m_records[index];
+  return utility::string_t(m_arena.data() + record.name_offset, record.name_length);
+}
+
+utility::string_t blob_listing::etag(size_t index) const
+{
+  const blob_record& record = m_records[index];
+  return utility::string_t(m_arena.data() + record.etag_offset, record.etag_length);
+}
+
+///
+/// Appends an entry to the listing. The strings are copied in a single character arena,
+/// so a listing of any size only holds two allocations.
+///
+void blob_listing::add(const utility::string_t& name, const utility::string_t& etag, utility::size64_t size, bool is_directory)
+{
+  blob_record record;
+  record.name_offset = m_arena.size();
+  record.name_length = name.size();
+  m_arena.insert(m_arena.end(), name.cbegin(), name.cend());
+  record.etag_offset = m_arena.size();
+  record.etag_length = etag.size();
+  m_arena.insert(m_arena.end(), etag.cbegin(), etag.cend());
+  record.size = size;
+  record.is_directory = is_directory;
+
+  m_records.push_back(record);
+}
+
+///
+/// Removes all the entries, keeping the memory for reuse
+///
+void blob_listing::clear()
+{
+  m_arena.clear();
+  m_records.clear();
+}
+
+///
+/// Creates a lister that keeps up to 'prefetch_pages' pages of results requested ahead of the consumer.
+/// With a flat listing every blob under the prefix is returned, otherwise the names are split on 'delimiter' and
+/// virtual directories are returned as entries of their own. The delimiter is a setting of the blob client, so
+/// the container is listed through a copy of its client using it, leaving the client of the caller unchanged.
+/// An empty delimiter keeps the one of the client, '/' unless set otherwise.
+///
+blob_lister::blob_lister(cloud_blob_container container, const utility::string_t& prefix, bool use_flat_blob_listing, const utility::string_t& delimiter,
+  int max_results, size_t prefetch_pages)
+  : m_state(std::make_shared<listing_state>())
+{
+  if (!delimiter.empty())
+  {
+    cloud_blob_client client = container.service_client();
+    client.set_directory_delimiter(delimiter);
+    container = client.get_container_reference(container.name());
+  }
+
+  m_state->container = container;
+  m_state->prefix = prefix;
+  m_state->use_flat_blob_listing = use_flat_blob_listing;
+  m_state->max_results = max_results;
+  m_state->prefetch_pages = prefetch_pages > 0 ? prefetch_pages : 1;
+}
+
+///
+/// Requests the page following the last one received. When it arrives the next request is sent right away,
+/// until the listing ends or enough pages are waiting for the consumer. Must be called with 'fetching' set.
+///
+void blob_lister::fetch(std::shared_ptr<listing_state> state)
+{
+  continuation_token token;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    token = state->token;
+  }
+
+  state->container.list_blobs_segmented_async(state->prefix, state->use_flat_blob_listing, blob_listing_details::none, state->max_results, token, blob_request_options(), operation_context())
+    .then([state](pplx::task<list_blob_item_segment> request)
+  {
+    bool fetch_next = false;
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      try
+      {
+        list_blob_item_segment segment = request.get();
+        state->token = segment.continuation_token();
+        state->done = state->token.empty();
+        state->pages.push_back(segment);
+      }
+      catch (...)
+      {
+        state->error = std::current_exception();
+        state->done = true;
+      }
+
+      fetch_next = !state->done && state->pages.size() < state->prefetch_pages;
+      state->fetching = fetch_next;
+    }
+
+    state->page_ready.notify_all();
+    if (fetch_next)
+    {
+      fetch(state);
+    }
+  });
+}
+
+///
+/// Fills 'page' with the next page of results, waiting for it if it has not arrived yet.
+/// Returns false once the listing is complete.
+///
+bool blob_lister::next_page(blob_listing& page)
+{
+  page.clear();
+
+  list_blob_item_segment segment;
+  bool fetch_next = false;
+  {
+    std::unique_lock<std::mutex> lock(m_state->mutex);
+    if (!m_state->fetching && !m_state->done && m_state->pages.size() < m_state->prefetch_pages)
+    {
+      m_state->fetching = true;
+      lock.unlock();
+      fetch(m_state);
+      lock.lock();
+    }
+
+    std::shared_ptr<listing_state> state = m_state;
+    state->page_ready.wait(lock, [state]() { return !state->pages.empty() || (state->done && !state->fetching); });
+
+    if (state->pages.empty())
+    {
+      if (state->error)
+      {
+        std::rethrow_exception(state->error);
+      }
+
+      return false;
+    }
+
+    segment = state->pages.front();
+    state->pages.pop_front();
+
+    // A slot was freed in the prefetch queue
+    if (!state->fetching && !state->done)
+    {
+      state->fetching = true;
+      fetch_next = true;
+    }
+  }
+
+  if (fetch_next)
+  {
+    fetch(m_state);
+  }
+
+  for (const list_blob_item& item : segment.results())
+  {
+    if (item.is_blob())
+    {
+      cloud_blob blob = item.as_blob();
+      page.add(blob.name(), blob.properties().etag(), blob.properties().size(), false);
+    }
+    else
+    {
+      page.add(item.as_directory().prefix(), utility::string_t(), 0, true);
+    }
+  }
+
+  return true;
+}
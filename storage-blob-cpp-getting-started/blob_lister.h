@@ -0,0 +1,61 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+using namespace azure::storage;
+
+#pragma once
+
+struct blob_record
+{
+  size_t name_offset;
+  size_t name_length;
+  size_t etag_offset;
+  size_t etag_length;
+  utility::size64_t size;
+  bool is_directory;
+};
+
+class blob_listing
+{
+public:
+  size_t size() const;
+  const blob_record& operator[](size_t index) const;
+
+  utility::string_t name(size_t index) const;
+  utility::string_t etag(size_t index) const;
+
+  void add(const utility::string_t& name, const utility::string_t& etag, utility::size64_t size, bool is_directory);
+  void clear();
+
+private:
+  std::vector<utility::char_t> m_arena;
+  std::vector<blob_record> m_records;
+};
+
+class blob_lister
+{
+public:
+  blob_lister(cloud_blob_container container, const utility::string_t& prefix, bool use_flat_blob_listing, const utility::string_t& delimiter, int max_results, size_t prefetch_pages);
+
+  bool next_page(blob_listing& page);
+
+private:
+  struct listing_state;
+
+  static void fetch(std::shared_ptr<listing_state> state);
+
+  std::shared_ptr<listing_state> m_state;
+};
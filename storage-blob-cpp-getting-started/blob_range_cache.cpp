@@ -0,0 +1,511 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "blob_range_cache.h"
+
+using namespace azure::storage;
+
+namespace
+{
+  // Number of times a read is retried when the blob changes while it is read
+  const int max_read_attempts = 3;
+
+  struct blob_version
+  {
+    utility::string_t etag;
+    utility::size64_t size;
+    std::chrono::steady_clock::time_point validated;
+  };
+
+  struct memory_frame
+  {
+    memory_frame() : used(false), referenced(false) {}
+
+    utility::string_t key;
+    utility::string_t etag;
+    std::vector<uint8_t> data;
+    bool used;
+    bool referenced;
+  };
+
+  struct disk_entry
+  {
+    size_t slot;
+    size_t length;
+    utility::string_t etag;
+    std::list<utility::string_t>::iterator recent;
+  };
+
+  utility::string_t page_key(const utility::string_t& blob_name, utility::size64_t page)
+  {
+    return blob_name + U("#") + utility::conversions::print_string(page);
+  }
+}
+
+cache_stats::cache_stats()
+  : memory_hits(0), disk_hits(0), misses(0), requests(0), evictions(0), invalidations(0)
+{
+}
+
+double cache_stats::hit_ratio() const
+{
+  size_t lookups = memory_hits + disk_hits + misses;
+  return lookups > 0 ? static_cast<double>(memory_hits + disk_hits) / lookups : 0;
+}
+
+///
+/// The progress of one attempt of a read: the pages covering the range, the ones missing from the cache and the
+/// version of the blob the pages come from.
+///
+struct blob_range_cache::cache_read
+{
+  cache_read() : first_page(0), size(0), validate(true), requests(0) {}
+
+  utility::string_t blob_name;
+  utility::size64_t first_page;
+  std::vector<std::vector<uint8_t>> pages;
+  std::vector<size_t> missing;
+  utility::string_t etag;
+  utility::size64_t size;
+  bool validate;
+  size_t requests;
+};
+
+struct blob_range_cache::cache_state
+{
+  cache_state() : page_size(0), hand(0), disk_pages(0) {}
+
+  ///
+  /// Records the version of the blob and the pages downloaded by a read, and returns the range it read
+  ///
+  std::vector<uint8_t> complete(const cache_read& pass, utility::size64_t offset, size_t length)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stats.requests += pass.requests;
+      if (pass.requests > 0)
+      {
+        blob_version& version = versions[pass.blob_name];
+        version.etag = pass.etag;
+        version.size = pass.size;
+        version.validated = std::chrono::steady_clock::now();
+      }
+
+      for (size_t index : pass.missing)
+      {
+        if (!pass.pages[index].empty())
+        {
+          store(page_key(pass.blob_name, pass.first_page + index), pass.etag, pass.pages[index]);
+        }
+      }
+    }
+
+    std::vector<uint8_t> result;
+    if (offset >= pass.size)
+    {
+      return result;
+    }
+
+    result.reserve(static_cast<size_t>(std::min<utility::size64_t>(length, pass.size - offset)));
+    size_t skip = static_cast<size_t>(offset - pass.first_page * page_size);
+    for (const std::vector<uint8_t>& page : pass.pages)
+    {
+      if (result.size() >= length || skip >= page.size())
+      {
+        break;
+      }
+
+      size_t count = std::min(page.size() - skip, length - result.size());
+      result.insert(result.end(), page.begin() + skip, page.begin() + skip + count);
+      skip = 0;
+    }
+
+    return result;
+  }
+
+  ///
+  /// Copies a cached page of the given version. A page of another version is dropped.
+  ///
+  bool lookup(const utility::string_t& key, const utility::string_t& etag, std::vector<uint8_t>& data)
+  {
+    auto frame_index = memory_index.find(key);
+    if (frame_index != memory_index.end())
+    {
+      memory_frame& frame = frames[frame_index->second];
+      if (frame.etag == etag)
+      {
+        frame.referenced = true;
+        data = frame.data;
+        stats.memory_hits++;
+        return true;
+      }
+
+      frame.used = false;
+      memory_index.erase(frame_index);
+    }
+
+    auto entry = disk_index.find(key);
+    if (entry != disk_index.end())
+    {
+      if (entry->second.etag == etag)
+      {
+        data.resize(entry->second.length);
+        disk.seekg(static_cast<std::streamoff>(entry->second.slot) * page_size);
+        disk.read(reinterpret_cast<char*>(data.data()), data.size());
+        if (disk)
+        {
+          stats.disk_hits++;
+          recent.splice(recent.begin(), recent, entry->second.recent);
+          store(key, etag, data);
+          return true;
+        }
+
+        disk.clear();
+      }
+
+      free_slots.push_back(entry->second.slot);
+      recent.erase(entry->second.recent);
+      disk_index.erase(entry);
+    }
+
+    stats.misses++;
+    return false;
+  }
+
+  ///
+  /// Keeps a page in memory. When every frame is used, the clock hand goes around the frames, giving a second
+  /// chance to the ones read since it last passed, and the first one not read moves to the disk tier, if any.
+  ///
+  void store(const utility::string_t& key, const utility::string_t& etag, const std::vector<uint8_t>& data)
+  {
+    size_t index;
+    auto existing = memory_index.find(key);
+    if (existing != memory_index.end())
+    {
+      index = existing->second;
+    }
+    else
+    {
+      for (;;)
+      {
+        memory_frame& frame = frames[hand];
+        index = hand;
+        hand = (hand + 1) % frames.size();
+
+        if (!frame.used)
+        {
+          break;
+        }
+
+        if (frame.referenced)
+        {
+          frame.referenced = false;
+          continue;
+        }
+
+        if (disk_pages > 0)
+        {
+          store_on_disk(frame.key, frame.etag, frame.data);
+        }
+
+        memory_index.erase(frame.key);
+        stats.evictions++;
+        break;
+      }
+    }
+
+    memory_frame& frame = frames[index];
+    frame.key = key;
+    frame.etag = etag;
+    frame.data = data;
+    frame.used = true;
+    frame.referenced = true;
+    memory_index[key] = index;
+  }
+
+  ///
+  /// Writes a page evicted from memory to its own slot of the disk file, replacing the least recently
+  /// used page when the file is full.
+  ///
+  void store_on_disk(const utility::string_t& key, const utility::string_t& etag, const std::vector<uint8_t>& data)
+  {
+    size_t slot;
+    auto existing = disk_index.find(key);
+    if (existing != disk_index.end())
+    {
+      slot = existing->second.slot;
+      recent.erase(existing->second.recent);
+      disk_index.erase(existing);
+    }
+    else if (!free_slots.empty())
+    {
+      slot = free_slots.back();
+      free_slots.pop_back();
+    }
+    else
+    {
+      auto oldest = disk_index.find(recent.back());
+      slot = oldest->second.slot;
+      disk_index.erase(oldest);
+      recent.pop_back();
+    }
+
+    disk.seekp(static_cast<std::streamoff>(slot) * page_size);
+    disk.write(reinterpret_cast<const char*>(data.data()), data.size());
+    if (!disk)
+    {
+      disk.clear();
+      free_slots.push_back(slot);
+      return;
+    }
+
+    recent.push_front(key);
+    disk_entry entry = { slot, data.size(), etag, recent.begin() };
+    disk_index[key] = entry;
+  }
+
+  size_t page_size;
+  std::chrono::milliseconds validation_interval;
+
+  mutable std::mutex mutex;
+  std::unordered_map<utility::string_t, blob_version> versions;
+  cache_stats stats;
+
+  std::vector<memory_frame> frames;
+  std::unordered_map<utility::string_t, size_t> memory_index;
+  size_t hand;
+
+  utility::string_t disk_file_name;
+  std::fstream disk;
+  size_t disk_pages;
+  std::unordered_map<utility::string_t, disk_entry> disk_index;
+  std::list<utility::string_t> recent;
+  std::vector<size_t> free_slots;
+};
+
+///
+/// Creates a cache keeping up to 'memory_pages' pages of 'page_size' bytes in memory. Every page starts at a
+/// multiple of the page size in its blob. A blob read less than 'validation_interval' after its version was last
+/// confirmed by the service is served from the cache without any request; with an interval of zero, every read
+/// is checked with the service.
+///
+blob_range_cache::blob_range_cache(size_t page_size, size_t memory_pages, std::chrono::milliseconds validation_interval)
+  : m_state(std::make_shared<cache_state>())
+{
+  m_state->page_size = page_size > 0 ? page_size : 1;
+  m_state->validation_interval = validation_interval;
+  m_state->frames.resize(memory_pages > 0 ? memory_pages : 1);
+}
+
+blob_range_cache::~blob_range_cache()
+{
+  if (m_state->disk.is_open())
+  {
+    m_state->disk.close();
+    std::remove(utility::conversions::to_utf8string(m_state->disk_file_name).c_str());
+  }
+}
+
+///
+/// Adds a disk tier of up to 'disk_pages' pages, kept in a file deleted with the cache. The pages evicted from
+/// memory move to the file, and a page read from the file moves back to memory.
+///
+void blob_range_cache::set_disk_tier(const utility::string_t& file_name, size_t disk_pages)
+{
+  std::lock_guard<std::mutex> lock(m_state->mutex);
+  m_state->disk.open(utility::conversions::to_utf8string(file_name).c_str(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!m_state->disk)
+  {
+    throw std::runtime_error("The cache file could not be created");
+  }
+
+  m_state->disk_file_name = file_name;
+  m_state->disk_pages = disk_pages;
+  for (size_t slot = disk_pages; slot > 0; slot--)
+  {
+    m_state->free_slots.push_back(slot - 1);
+  }
+}
+
+///
+/// Reads a range of a blob through the cache and waits for it.
+///
+std::vector<uint8_t> blob_range_cache::read(cloud_blob blob, utility::size64_t offset, size_t length)
+{
+  return read_async(blob, offset, length).get();
+}
+
+///
+/// Reads a range of a blob through the cache. The pages covering the range are looked up for the version of the
+/// blob last seen, and the missing ones are downloaded, consecutive pages with a single request. Every request
+/// is conditional on that version, so the pages returned by a read always come from the same version of the
+/// blob: when the blob has changed, the service rejects the request, the cached pages are dropped and the read
+/// starts again. The range must start within the blob and is cut at its end.
+///
+pplx::task<std::vector<uint8_t>> blob_range_cache::read_async(cloud_blob blob, utility::size64_t offset, size_t length)
+{
+  return read_attempt(m_state, blob, offset, length, 1);
+}
+
+pplx::task<std::vector<uint8_t>> blob_range_cache::read_attempt(std::shared_ptr<cache_state> state, cloud_blob blob, utility::size64_t offset, size_t length,
+  int attempt)
+{
+  // The snapshot time is part of the key, so the pages of a snapshot are not mixed with the ones of its blob
+  std::shared_ptr<cache_read> pass = std::make_shared<cache_read>();
+  pass->blob_name = blob.snapshot_qualified_uri().primary_uri().to_string();
+  size_t page_size = state->page_size;
+
+  pass->first_page = offset / page_size;
+  utility::size64_t last_page = (offset + std::max<size_t>(length, 1) - 1) / page_size;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    auto version = state->versions.find(pass->blob_name);
+    if (version != state->versions.end())
+    {
+      if (offset >= version->second.size)
+      {
+        return pplx::task_from_result(std::vector<uint8_t>());
+      }
+
+      pass->etag = version->second.etag;
+      pass->size = version->second.size;
+      pass->validate = std::chrono::steady_clock::now() - version->second.validated >= state->validation_interval;
+
+      // The pages past the end of the blob are neither looked up nor requested
+      last_page = std::min(last_page, (pass->size - 1) / page_size);
+    }
+
+    pass->pages.resize(static_cast<size_t>(last_page - pass->first_page + 1));
+    for (size_t index = 0; index < pass->pages.size(); index++)
+    {
+      if (!state->lookup(page_key(pass->blob_name, pass->first_page + index), pass->etag, pass->pages[index]))
+      {
+        pass->missing.push_back(index);
+      }
+    }
+  }
+
+  return download_runs(page_size, pass, blob, 0).then([pass, blob]() mutable
+  {
+    if (pass->missing.empty() && pass->validate)
+    {
+      // Every page is cached, a conditional request on the properties confirms the version
+      return blob.download_attributes_async(access_condition::generate_if_match_condition(pass->etag), blob_request_options(), operation_context())
+        .then([pass, blob]()
+      {
+        pass->requests++;
+        pass->size = blob.properties().size();
+      });
+    }
+
+    return pplx::task_from_result();
+  }).then([state, pass, blob, offset, length, attempt](pplx::task<void> downloaded)
+  {
+    try
+    {
+      downloaded.get();
+    }
+    catch (const azure::storage::storage_exception& e)
+    {
+      if (e.result().http_status_code() != web::http::status_codes::PreconditionFailed || attempt >= max_read_attempts)
+      {
+        throw;
+      }
+
+      // The blob changed since its pages were cached
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->versions.erase(pass->blob_name) > 0)
+        {
+          state->stats.invalidations++;
+        }
+      }
+
+      return read_attempt(state, blob, offset, length, attempt + 1);
+    }
+
+    return pplx::task_from_result(state->complete(*pass, offset, length));
+  });
+}
+
+///
+/// Downloads the runs of consecutive missing pages one after the other, starting from the given missing page.
+/// The first response of a blob not seen yet tells its version, the next requests are conditional on it.
+///
+pplx::task<void> blob_range_cache::download_runs(size_t page_size, std::shared_ptr<cache_read> pass, cloud_blob blob, size_t run)
+{
+  if (run >= pass->missing.size())
+  {
+    return pplx::task_from_result();
+  }
+
+  size_t run_end = run + 1;
+  while (run_end < pass->missing.size() && pass->missing[run_end] == pass->missing[run_end - 1] + 1)
+  {
+    run_end++;
+  }
+
+  utility::size64_t run_offset = (pass->first_page + pass->missing[run]) * page_size;
+  utility::size64_t run_length = static_cast<utility::size64_t>(run_end - run) * page_size;
+  if (!pass->etag.empty() && run_offset >= pass->size)
+  {
+    // The size of the blob is known since the first response, the remaining pages are past its end
+    return pplx::task_from_result();
+  }
+
+  access_condition condition = pass->etag.empty() ? access_condition() : access_condition::generate_if_match_condition(pass->etag);
+  concurrency::streams::container_buffer<std::vector<uint8_t>> buffer;
+  concurrency::streams::ostream stream(buffer);
+  return blob.download_range_to_stream_async(stream, run_offset, run_length, condition, blob_request_options(), operation_context())
+    .then([page_size, pass, blob, run, run_end, buffer]()
+  {
+    pass->requests++;
+    pass->etag = blob.properties().etag();
+    pass->size = blob.properties().size();
+
+    const std::vector<uint8_t>& content = buffer.collection();
+    for (size_t index = run; index < run_end; index++)
+    {
+      size_t start = (index - run) * page_size;
+      if (start < content.size())
+      {
+        pass->pages[pass->missing[index]].assign(content.begin() + start, content.begin() + std::min(start + page_size, content.size()));
+      }
+    }
+
+    return download_runs(page_size, pass, blob, run_end);
+  });
+}
+
+///
+/// Forgets the version of a blob, so its cached pages are not used anymore. They are dropped when next looked up
+/// or evicted.
+///
+void blob_range_cache::invalidate(const cloud_blob& blob)
+{
+  std::lock_guard<std::mutex> lock(m_state->mutex);
+  if (m_state->versions.erase(blob.snapshot_qualified_uri().primary_uri().to_string()) > 0)
+  {
+    m_state->stats.invalidations++;
+  }
+}
+
+cache_stats blob_range_cache::stats() const
+{
+  std::lock_guard<std::mutex> lock(m_state->mutex);
+  return m_state->stats;
+}
@@ -0,0 +1,59 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+using namespace azure::storage;
+
+#pragma once
+
+struct cache_stats
+{
+  cache_stats();
+
+  double hit_ratio() const;
+
+  size_t memory_hits;
+  size_t disk_hits;
+  size_t misses;
+  size_t requests;
+  size_t evictions;
+  size_t invalidations;
+};
+
+class blob_range_cache
+{
+public:
+  blob_range_cache(size_t page_size, size_t memory_pages, std::chrono::milliseconds validation_interval);
+  ~blob_range_cache();
+
+  void set_disk_tier(const utility::string_t& file_name, size_t disk_pages);
+
+  std::vector<uint8_t> read(cloud_blob blob, utility::size64_t offset, size_t length);
+  pplx::task<std::vector<uint8_t>> read_async(cloud_blob blob, utility::size64_t offset, size_t length);
+  void invalidate(const cloud_blob& blob);
+  cache_stats stats() const;
+
+private:
+  blob_range_cache(const blob_range_cache&);
+  blob_range_cache& operator=(const blob_range_cache&);
+
+  struct cache_state;
+  struct cache_read;
+
+  static pplx::task<std::vector<uint8_t>> read_attempt(std::shared_ptr<cache_state> state, cloud_blob blob, utility::size64_t offset, size_t length, int attempt);
+  static pplx::task<void> download_runs(size_t page_size, std::shared_ptr<cache_read> pass, cloud_blob blob, size_t run);
+
+  std::shared_ptr<cache_state> m_state;
+};
@@ -0,0 +1,1445 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#include "stdafx.h"
+#include "string_util.h"
+#include "task_util.h"
+#include "latency_histogram.h"
+#include "mock_blob_service.h"
+#include "md5.h"
+#include "crc64.h"
+#include "integrity_pipeline.h"
+#include "concurrency_controller.h"
+#include "request_tracer.h"
+#include "client_context.h"
+#include "mapped_file.h"
+#include "parallel_range_downloader.h"
+#include "parallel_block_uploader.h"
+#include "sparse_page_uploader.h"
+#include "local_directory.h"
+#include "file_batch_uploader.h"
+#include "blob_range_cache.h"
+#ifdef BUILD_GZIP_TRANSFER
+#include "compressed_transfer.h"
+#endif
+#include "bulk_property_updater.h"
+#include "prefix_deleter.h"
+#ifdef BUILD_PAGE_BLOB_BACKUP
+#include "page_blob_backup.h"
+#endif
+
+using namespace azure::storage;
+
+struct bench_settings
+{
+  bench_settings() : concurrency(4), iterations(50), mock_service(nullptr), mock_latency(0), mock_bandwidth(0), mock_error_rate(0) {}
+
+  std::vector<size_t> payload_sizes;
+  std::vector<utility::string_t> operations;
+  size_t concurrency;
+  size_t iterations;
+  utility::string_t storage_connection_string;
+
+  // The in-process service the benchmark runs against, if any, and the behaviour it was configured with
+  mock_blob_service* mock_service;
+  std::chrono::microseconds mock_latency;
+  utility::size64_t mock_bandwidth;
+  double mock_error_rate;
+};
+
+// Number of heap allocations made by the process while they are counted, to report the allocations of the
+// 'client' operation. Other operations do not count them, so their threads do not contend on the counter.
+std::atomic<bool> counting_allocations(false);
+std::atomic<uint64_t> allocations(0);
+
+///
+/// Counts the heap allocations while it is in scope
+///
+struct allocation_counting
+{
+  allocation_counting()
+  {
+    counting_allocations = true;
+  }
+
+  ~allocation_counting()
+  {
+    counting_allocations = false;
+  }
+};
+
+void* operator new(size_t size)
+{
+  if (counting_allocations.load(std::memory_order_relaxed))
+  {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void* memory = std::malloc(size > 0 ? size : 1);
+  if (memory == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+
+  return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+  std::free(memory);
+}
+
+typedef std::function<pplx::task<void>(size_t iteration)> bench_operation;
+
+// Largest payload of a single Append Block or Put Page request
+const size_t max_request_size = 4 * 1024 * 1024;
+
+std::vector<size_t> parse_sizes(const std::string& list);
+bool is_selected(const bench_settings& settings, const utility::string_t& operation);
+web::json::value run_operation(const utility::string_t& name, size_t payload_size, const bench_settings& settings, bench_operation operation);
+web::json::value run_benchmarks(const cloud_blob_client& blob_client, const bench_settings& settings);
+web::json::value measure_throughput(const utility::string_t& name, size_t payload_size, size_t total_bytes, std::function<void()> run);
+web::json::value run_hashing(const bench_settings& settings);
+web::json::value run_ranged_download(const utility::string_t& name, cloud_blob source, size_t payload_size, const bench_settings& settings,
+  std::shared_ptr<concurrency_controller> controller);
+std::vector<web::json::value> run_file_batch(cloud_blob_container container, const bench_settings& settings);
+std::vector<web::json::value> run_sparse(cloud_blob_container container, const bench_settings& settings);
+web::json::value run_controller_check(cloud_blob_container container, const bench_settings& settings);
+bool checks_passed(const web::json::value& report);
+#ifdef BUILD_GZIP_TRANSFER
+std::vector<web::json::value> run_compression(cloud_blob_container container, size_t block_size, const bench_settings& settings);
+#endif
+std::vector<web::json::value> run_retag(cloud_blob_container container, const bench_settings& settings);
+std::vector<web::json::value> run_purge(cloud_blob_container container, const bench_settings& settings);
+#ifdef BUILD_PAGE_BLOB_BACKUP
+std::vector<web::json::value> run_backup(cloud_blob_container container, const bench_settings& settings);
+#endif
+
+///
+/// Measures the latency of the blob operations shown by the samples (upload, download, append, page write, list,
+/// lease, copy and metadata) and writes the results as JSON, to compare SDK versions and tuning. The 'hash'
+/// operation measures the local MD5 and CRC64 throughput, without any request. The 'client' operation runs the flow
+/// of the samples with a new client for every run, then with one shared client context. The 'adaptive' operation
+/// compares ranged downloads on a fixed number of workers with downloads under a concurrency controller, best run
+/// against the mock service injecting latency and errors. The 'batch' operation uploads many small files and a few
+/// large ones one at a time, then with the batch uploader, and reports the files uploaded per second. The 'cache'
+/// operation reads ranges of a blob directly, then through a read-through cache. The 'gzip' operation uploads a log
+/// file in blocks as it is, then compressed, and downloads it decompressed, when zlib is found. The 'retag'
+/// operation updates the properties and metadata of many blobs one at a time, then with the bulk updater. The
+/// 'purge' operation deletes the blobs under a prefix one at a time, then with the prefix deleter. The 'backup'
+/// operation backs up a page blob in full, then incrementally after a part of its pages changed, when it is built.
+/// The 'sparse' operation uploads an empty file, a file of whole pages and a file ending with a partial page with
+/// the sparse page uploader, and checks the content of each page blob. The 'controller' operation checks, against
+/// the mock service only, that a concurrency controller backs off when requests are throttled and grows back once
+/// they are not. The process exits with an error when a check fails.
+///
+/// Usage: blobbench [--connection-string <connection string> | --mock] [--sizes 4096,1048576] [--concurrency 4]
+///                  [--iterations 50] [--operations upload,download,...] [--output results.json]
+///                  [--mock-latency-ms <ms>] [--mock-bandwidth <bytes per second>] [--mock-error-rate <fraction>]
+///
+int main(int argc, char* argv[])
+{
+  utility::string_t storage_connection_string(U("UseDevelopmentStorage=true"));
+  bench_settings settings;
+  bool mock = false;
+  long long mock_latency_ms = 0;
+  utility::size64_t mock_bandwidth = 0;
+  double mock_error_rate = 0;
+  std::string output;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string argument(argv[i]);
+    bool has_value = i + 1 < argc;
+    if (argument == "--mock")
+    {
+      mock = true;
+    }
+    else if (argument == "--connection-string" && has_value)
+    {
+      storage_connection_string = utility::conversions::to_string_t(argv[++i]);
+    }
+    else if (argument == "--sizes" && has_value)
+    {
+      settings.payload_sizes = parse_sizes(argv[++i]);
+    }
+    else if (argument == "--concurrency" && has_value)
+    {
+      settings.concurrency = static_cast<size_t>(std::strtoul(argv[++i], nullptr, 10));
+    }
+    else if (argument == "--iterations" && has_value)
+    {
+      settings.iterations = static_cast<size_t>(std::strtoul(argv[++i], nullptr, 10));
+    }
+    else if (argument == "--operations" && has_value)
+    {
+      std::istringstream list(argv[++i]);
+      std::string operation;
+      while (std::getline(list, operation, ','))
+      {
+        settings.operations.push_back(utility::conversions::to_string_t(operation));
+      }
+    }
+    else if (argument == "--output" && has_value)
+    {
+      output = argv[++i];
+    }
+    else if (argument == "--mock-latency-ms" && has_value)
+    {
+      mock_latency_ms = std::atoll(argv[++i]);
+    }
+    else if (argument == "--mock-bandwidth" && has_value)
+    {
+      mock_bandwidth = std::strtoull(argv[++i], nullptr, 10);
+    }
+    else if (argument == "--mock-error-rate" && has_value)
+    {
+      mock_error_rate = std::atof(argv[++i]);
+    }
+    else
+    {
+      ucerr << U("Unknown option ") << utility::conversions::to_string_t(argument) << std::endl;
+      return 1;
+    }
+  }
+
+  if (settings.payload_sizes.empty())
+  {
+    settings.payload_sizes.push_back(4 * 1024);
+    settings.payload_sizes.push_back(1024 * 1024);
+  }
+
+  settings.concurrency = settings.concurrency > 0 ? settings.concurrency : 1;
+  settings.iterations = settings.iterations > 0 ? settings.iterations : 1;
+
+  std::unique_ptr<mock_blob_service> mock_service;
+  try
+  {
+    if (mock)
+    {
+      mock_service.reset(new mock_blob_service(U("http://127.0.0.1:10000")));
+      mock_service->set_latency(std::chrono::milliseconds(mock_latency_ms));
+      mock_service->set_bandwidth(mock_bandwidth);
+      mock_service->set_error_rate(mock_error_rate, web::http::status_codes::ServiceUnavailable);
+      mock_service->open();
+      storage_connection_string = mock_service->connection_string();
+
+      settings.mock_service = mock_service.get();
+      settings.mock_latency = std::chrono::milliseconds(mock_latency_ms);
+      settings.mock_bandwidth = mock_bandwidth;
+      settings.mock_error_rate = mock_error_rate;
+    }
+
+    settings.storage_connection_string = storage_connection_string;
+    client_context context(storage_connection_string);
+
+    web::json::value results = run_benchmarks(context.blob_client(), settings);
+
+    std::string json = utility::conversions::to_utf8string(results.serialize());
+    if (output.empty())
+    {
+      std::cout << json << std::endl;
+    }
+    else
+    {
+      std::ofstream file(output, std::ios::binary);
+      file << json << std::endl;
+    }
+
+    if (!checks_passed(results))
+    {
+      return 1;
+    }
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucerr << U("Error:") << e.what() << std::endl << U("The benchmark could not be completed.") << std::endl;
+    return 1;
+  }
+  catch (const std::exception& e)
+  {
+    ucerr << U("Error:") << e.what() << std::endl << U("The benchmark could not be completed.") << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+///
+/// Parses a comma separated list of payload sizes in bytes
+///
+std::vector<size_t> parse_sizes(const std::string& list)
+{
+  std::vector<size_t> sizes;
+  std::istringstream stream(list);
+  std::string size;
+  while (std::getline(stream, size, ','))
+  {
+    sizes.push_back(static_cast<size_t>(std::strtoull(size.c_str(), nullptr, 10)));
+  }
+
+  return sizes;
+}
+
+bool is_selected(const bench_settings& settings, const utility::string_t& operation)
+{
+  return settings.operations.empty() || std::find(settings.operations.begin(), settings.operations.end(), operation) != settings.operations.end();
+}
+
+///
+/// Runs an operation the configured number of times on concurrent workers and records the latency of each call.
+/// Failed calls are counted, but not recorded in the latency distribution. The heap allocations per call are
+/// reported when they are being counted.
+///
+web::json::value run_operation(const utility::string_t& name, size_t payload_size, const bench_settings& settings, bench_operation operation)
+{
+  ucerr << U("Running ") << name << U(" with ") << payload_size << U(" bytes") << std::endl;
+
+  latency_histogram histogram;
+  std::atomic<size_t> next(0);
+  std::atomic<size_t> errors(0);
+
+  bool counted = counting_allocations;
+  uint64_t start_allocations = allocations;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  task_util::run_workers(settings.concurrency, [&]() -> pplx::task<bool>
+  {
+    size_t iteration = next++;
+    if (iteration >= settings.iterations)
+    {
+      return pplx::task_from_result(false);
+    }
+
+    std::chrono::steady_clock::time_point operation_start = std::chrono::steady_clock::now();
+    return operation(iteration).then([&histogram, &errors, operation_start](pplx::task<void> completed)
+    {
+      try
+      {
+        completed.get();
+        histogram.record(std::chrono::steady_clock::now() - operation_start);
+      }
+      catch (const azure::storage::storage_exception& e)
+      {
+        if (errors++ == 0)
+        {
+          ucerr << U("Error:") << e.what() << std::endl;
+        }
+      }
+      catch (const std::exception& e)
+      {
+        if (errors++ == 0)
+        {
+          ucerr << U("Error:") << e.what() << std::endl;
+        }
+      }
+
+      return true;
+    });
+  }).wait();
+
+  double seconds = task_util::seconds_since(start);
+  double completed = static_cast<double>(histogram.count());
+  double allocated = static_cast<double>(allocations - start_allocations);
+
+  web::json::value result = web::json::value::object();
+  result[U("operation")] = web::json::value::string(name);
+  result[U("payload_bytes")] = web::json::value::number(static_cast<uint64_t>(payload_size));
+  result[U("concurrency")] = web::json::value::number(static_cast<uint64_t>(settings.concurrency));
+  result[U("iterations")] = web::json::value::number(static_cast<uint64_t>(settings.iterations));
+  result[U("errors")] = web::json::value::number(static_cast<uint64_t>(errors.load()));
+  result[U("seconds")] = web::json::value::number(seconds);
+  result[U("operations_per_second")] = web::json::value::number(seconds > 0 ? completed / seconds : 0);
+  result[U("megabytes_per_second")] = web::json::value::number(seconds > 0 ? completed * static_cast<double>(payload_size) / (1024.0 * 1024.0) / seconds : 0);
+  if (counted)
+  {
+    result[U("allocations_per_operation")] = web::json::value::number(completed > 0 ? allocated / completed : 0);
+  }
+
+  result[U("latency")] = histogram.to_json();
+  return result;
+}
+
+///
+/// Creates a container for the run, measures every selected operation for every payload size and deletes the container.
+/// Each operation is prepared before its measurement starts, so only the measured calls are timed.
+///
+web::json::value run_benchmarks(const cloud_blob_client& blob_client, const bench_settings& settings)
+{
+  cloud_blob_container container = blob_client.get_container_reference(U("blobbench-") + string_util::random_string());
+  container.create();
+
+  std::vector<web::json::value> results;
+  try
+  {
+    std::mt19937 random(42);
+    size_t workers = settings.concurrency;
+
+    for (size_t payload_size : settings.payload_sizes)
+    {
+      // Random data, so that compression anywhere on the way does not change the results
+      std::shared_ptr<std::vector<uint8_t>> payload = std::make_shared<std::vector<uint8_t>>(payload_size);
+      for (auto& byte : *payload)
+      {
+        byte = static_cast<uint8_t>(random());
+      }
+
+      auto open_payload = [payload](size_t size) -> concurrency::streams::istream
+      {
+        concurrency::streams::rawptr_buffer<uint8_t> buffer(payload->data(), size, std::ios::in);
+        return concurrency::streams::istream(buffer);
+      };
+
+      utility::string_t suffix = U("-") + utility::conversions::print_string(payload_size);
+
+      if (is_selected(settings, U("upload")))
+      {
+        results.push_back(run_operation(U("upload"), payload_size, settings, [container, open_payload, payload, suffix](size_t iteration)
+        {
+          cloud_block_blob blob = container.get_block_blob_reference(U("upload") + suffix + U("-") + utility::conversions::print_string(iteration));
+          return blob.upload_from_stream_async(open_payload(payload->size()));
+        }));
+      }
+
+      if (is_selected(settings, U("download")))
+      {
+        cloud_block_blob source = container.get_block_blob_reference(U("download") + suffix);
+        source.upload_from_stream(open_payload(payload_size));
+
+        utility::string_t name = source.name();
+        results.push_back(run_operation(U("download"), payload_size, settings, [container, name](size_t)
+        {
+          cloud_block_blob blob = container.get_block_blob_reference(name);
+          concurrency::streams::container_buffer<std::vector<uint8_t>> buffer;
+          concurrency::streams::ostream stream(buffer);
+          return blob.download_to_stream_async(stream).then([buffer]()
+          {
+          });
+        }));
+      }
+
+      if (is_selected(settings, U("append")) && payload_size > 0 && payload_size <= max_request_size)
+      {
+        cloud_append_blob target = container.get_append_blob_reference(U("append") + suffix);
+        target.create_or_replace();
+
+        utility::string_t name = target.name();
+        results.push_back(run_operation(U("append"), payload_size, settings, [container, name, open_payload, payload](size_t)
+        {
+          cloud_append_blob blob = container.get_append_blob_reference(name);
+          return blob.append_block_async(open_payload(payload->size()), utility::string_t()).then([](int64_t)
+          {
+          });
+        }));
+      }
+
+      if (is_selected(settings, U("page")) && payload_size > 0 && payload_size <= max_request_size)
+      {
+        // Pages are written in 512 byte units, every worker writes its own part of the blob
+        size_t page_write_size = (payload_size + 511) / 512 * 512;
+        std::shared_ptr<std::vector<uint8_t>> pages = std::make_shared<std::vector<uint8_t>>(*payload);
+        pages->resize(page_write_size, 0);
+
+        cloud_page_blob target = container.get_page_blob_reference(U("page") + suffix);
+        target.create(static_cast<utility::size64_t>(page_write_size) * workers);
+
+        utility::string_t name = target.name();
+        results.push_back(run_operation(U("page"), page_write_size, settings, [container, name, pages, workers](size_t iteration)
+        {
+          cloud_page_blob blob = container.get_page_blob_reference(name);
+          int64_t offset = static_cast<int64_t>((iteration % workers) * pages->size());
+          concurrency::streams::rawptr_buffer<uint8_t> buffer(pages->data(), pages->size(), std::ios::in);
+          concurrency::streams::istream stream(buffer);
+          return blob.upload_pages_async(stream, offset, utility::string_t());
+        }));
+      }
+
+      if (is_selected(settings, U("copy")))
+      {
+        cloud_block_blob source = container.get_block_blob_reference(U("copy-source") + suffix);
+        source.upload_from_stream(open_payload(payload_size));
+
+        // The copy of a blob within the same account completes while the request is served
+        web::uri source_uri = source.uri().primary_uri();
+        results.push_back(run_operation(U("copy"), payload_size, settings, [container, source_uri, suffix](size_t iteration)
+        {
+          cloud_block_blob blob = container.get_block_blob_reference(U("copy") + suffix + U("-") + utility::conversions::print_string(iteration));
+          return blob.start_copy_async(source_uri).then([](utility::string_t)
+          {
+          });
+        }));
+      }
+
+      if (is_selected(settings, U("cache")) && payload_size > 0)
+      {
+        cloud_block_blob source = container.get_block_blob_reference(U("cache") + suffix);
+        source.upload_from_stream(open_payload(payload_size));
+
+        // Every iteration reads one of the four quarters of the blob
+        utility::string_t name = source.name();
+        size_t range_size = std::max<size_t>(payload_size / 4, 1);
+        results.push_back(run_operation(U("range_read"), range_size, settings, [container, name, range_size](size_t iteration)
+        {
+          cloud_block_blob blob = container.get_block_blob_reference(name);
+          concurrency::streams::container_buffer<std::vector<uint8_t>> buffer;
+          concurrency::streams::ostream stream(buffer);
+          return blob.download_range_to_stream_async(stream, (iteration % 4) * range_size, range_size).then([buffer]()
+          {
+          });
+        }));
+
+        // The pages of the blob fit in memory, its version is checked at most once a second
+        const size_t page_size = 64 * 1024;
+        std::shared_ptr<blob_range_cache> cache = std::make_shared<blob_range_cache>(page_size, payload_size / page_size + 1, std::chrono::milliseconds(1000));
+        web::json::value cached = run_operation(U("cached_range_read"), range_size, settings, [container, name, range_size, cache](size_t iteration)
+        {
+          cloud_block_blob blob = container.get_block_blob_reference(name);
+          return cache->read_async(blob, (iteration % 4) * range_size, range_size).then([](std::vector<uint8_t>)
+          {
+          });
+        });
+
+        cache_stats stats = cache->stats();
+        cached[U("hit_ratio")] = web::json::value::number(stats.hit_ratio());
+        cached[U("requests")] = web::json::value::number(static_cast<uint64_t>(stats.requests));
+        results.push_back(cached);
+      }
+
+#ifdef BUILD_GZIP_TRANSFER
+      if (is_selected(settings, U("gzip")) && payload_size > 0)
+      {
+        std::vector<web::json::value> compression_results = run_compression(container, payload_size, settings);
+        results.insert(results.end(), compression_results.begin(), compression_results.end());
+      }
+#endif
+
+      if (is_selected(settings, U("adaptive")) && payload_size > 0)
+      {
+        cloud_block_blob source = container.get_block_blob_reference(U("adaptive") + suffix);
+        source.upload_from_stream(open_payload(payload_size));
+
+        // The controller is kept across the iterations, as it would be across the transfers of an application. Its
+        // ranges start at the size of the fixed ones.
+        results.push_back(run_ranged_download(U("download_fixed"), source, payload_size, settings, nullptr));
+        results.push_back(run_ranged_download(U("download_adaptive"), source, payload_size, settings,
+          std::make_shared<concurrency_controller>(1, 64, 64 * 1024, max_request_size, payload_size / 4)));
+      }
+    }
+
+    if (is_selected(settings, U("batch")))
+    {
+      std::vector<web::json::value> batch_results = run_file_batch(container, settings);
+      results.insert(results.end(), batch_results.begin(), batch_results.end());
+    }
+
+    if (is_selected(settings, U("sparse")))
+    {
+      std::vector<web::json::value> sparse_results = run_sparse(container, settings);
+      results.insert(results.end(), sparse_results.begin(), sparse_results.end());
+    }
+
+    if (is_selected(settings, U("controller")) && settings.mock_service != nullptr)
+    {
+      results.push_back(run_controller_check(container, settings));
+    }
+
+    if (is_selected(settings, U("retag")))
+    {
+      std::vector<web::json::value> retag_results = run_retag(container, settings);
+      results.insert(results.end(), retag_results.begin(), retag_results.end());
+    }
+
+    if (is_selected(settings, U("purge")))
+    {
+      std::vector<web::json::value> purge_results = run_purge(container, settings);
+      results.insert(results.end(), purge_results.begin(), purge_results.end());
+    }
+
+#ifdef BUILD_PAGE_BLOB_BACKUP
+    if (is_selected(settings, U("backup")))
+    {
+      std::vector<web::json::value> backup_results = run_backup(container, settings);
+      results.insert(results.end(), backup_results.begin(), backup_results.end());
+    }
+#endif
+
+    // The remaining operations do not transfer a payload
+    if (is_selected(settings, U("list")))
+    {
+      results.push_back(run_operation(U("list"), 0, settings, [container](size_t)
+      {
+        return container.list_blobs_segmented_async(utility::string_t(), true, blob_listing_details::none, 1000, continuation_token(),
+          blob_request_options(), operation_context()).then([](list_blob_item_segment)
+        {
+        });
+      }));
+    }
+
+    if (is_selected(settings, U("lease")))
+    {
+      // Every iteration acquires and releases the lease of its own blob
+      std::vector<utility::string_t> names;
+      for (size_t i = 0; i < settings.iterations; i++)
+      {
+        names.push_back(U("lease-") + utility::conversions::print_string(i));
+      }
+
+      std::atomic<size_t> next(0);
+      task_util::run_workers(workers, [&]() -> pplx::task<bool>
+      {
+        size_t index = next++;
+        if (index >= names.size())
+        {
+          return pplx::task_from_result(false);
+        }
+
+        return container.get_block_blob_reference(names[index]).upload_text_async(utility::string_t()).then([]()
+        {
+          return true;
+        });
+      }).wait();
+
+      results.push_back(run_operation(U("lease"), 0, settings, [container, names](size_t iteration)
+      {
+        cloud_block_blob blob = container.get_block_blob_reference(names[iteration]);
+        return blob.acquire_lease_async(lease_time(std::chrono::seconds(15)), utility::string_t()).then([blob](utility::string_t lease_id) mutable
+        {
+          access_condition condition;
+          condition.set_lease_id(lease_id);
+          return blob.release_lease_async(condition);
+        });
+      }));
+    }
+
+    if (is_selected(settings, U("client")))
+    {
+      // The flow of the samples: write a blob, read it back and delete it. The first run creates a client and its
+      // request options every time, like the samples did, the second one shares a client context.
+      allocation_counting counting;
+      utility::string_t connection_string = settings.storage_connection_string;
+      utility::string_t container_name = container.name();
+      results.push_back(run_operation(U("client_per_flow"), 0, settings, [connection_string, container_name](size_t iteration)
+      {
+        cloud_blob_client fresh_client = cloud_storage_account::parse(connection_string).create_cloud_blob_client();
+        cloud_block_blob blob = fresh_client.get_container_reference(container_name).get_block_blob_reference(U("client-") + utility::conversions::print_string(iteration));
+        return blob.upload_text_async(U("sample flow"), access_condition(), blob_request_options(), operation_context()).then([blob]() mutable
+        {
+          return blob.download_text_async(access_condition(), blob_request_options(), operation_context());
+        }).then([blob](utility::string_t) mutable
+        {
+          return blob.delete_blob_async(delete_snapshots_option::none, access_condition(), blob_request_options(), operation_context());
+        });
+      }));
+
+      std::shared_ptr<client_context> shared_context = std::make_shared<client_context>(connection_string);
+      results.push_back(run_operation(U("shared_client_context"), 0, settings, [shared_context, container_name](size_t iteration)
+      {
+        cloud_block_blob blob = shared_context->blob_client().get_container_reference(container_name).get_block_blob_reference(U("client-") + utility::conversions::print_string(iteration));
+        return blob.upload_text_async(U("sample flow")).then([blob]() mutable
+        {
+          return blob.download_text_async();
+        }).then([blob](utility::string_t) mutable
+        {
+          return blob.delete_blob_async();
+        });
+      }));
+    }
+
+    if (is_selected(settings, U("metadata")))
+    {
+      cloud_block_blob target = container.get_block_blob_reference(U("metadata"));
+      target.upload_text(utility::string_t());
+
+      utility::string_t name = target.name();
+      results.push_back(run_operation(U("metadata"), 0, settings, [container, name](size_t iteration)
+      {
+        cloud_block_blob blob = container.get_block_blob_reference(name);
+        blob.metadata()[U("iteration")] = utility::conversions::print_string(iteration);
+        return blob.upload_metadata_async();
+      }));
+    }
+  }
+  catch (...)
+  {
+    // The error of the benchmark is reported rather than one of the cleanup
+    try
+    {
+      container.delete_container_if_exists();
+    }
+    catch (...)
+    {
+    }
+
+    throw;
+  }
+
+  container.delete_container_if_exists();
+
+  web::json::value report = web::json::value::object();
+  report[U("concurrency")] = web::json::value::number(static_cast<uint64_t>(settings.concurrency));
+  report[U("iterations")] = web::json::value::number(static_cast<uint64_t>(settings.iterations));
+  report[U("results")] = web::json::value::array(results);
+  if (is_selected(settings, U("hash")))
+  {
+    report[U("hashing")] = run_hashing(settings);
+  }
+
+  return report;
+}
+
+///
+/// Runs a local computation once to warm up, then the configured number of times, and reports its throughput
+///
+web::json::value measure_throughput(const utility::string_t& name, size_t payload_size, size_t total_bytes, std::function<void()> run)
+{
+  ucerr << U("Running ") << name << U(" with ") << payload_size << U(" bytes") << std::endl;
+
+  run();
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  run();
+  double seconds = task_util::seconds_since(start);
+
+  web::json::value result = web::json::value::object();
+  result[U("algorithm")] = web::json::value::string(name);
+  result[U("payload_bytes")] = web::json::value::number(static_cast<uint64_t>(payload_size));
+  result[U("seconds")] = web::json::value::number(seconds);
+  result[U("gigabytes_per_second")] = web::json::value::number(seconds > 0 ? static_cast<double>(total_bytes) / (1024.0 * 1024.0 * 1024.0) / seconds : 0);
+  return result;
+}
+
+///
+/// Compares the integrity hashes: the MD5 computed before each upload one buffer at a time against four buffers
+/// at once, and the integrity pipeline hashing the blocks of the concurrent workers, and CRC64 one bit at a time
+/// against eight bytes at a time. Every algorithm hashes 'iterations' payloads of each size.
+///
+web::json::value run_hashing(const bench_settings& settings)
+{
+  std::vector<web::json::value> results;
+  std::mt19937 random(7);
+
+  for (size_t payload_size : settings.payload_sizes)
+  {
+    // Four payloads, the number of buffers hashed at once
+    std::vector<std::vector<uint8_t>> payloads(4, std::vector<uint8_t>(payload_size));
+    for (auto& payload : payloads)
+    {
+      for (auto& byte : payload)
+      {
+        byte = static_cast<uint8_t>(random());
+      }
+    }
+
+    size_t iterations = settings.iterations;
+    size_t total_bytes = payload_size * iterations;
+
+    results.push_back(measure_throughput(U("md5"), payload_size, total_bytes, [&]()
+    {
+      for (size_t i = 0; i < iterations; i++)
+      {
+        md5_hash::compute(payloads[i % 4].data(), payload_size);
+      }
+    }));
+
+    results.push_back(measure_throughput(U("md5_multi_buffer"), payload_size, total_bytes, [&]()
+    {
+      const uint8_t* data[4] = { payloads[0].data(), payloads[1].data(), payloads[2].data(), payloads[3].data() };
+      for (size_t i = 0; i < iterations; i += 4)
+      {
+        md5_hash hashes[4];
+        md5_hash::update_parallel(hashes, data, std::min<size_t>(4, iterations - i), payload_size);
+        for (auto& hash : hashes)
+        {
+          hash.finish();
+        }
+      }
+    }));
+
+    results.push_back(measure_throughput(U("crc64_bitwise"), payload_size, total_bytes, [&]()
+    {
+      for (size_t i = 0; i < iterations; i++)
+      {
+        crc64::compute_bitwise(payloads[i % 4].data(), payload_size);
+      }
+    }));
+
+    results.push_back(measure_throughput(U("crc64"), payload_size, total_bytes, [&]()
+    {
+      for (size_t i = 0; i < iterations; i++)
+      {
+        crc64::compute(payloads[i % 4].data(), payload_size);
+      }
+    }));
+
+    results.push_back(measure_throughput(U("pipeline"), payload_size, total_bytes, [&]()
+    {
+      integrity_pipeline pipeline(settings.concurrency);
+      std::vector<pplx::task<block_digest>> digests;
+      for (size_t i = 0; i < iterations; i++)
+      {
+        digests.push_back(pipeline.hash_async(payloads[i % 4].data(), payload_size));
+      }
+
+      pplx::when_all(digests.begin(), digests.end()).wait();
+    }));
+  }
+
+  return web::json::value::array(results);
+}
+
+///
+/// Uploads a set of local files to the container, first one file after the other with a single upload call each,
+/// like the samples upload a file, then with a batch uploader on 'concurrency' workers. The set holds
+/// 20 * 'iterations' files of 512 bytes to 16 KiB and two files of 16 MiB, which the batch uploader sends in blocks.
+///
+std::vector<web::json::value> run_file_batch(cloud_blob_container container, const bench_settings& settings)
+{
+  const utility::string_t directory(U("blobbench-batch"));
+  local_directory::create_parent_directories(U("."), directory + U("/"));
+
+  std::mt19937 random(11);
+  std::vector<batch_file> files;
+  utility::size64_t total_bytes = 0;
+  for (size_t i = 0; i < 20 * settings.iterations + 2; i++)
+  {
+    size_t size = i < 2 ? 16 * 1024 * 1024 : 512 + random() % (16 * 1024 - 512);
+    utility::string_t name = U("file-") + utility::conversions::print_string(i);
+
+    std::vector<char> content(size);
+    for (auto& byte : content)
+    {
+      byte = static_cast<char>(random());
+    }
+
+    std::ofstream file(utility::conversions::to_utf8string(directory + U("/") + name), std::ios::binary);
+    file.write(content.data(), content.size());
+
+    files.push_back(batch_file(directory + U("/") + name, name, size));
+    total_bytes += size;
+  }
+
+  auto report = [&](const utility::string_t& name, const transfer_stats& stats)
+  {
+    web::json::value result = web::json::value::object();
+    result[U("operation")] = web::json::value::string(name);
+    result[U("files")] = web::json::value::number(static_cast<uint64_t>(files.size()));
+    result[U("bytes")] = web::json::value::number(static_cast<uint64_t>(stats.bytes));
+    result[U("requests")] = web::json::value::number(static_cast<uint64_t>(stats.requests));
+    result[U("seconds")] = web::json::value::number(stats.seconds);
+    result[U("files_per_second")] = web::json::value::number(stats.seconds > 0 ? files.size() / stats.seconds : 0);
+    result[U("megabytes_per_second")] = web::json::value::number(stats.megabytes_per_second());
+    return result;
+  };
+
+  auto remove_files = [&]()
+  {
+    for (const batch_file& file : files)
+    {
+      std::remove(utility::conversions::to_utf8string(file.path).c_str());
+    }
+
+    std::remove(utility::conversions::to_utf8string(directory).c_str());
+  };
+
+  std::vector<web::json::value> results;
+  try
+  {
+    ucerr << U("Running batch_one_at_a_time with ") << files.size() << U(" files") << std::endl;
+
+    transfer_stats sequential;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (const batch_file& file : files)
+    {
+      container.get_block_blob_reference(U("sequential/") + file.blob_name).upload_from_file(file.path);
+      sequential.requests++;
+    }
+
+    sequential.bytes = total_bytes;
+    sequential.seconds = task_util::seconds_since(start);
+    results.push_back(report(U("batch_one_at_a_time"), sequential));
+
+    ucerr << U("Running batch_work_stealing with ") << files.size() << U(" files") << std::endl;
+
+    std::vector<batch_file> batch(files);
+    for (batch_file& file : batch)
+    {
+      file.blob_name = U("batch/") + file.blob_name;
+    }
+
+    file_batch_uploader uploader(max_request_size, max_request_size, settings.concurrency);
+    results.push_back(report(U("batch_work_stealing"), uploader.upload(batch, container)));
+  }
+  catch (...)
+  {
+    remove_files();
+    throw;
+  }
+
+  remove_files();
+  return results;
+}
+
+///
+/// Uploads an empty file, a file of whole pages and a file ending with a partial page to page blobs with the sparse
+/// page uploader, one page in four being zero, then downloads each blob and checks that it holds the file padded
+/// with zeros to whole pages. Every result reports whether its check 'passed'.
+///
+std::vector<web::json::value> run_sparse(cloud_blob_container container, const bench_settings& settings)
+{
+  const size_t page_size = sparse_page_uploader::page_size;
+  const size_t file_sizes[] = { 0, 64 * page_size, 64 * page_size + 100 };
+  const utility::char_t* case_names[] = { U("sparse_empty"), U("sparse_aligned"), U("sparse_partial_page") };
+
+  std::mt19937 random(13);
+  std::vector<utility::string_t> paths;
+  std::vector<web::json::value> results;
+  try
+  {
+    for (size_t i = 0; i < 3; i++)
+    {
+      ucerr << U("Running ") << case_names[i] << U(" with ") << file_sizes[i] << U(" bytes") << std::endl;
+
+      std::vector<uint8_t> content(file_sizes[i]);
+      for (size_t position = 0; position < content.size(); position++)
+      {
+        content[position] = (position / page_size) % 4 == 1 ? 0 : static_cast<uint8_t>(random());
+      }
+
+      utility::string_t path = utility::string_t(U("blobbench-")) + case_names[i] + U(".bin");
+      paths.push_back(path);
+      {
+        std::ofstream file(utility::conversions::to_utf8string(path), std::ios::binary);
+        file.write(reinterpret_cast<const char*>(content.data()), static_cast<std::streamsize>(content.size()));
+      }
+
+      cloud_page_blob blob = container.get_page_blob_reference(utility::string_t(case_names[i]));
+      sparse_page_uploader uploader(max_request_size, settings.concurrency);
+      transfer_stats stats = uploader.upload_file(blob, path);
+
+      concurrency::streams::container_buffer<std::vector<uint8_t>> buffer;
+      blob.download_to_stream(concurrency::streams::ostream(buffer));
+
+      std::vector<uint8_t> expected(content);
+      expected.resize(static_cast<size_t>(sparse_page_uploader::aligned_size(content.size())), 0);
+
+      web::json::value result = web::json::value::object();
+      result[U("operation")] = web::json::value::string(case_names[i]);
+      result[U("bytes")] = web::json::value::number(static_cast<uint64_t>(stats.bytes));
+      result[U("skipped_bytes")] = web::json::value::number(static_cast<uint64_t>(stats.skipped_bytes));
+      result[U("requests")] = web::json::value::number(static_cast<uint64_t>(stats.requests));
+      result[U("seconds")] = web::json::value::number(stats.seconds);
+      result[U("passed")] = web::json::value::boolean(buffer.collection() == expected);
+      results.push_back(result);
+    }
+  }
+  catch (...)
+  {
+    for (const utility::string_t& path : paths)
+    {
+      std::remove(utility::conversions::to_utf8string(path).c_str());
+    }
+
+    throw;
+  }
+
+  for (const utility::string_t& path : paths)
+  {
+    std::remove(utility::conversions::to_utf8string(path).c_str());
+  }
+
+  return results;
+}
+
+///
+/// Reads a small blob under a concurrency controller in three phases of 200 requests: with the latency of the mock
+/// service flat, with a part of the requests failing with 503 Server Busy, at the '--mock-error-rate' or one in five
+/// when none is given, then with the latency flat again. The reads are not retried, so the controller sees every
+/// 503 as it arrives. The check 'passed' when the concurrency dropped while the requests were throttled, and grew
+/// back once they were not. The latency, bandwidth and errors of the mock are restored afterwards.
+///
+web::json::value run_controller_check(cloud_blob_container container, const bench_settings& settings)
+{
+  const size_t requests_per_phase = 200;
+  const size_t range_size = 4 * 1024;
+  double error_rate = settings.mock_error_rate > 0 ? settings.mock_error_rate : 0.2;
+  mock_blob_service& mock = *settings.mock_service;
+
+  ucerr << U("Running controller_check with an error rate of ") << error_rate << std::endl;
+
+  cloud_block_blob blob = container.get_block_blob_reference(U("controller-check"));
+  blob.upload_from_stream(concurrency::streams::bytestream::open_istream(std::vector<uint8_t>(range_size, 0)));
+
+  blob_request_options options;
+  options.set_retry_policy(no_retry_policy());
+  std::shared_ptr<concurrency_controller> controller = std::make_shared<concurrency_controller>(1, 16, range_size, range_size);
+  std::atomic<size_t> failed(0);
+
+  auto run_phase = [&]() -> size_t
+  {
+    std::atomic<size_t> next(0);
+    concurrency_controller::run_workers(controller, 1, [&]() -> pplx::task<bool>
+    {
+      if (next++ >= requests_per_phase)
+      {
+        return pplx::task_from_result(false);
+      }
+
+      concurrency::streams::container_buffer<std::vector<uint8_t>> buffer;
+      return blob.download_range_to_stream_async(concurrency::streams::ostream(buffer), 0, range_size, access_condition(), options,
+        concurrency_controller::context_for(controller)).then([&failed, buffer](pplx::task<void> read)
+      {
+        try
+        {
+          read.get();
+        }
+        catch (const azure::storage::storage_exception&)
+        {
+          failed++;
+        }
+
+        return true;
+      });
+    }).wait();
+
+    return controller->concurrency();
+  };
+
+  auto restore = [&]()
+  {
+    mock.set_latency(settings.mock_latency);
+    mock.set_bandwidth(settings.mock_bandwidth);
+    mock.set_error_rate(settings.mock_error_rate, web::http::status_codes::ServiceUnavailable);
+  };
+
+  size_t flat = 0;
+  size_t throttled = 0;
+  size_t recovered = 0;
+  try
+  {
+    // A fixed delay well above the jitter of the local requests keeps the latency flat whatever the concurrency
+    mock.set_latency(std::chrono::milliseconds(20));
+    mock.set_bandwidth(0);
+    mock.set_error_rate(0, web::http::status_codes::ServiceUnavailable);
+    flat = run_phase();
+
+    mock.set_error_rate(error_rate, web::http::status_codes::ServiceUnavailable);
+    throttled = run_phase();
+
+    mock.set_error_rate(0, web::http::status_codes::ServiceUnavailable);
+    recovered = run_phase();
+  }
+  catch (...)
+  {
+    restore();
+    throw;
+  }
+
+  restore();
+
+  web::json::value result = web::json::value::object();
+  result[U("operation")] = web::json::value::string(U("controller_check"));
+  result[U("error_rate")] = web::json::value::number(error_rate);
+  result[U("failed_requests")] = web::json::value::number(static_cast<uint64_t>(failed));
+  result[U("concurrency_flat")] = web::json::value::number(static_cast<uint64_t>(flat));
+  result[U("concurrency_throttled")] = web::json::value::number(static_cast<uint64_t>(throttled));
+  result[U("concurrency_recovered")] = web::json::value::number(static_cast<uint64_t>(recovered));
+  result[U("controller")] = controller->to_json();
+  result[U("passed")] = web::json::value::boolean(throttled < flat && recovered > throttled);
+  return result;
+}
+
+///
+/// Reports the results of the operations whose check failed, and returns whether all the checks passed
+///
+bool checks_passed(const web::json::value& report)
+{
+  bool passed = true;
+  for (const web::json::value& result : report.at(U("results")).as_array())
+  {
+    if (result.has_field(U("passed")) && !result.at(U("passed")).as_bool())
+    {
+      ucerr << U("Check failed: ") << result.at(U("operation")).as_string() << std::endl;
+      passed = false;
+    }
+  }
+
+  return passed;
+}
+
+///
+/// Creates 20 * 'iterations' small blobs, then sets a content type and a metadata entry on each of them: first one
+/// blob after the other with a properties request and a metadata request each, as the samples set them, then with
+/// the bulk updater on 'concurrency' workers, and again with the bulk updater once every blob is up to date.
+///
+std::vector<web::json::value> run_retag(cloud_blob_container container, const bench_settings& settings)
+{
+  const size_t blob_count = 20 * settings.iterations;
+  auto blob_name = [](size_t i)
+  {
+    return U("retag/blob-") + utility::conversions::print_string(i);
+  };
+
+  std::vector<pplx::task<void>> uploads;
+  for (size_t i = 0; i < blob_count; i++)
+  {
+    uploads.push_back(container.get_block_blob_reference(blob_name(i)).upload_text_async(U("retag")));
+  }
+
+  pplx::when_all(uploads.begin(), uploads.end()).wait();
+
+  auto report = [blob_count](const utility::string_t& name, const update_stats& stats)
+  {
+    web::json::value result = web::json::value::object();
+    result[U("operation")] = web::json::value::string(name);
+    result[U("blobs")] = web::json::value::number(static_cast<uint64_t>(blob_count));
+    result[U("written")] = web::json::value::number(static_cast<uint64_t>(stats.written));
+    result[U("unchanged")] = web::json::value::number(static_cast<uint64_t>(stats.unchanged));
+    result[U("requests")] = web::json::value::number(static_cast<uint64_t>(stats.requests));
+    result[U("seconds")] = web::json::value::number(stats.seconds);
+    result[U("updates_per_second")] = web::json::value::number(stats.updates_per_second());
+    result[U("conflict_rate")] = web::json::value::number(stats.conflict_rate());
+    return result;
+  };
+
+  std::vector<web::json::value> results;
+  ucerr << U("Running retag_one_at_a_time with ") << blob_count << U(" blobs") << std::endl;
+
+  update_stats sequential;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < blob_count; i++)
+  {
+    cloud_block_blob blob = container.get_block_blob_reference(blob_name(i));
+    blob.download_attributes();
+    blob.properties().set_content_type(U("text/plain"));
+    blob.upload_properties();
+    blob.metadata()[U("generation")] = U("1");
+    blob.upload_metadata();
+    sequential.requests += 3;
+  }
+
+  sequential.updates = blob_count;
+  sequential.written = blob_count;
+  sequential.seconds = task_util::seconds_since(start);
+  results.push_back(report(U("retag_one_at_a_time"), sequential));
+
+  bulk_property_updater updater(settings.concurrency, 3);
+  for (const utility::string_t& name : { utility::string_t(U("retag_bulk")), utility::string_t(U("retag_bulk_unchanged")) })
+  {
+    ucerr << U("Running ") << name << U(" with ") << blob_count << U(" blobs") << std::endl;
+
+    size_t next = 0;
+    results.push_back(report(name, updater.apply(container, U("retag/"), [&](blob_update& update)
+    {
+      if (next >= blob_count)
+      {
+        return false;
+      }
+
+      update.blob_name = blob_name(next++);
+      update.content_type = U("text/plain; charset=utf-8");
+      update.metadata[U("generation")] = U("2");
+      return true;
+    })));
+  }
+
+  return results;
+}
+
+///
+/// Creates 100 * 'iterations' empty blobs under a prefix, one in ten with a snapshot, and deletes them: first
+/// listing them and deleting one blob after the other, then with the prefix deleter on 'concurrency' workers, then
+/// with the prefix deleter under a concurrency controller. The blobs are created again before each run.
+///
+std::vector<web::json::value> run_purge(cloud_blob_container container, const bench_settings& settings)
+{
+  const size_t blob_count = 100 * settings.iterations;
+  const utility::string_t prefix(U("purge/"));
+
+  auto create_blobs = [&]()
+  {
+    std::vector<pplx::task<void>> uploads;
+    for (size_t i = 0; i < blob_count; i++)
+    {
+      cloud_block_blob blob = container.get_block_blob_reference(prefix + utility::conversions::print_string(i));
+      uploads.push_back(blob.upload_text_async(utility::string_t()).then([blob, i]() mutable -> pplx::task<void>
+      {
+        if (i % 10 == 0)
+        {
+          return blob.create_snapshot_async().then([](cloud_blob)
+          {
+          });
+        }
+
+        return pplx::task_from_result();
+      }));
+    }
+
+    pplx::when_all(uploads.begin(), uploads.end()).wait();
+  };
+
+  auto report = [blob_count](const utility::string_t& name, const delete_stats& stats)
+  {
+    web::json::value result = web::json::value::object();
+    result[U("operation")] = web::json::value::string(name);
+    result[U("blobs")] = web::json::value::number(static_cast<uint64_t>(stats.blobs));
+    result[U("snapshots")] = web::json::value::number(static_cast<uint64_t>(stats.snapshots));
+    result[U("failed")] = web::json::value::number(static_cast<uint64_t>(stats.failed));
+    result[U("requests")] = web::json::value::number(static_cast<uint64_t>(stats.requests));
+    result[U("seconds")] = web::json::value::number(stats.seconds);
+    result[U("deletes_per_second")] = web::json::value::number(stats.deletes_per_second());
+    return result;
+  };
+
+  std::vector<web::json::value> results;
+  create_blobs();
+  ucerr << U("Running purge_one_at_a_time with ") << blob_count << U(" blobs") << std::endl;
+
+  delete_stats sequential;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  continuation_token token;
+  do
+  {
+    list_blob_item_segment segment = container.list_blobs_segmented(prefix, true, blob_listing_details::none, task_util::max_listing_results, token,
+      blob_request_options(), operation_context());
+    sequential.requests++;
+    for (const list_blob_item& item : segment.results())
+    {
+      item.as_blob().delete_blob(delete_snapshots_option::include_snapshots, access_condition(), blob_request_options(), operation_context());
+      sequential.blobs++;
+      sequential.requests++;
+    }
+
+    token = segment.continuation_token();
+  } while (!token.empty());
+
+  // The snapshots go with their blob, without being listed
+  sequential.snapshots = (blob_count + 9) / 10;
+  sequential.seconds = task_util::seconds_since(start);
+  results.push_back(report(U("purge_one_at_a_time"), sequential));
+
+  create_blobs();
+  ucerr << U("Running purge_fixed with ") << blob_count << U(" blobs") << std::endl;
+  prefix_deleter deleter(settings.concurrency);
+  results.push_back(report(U("purge_fixed"), deleter.delete_prefix(container, prefix)));
+
+  create_blobs();
+  ucerr << U("Running purge_adaptive with ") << blob_count << U(" blobs") << std::endl;
+  deleter.set_controller(std::make_shared<concurrency_controller>(1, 64, 64 * 1024, max_request_size));
+  results.push_back(report(U("purge_adaptive"), deleter.delete_prefix(container, prefix)));
+
+  return results;
+}
+
+#ifdef BUILD_PAGE_BLOB_BACKUP
+///
+/// Writes every page of a page blob of 'iterations' MiB, backs it up in full to a local file, then rewrites one
+/// page in a hundred and clears as many, and backs it up again from the snapshot of the first backup. Both backups
+/// download on 'concurrency' workers.
+///
+std::vector<web::json::value> run_backup(cloud_blob_container container, const bench_settings& settings)
+{
+  const utility::string_t file_name(U("blobbench-backup.tmp"));
+  const size_t page_size = 512;
+  const size_t blob_size = settings.iterations * 1024 * 1024;
+
+  cloud_page_blob blob = container.get_page_blob_reference(U("backup"));
+  blob.create(blob_size);
+
+  std::mt19937 random(13);
+  std::vector<uint8_t> content(blob_size);
+  for (auto& byte : content)
+  {
+    byte = static_cast<uint8_t>(random());
+  }
+
+  std::vector<pplx::task<void>> writes;
+  for (size_t offset = 0; offset < blob_size; offset += max_request_size)
+  {
+    size_t length = std::min(max_request_size, blob_size - offset);
+    concurrency::streams::istream pages = concurrency::streams::bytestream::open_istream(std::vector<uint8_t>(content.begin() + offset, content.begin() + offset + length));
+    writes.push_back(blob.upload_pages_async(pages, static_cast<int64_t>(offset), utility::string_t()));
+  }
+
+  pplx::when_all(writes.begin(), writes.end()).wait();
+
+  auto report = [blob_size](const utility::string_t& name, const page_backup& backup)
+  {
+    web::json::value result = web::json::value::object();
+    result[U("operation")] = web::json::value::string(name);
+    result[U("blob_bytes")] = web::json::value::number(static_cast<uint64_t>(blob_size));
+    result[U("bytes")] = web::json::value::number(static_cast<uint64_t>(backup.stats.bytes));
+    result[U("changed_ranges")] = web::json::value::number(static_cast<uint64_t>(backup.changed_ranges));
+    result[U("cleared_ranges")] = web::json::value::number(static_cast<uint64_t>(backup.cleared_ranges));
+    result[U("requests")] = web::json::value::number(static_cast<uint64_t>(backup.stats.requests));
+    result[U("seconds")] = web::json::value::number(backup.stats.seconds);
+    result[U("megabytes_per_second")] = web::json::value::number(backup.stats.megabytes_per_second());
+    return result;
+  };
+
+  std::vector<web::json::value> results;
+  try
+  {
+    page_blob_backup backup(max_request_size, settings.concurrency);
+
+    ucerr << U("Running backup_full with ") << blob_size << U(" bytes") << std::endl;
+    page_backup full = backup.backup(blob, file_name, utility::string_t());
+    results.push_back(report(U("backup_full"), full));
+
+    std::vector<uint8_t> page(page_size);
+    for (size_t offset = 0; offset + 100 * page_size <= blob_size; offset += 100 * page_size)
+    {
+      for (auto& byte : page)
+      {
+        byte = static_cast<uint8_t>(random());
+      }
+
+      concurrency::streams::istream page_stream = concurrency::streams::bytestream::open_istream(page);
+      blob.upload_pages(page_stream, static_cast<int64_t>(offset), utility::string_t());
+      blob.clear_pages(static_cast<int64_t>(offset + 50 * page_size), static_cast<int64_t>(page_size));
+    }
+
+    ucerr << U("Running backup_incremental with ") << blob_size << U(" bytes") << std::endl;
+    results.push_back(report(U("backup_incremental"), backup.backup(blob, file_name, full.snapshot_time)));
+  }
+  catch (...)
+  {
+    std::remove(utility::conversions::to_utf8string(file_name).c_str());
+    throw;
+  }
+
+  std::remove(utility::conversions::to_utf8string(file_name).c_str());
+  return results;
+}
+#endif
+
+#ifdef BUILD_GZIP_TRANSFER
+///
+/// Writes a log file of 'iterations' blocks of 'block_size' bytes, uploads it in blocks as it is, then compressed
+/// with gzip, and downloads the compressed blob decompressing it. The throughput is computed on the size of the
+/// file, so it includes the time spent compressing and decompressing.
+///
+std::vector<web::json::value> run_compression(cloud_blob_container container, size_t block_size, const bench_settings& settings)
+{
+  const utility::string_t file_name(U("blobbench-log.tmp"));
+  const utility::string_t copy_file_name(U("blobbench-log-copy.tmp"));
+
+  ucerr << U("Running gzip with ") << block_size << U(" byte blocks") << std::endl;
+
+  utility::size64_t file_size = static_cast<utility::size64_t>(block_size) * settings.iterations;
+  {
+    std::mt19937 random(13);
+    std::ofstream file(utility::conversions::to_utf8string(file_name), std::ios::binary);
+    for (utility::size64_t written = 0; written < file_size; )
+    {
+      std::string record = "2016-01-01T00:00:00Z,bench-host," + std::to_string(random() % 16) + ",request served in " + std::to_string(random() % 1000) + " ms\n";
+      record.resize(static_cast<size_t>(std::min<utility::size64_t>(record.size(), file_size - written)));
+      file << record;
+      written += record.size();
+    }
+  }
+
+  auto report = [&](const utility::string_t& name, const transfer_stats& stats)
+  {
+    web::json::value result = web::json::value::object();
+    result[U("operation")] = web::json::value::string(name);
+    result[U("payload_bytes")] = web::json::value::number(static_cast<uint64_t>(block_size));
+    result[U("file_bytes")] = web::json::value::number(static_cast<uint64_t>(file_size));
+    result[U("transferred_bytes")] = web::json::value::number(static_cast<uint64_t>(stats.bytes));
+    result[U("compression_ratio")] = web::json::value::number(stats.bytes > 0 ? static_cast<double>(file_size) / stats.bytes : 0);
+    result[U("requests")] = web::json::value::number(static_cast<uint64_t>(stats.requests));
+    result[U("seconds")] = web::json::value::number(stats.seconds);
+    result[U("gigabytes_per_second")] = web::json::value::number(stats.seconds > 0 ? static_cast<double>(file_size) / (1024.0 * 1024.0 * 1024.0) / stats.seconds : 0);
+    return result;
+  };
+
+  std::vector<web::json::value> results;
+  try
+  {
+    utility::string_t suffix = U("-") + utility::conversions::print_string(block_size);
+
+    parallel_block_uploader uploader(block_size, settings.concurrency);
+    results.push_back(report(U("upload_raw"), uploader.upload_file(container.get_block_blob_reference(U("raw") + suffix), file_name)));
+
+    compressed_transfer transfer(block_size, settings.concurrency, 6);
+    cloud_block_blob compressed = container.get_block_blob_reference(U("gzip") + suffix);
+    results.push_back(report(U("upload_gzip"), transfer.upload_file(compressed, file_name)));
+    results.push_back(report(U("download_gzip"), transfer.download_to_file(compressed, copy_file_name)));
+  }
+  catch (...)
+  {
+    std::remove(utility::conversions::to_utf8string(file_name).c_str());
+    std::remove(utility::conversions::to_utf8string(copy_file_name).c_str());
+    throw;
+  }
+
+  std::remove(utility::conversions::to_utf8string(file_name).c_str());
+  std::remove(utility::conversions::to_utf8string(copy_file_name).c_str());
+  return results;
+}
+#endif
+
+///
+/// Downloads a blob 'iterations' times with ranged requests to a temporary file. Without a controller, ranges of
+/// a quarter of the payload are requested on 'concurrency' workers. With one, the controller chooses the number
+/// and the size of the ranges from the latencies and the throttling it observes, and its decisions are reported.
+///
+web::json::value run_ranged_download(const utility::string_t& name, cloud_blob source, size_t payload_size, const bench_settings& settings,
+  std::shared_ptr<concurrency_controller> controller)
+{
+  ucerr << U("Running ") << name << U(" with ") << payload_size << U(" bytes") << std::endl;
+
+  const utility::string_t file_name(U("blobbench-download.tmp"));
+  parallel_range_downloader downloader(controller ? max_request_size : std::max<size_t>(payload_size / 4, 1), settings.concurrency);
+  downloader.set_controller(controller);
+
+  transfer_stats total;
+  size_t errors = 0;
+  for (size_t i = 0; i < settings.iterations; i++)
+  {
+    try
+    {
+      transfer_stats stats = downloader.download_to_file(source, file_name);
+      total.bytes += stats.bytes;
+      total.requests += stats.requests;
+      total.seconds += stats.seconds;
+    }
+    catch (const azure::storage::storage_exception& e)
+    {
+      if (errors++ == 0)
+      {
+        ucerr << U("Error:") << e.what() << std::endl;
+      }
+    }
+  }
+
+  std::remove(utility::conversions::to_utf8string(file_name).c_str());
+
+  web::json::value result = web::json::value::object();
+  result[U("operation")] = web::json::value::string(name);
+  result[U("payload_bytes")] = web::json::value::number(static_cast<uint64_t>(payload_size));
+  result[U("iterations")] = web::json::value::number(static_cast<uint64_t>(settings.iterations));
+  result[U("errors")] = web::json::value::number(static_cast<uint64_t>(errors));
+  result[U("requests")] = web::json::value::number(static_cast<uint64_t>(total.requests));
+  result[U("seconds")] = web::json::value::number(total.seconds);
+  result[U("megabytes_per_second")] = web::json::value::number(total.megabytes_per_second());
+  if (controller)
+  {
+    result[U("controller")] = controller->to_json();
+  }
+
+  return result;
+}
@@ -0,0 +1,155 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#include "stdafx.h"
+#include "md5.h"
+#include "block_journal.h"
+
+namespace
+{
+  // The journal starts with the magic bytes, the size of the uploaded file and the block size,
+  // followed by a fixed size record per uploaded block.
+  const char journal_magic[8] = { 'B', 'L', 'K', 'J', 'R', 'N', 'L', '1' };
+  const size_t header_size = sizeof(journal_magic) + 2 * sizeof(uint64_t);
+  const size_t record_size = 2 * sizeof(uint32_t) + sizeof(uint64_t) + 16;
+
+  void put(std::vector<char>& buffer, uint64_t value, size_t size)
+  {
+    for (size_t i = 0; i < size; i++)
+    {
+      buffer.push_back(static_cast<char>(value >> (8 * i)));
+    }
+  }
+
+  uint64_t get(const char* data, size_t size)
+  {
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+      value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+
+    return value;
+  }
+}
+
+///
+/// Creates a journal of the blocks uploaded for a file, stored in the given file.
+///
+block_journal::block_journal(const utility::string_t& file_name)
+  : m_file_name(file_name)
+{
+}
+
+///
+/// Reads the blocks recorded by a previous upload of a file with the same size and block size, and keeps
+/// the journal open to record more blocks. A journal written for another file or block size is started over.
+/// A record cut short by a crash is dropped.
+///
+std::vector<block_journal_entry> block_journal::open(utility::size64_t file_size, size_t block_size)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  std::vector<block_journal_entry> entries;
+  std::vector<char> content;
+  {
+    std::ifstream existing(m_file_name.c_str(), std::ios::binary);
+    if (existing)
+    {
+      content.assign(std::istreambuf_iterator<char>(existing), std::istreambuf_iterator<char>());
+    }
+  }
+
+  bool valid = content.size() >= header_size &&
+    std::memcmp(content.data(), journal_magic, sizeof(journal_magic)) == 0 &&
+    get(content.data() + sizeof(journal_magic), sizeof(uint64_t)) == file_size &&
+    get(content.data() + sizeof(journal_magic) + sizeof(uint64_t), sizeof(uint64_t)) == block_size;
+
+  if (valid)
+  {
+    size_t complete_size = header_size + (content.size() - header_size) / record_size * record_size;
+    for (size_t position = header_size; position < complete_size; position += record_size)
+    {
+      const char* record = content.data() + position;
+
+      block_journal_entry entry;
+      entry.index = static_cast<uint32_t>(get(record, sizeof(uint32_t)));
+      entry.length = static_cast<uint32_t>(get(record + sizeof(uint32_t), sizeof(uint32_t)));
+      entry.offset = get(record + 2 * sizeof(uint32_t), sizeof(uint64_t));
+      std::memcpy(entry.md5.data(), record + 2 * sizeof(uint32_t) + sizeof(uint64_t), entry.md5.size());
+      entries.push_back(entry);
+    }
+
+    // Rewrite the complete records only, so new records are not appended after a partial one
+    content.resize(complete_size);
+  }
+  else
+  {
+    content.assign(journal_magic, journal_magic + sizeof(journal_magic));
+    put(content, file_size, sizeof(uint64_t));
+    put(content, block_size, sizeof(uint64_t));
+  }
+
+  m_file.open(m_file_name.c_str(), std::ios::binary | std::ios::trunc);
+  m_file.write(content.data(), static_cast<std::streamsize>(content.size()));
+  m_file.flush();
+  if (!m_file)
+  {
+    throw std::runtime_error("The journal could not be written");
+  }
+
+  return entries;
+}
+
+///
+/// Adds an uploaded block to the journal. The record is flushed right away so it survives the process.
+///
+void block_journal::record(const block_journal_entry& entry)
+{
+  std::vector<char> record;
+  record.reserve(record_size);
+  put(record, entry.index, sizeof(uint32_t));
+  put(record, entry.length, sizeof(uint32_t));
+  put(record, entry.offset, sizeof(uint64_t));
+  record.insert(record.end(), entry.md5.begin(), entry.md5.end());
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_file.write(record.data(), static_cast<std::streamsize>(record.size()));
+  m_file.flush();
+  if (!m_file)
+  {
+    throw std::runtime_error("The journal could not be written");
+  }
+}
+
+///
+/// Closes and deletes the journal, once the upload it tracks has been committed
+///
+void block_journal::remove()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_file.is_open())
+  {
+    m_file.close();
+  }
+
+#ifdef _WIN32
+  _wremove(m_file_name.c_str());
+#else
+  std::remove(m_file_name.c_str());
+#endif
+}
@@ -0,0 +1,41 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#pragma once
+
+struct block_journal_entry
+{
+  uint32_t index;
+  uint32_t length;
+  utility::size64_t offset;
+  md5_hash::digest md5;
+};
+
+class block_journal
+{
+public:
+  explicit block_journal(const utility::string_t& file_name);
+
+  std::vector<block_journal_entry> open(utility::size64_t file_size, size_t block_size);
+  void record(const block_journal_entry& entry);
+  void remove();
+
+private:
+  utility::string_t m_file_name;
+  std::mutex m_mutex;
+  std::ofstream m_file;
+};
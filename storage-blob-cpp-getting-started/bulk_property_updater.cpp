@@ -0,0 +1,396 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "task_util.h"
+#include "bulk_property_updater.h"
+
+using namespace azure::storage;
+
+namespace
+{
+  struct updater_state
+  {
+    explicit updater_state(size_t max_attempts)
+      : max_attempts(max_attempts), next(0), unchanged(0), missing(0), written(0), failed(0), write_requests(0), conflicts(0), requests(0)
+    {
+    }
+
+    size_t max_attempts;
+    // Built once for every request of the update, the client defaults applying to it
+    blob_request_options options;
+    std::atomic<size_t> next;
+    std::atomic<size_t> unchanged;
+    std::atomic<size_t> missing;
+    std::atomic<size_t> written;
+    std::atomic<size_t> failed;
+    std::atomic<size_t> write_requests;
+    std::atomic<size_t> conflicts;
+    std::atomic<size_t> requests;
+  };
+
+  // A listed blob, with the properties and metadata it was listed with, and the update to apply to it
+  struct pending_update
+  {
+    cloud_blob blob;
+    std::shared_ptr<blob_update> update;
+  };
+
+  void merge_property(utility::string_t& merged, const utility::string_t& value)
+  {
+    if (!value.empty())
+    {
+      merged = value;
+    }
+  }
+
+  ///
+  /// Merges a later update of a blob into an earlier one. The later values win, and a metadata entry removed by
+  /// one update and set by the other ends as the later one left it.
+  ///
+  void merge(blob_update& merged, const blob_update& update)
+  {
+    merge_property(merged.content_type, update.content_type);
+    merge_property(merged.content_encoding, update.content_encoding);
+    merge_property(merged.content_language, update.content_language);
+    merge_property(merged.cache_control, update.cache_control);
+    merge_property(merged.content_disposition, update.content_disposition);
+
+    for (const utility::string_t& name : update.removed_metadata)
+    {
+      merged.metadata.erase(name);
+      if (std::find(merged.removed_metadata.begin(), merged.removed_metadata.end(), name) == merged.removed_metadata.end())
+      {
+        merged.removed_metadata.push_back(name);
+      }
+    }
+
+    for (const auto& entry : update.metadata)
+    {
+      merged.metadata[entry.first] = entry.second;
+      merged.removed_metadata.erase(std::remove(merged.removed_metadata.begin(), merged.removed_metadata.end(), entry.first), merged.removed_metadata.end());
+    }
+  }
+
+  bool differs(const utility::string_t& wanted, const utility::string_t& current)
+  {
+    return !wanted.empty() && wanted != current;
+  }
+
+  bool needs_properties(const cloud_blob& blob, const blob_update& update)
+  {
+    const cloud_blob_properties& properties = blob.properties();
+    return differs(update.content_type, properties.content_type()) || differs(update.content_encoding, properties.content_encoding())
+      || differs(update.content_language, properties.content_language()) || differs(update.cache_control, properties.cache_control())
+      || differs(update.content_disposition, properties.content_disposition());
+  }
+
+  bool needs_metadata(const cloud_blob& blob, const blob_update& update)
+  {
+    const cloud_metadata& metadata = blob.metadata();
+    for (const auto& entry : update.metadata)
+    {
+      auto found = metadata.find(entry.first);
+      if (found == metadata.end() || found->second != entry.second)
+      {
+        return true;
+      }
+    }
+
+    for (const utility::string_t& name : update.removed_metadata)
+    {
+      if (metadata.find(name) != metadata.end())
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  ///
+  /// Applies an update to a blob whose properties and metadata were listed or read, writing only what differs.
+  /// Set Blob Properties replaces all the standard properties and Set Blob Metadata all the metadata, so both start
+  /// from the current values, and each write is conditional on the ETag they were read with. When the blob changed
+  /// in between, it is read again and compared with the update before the next attempt.
+  ///
+  pplx::task<void> write_update(std::shared_ptr<updater_state> state, cloud_blob blob, std::shared_ptr<blob_update> update, size_t attempt)
+  {
+    bool properties = needs_properties(blob, *update);
+    bool metadata = needs_metadata(blob, *update);
+    if (!properties && !metadata)
+    {
+      state->unchanged++;
+      return pplx::task_from_result();
+    }
+
+    cloud_blob_properties& blob_properties = blob.properties();
+    if (!update->content_type.empty())
+    {
+      blob_properties.set_content_type(update->content_type);
+    }
+
+    if (!update->content_encoding.empty())
+    {
+      blob_properties.set_content_encoding(update->content_encoding);
+    }
+
+    if (!update->content_language.empty())
+    {
+      blob_properties.set_content_language(update->content_language);
+    }
+
+    if (!update->cache_control.empty())
+    {
+      blob_properties.set_cache_control(update->cache_control);
+    }
+
+    if (!update->content_disposition.empty())
+    {
+      blob_properties.set_content_disposition(update->content_disposition);
+    }
+
+    for (const auto& entry : update->metadata)
+    {
+      blob.metadata()[entry.first] = entry.second;
+    }
+
+    for (const utility::string_t& name : update->removed_metadata)
+    {
+      blob.metadata().erase(name);
+    }
+
+    pplx::task<void> written = pplx::task_from_result();
+    if (properties)
+    {
+      state->write_requests++;
+      written = blob.upload_properties_async(access_condition::generate_if_match_condition(blob.properties().etag()), state->options, operation_context());
+    }
+
+    if (metadata)
+    {
+      // The properties write changed the ETag of the blob, which the metadata write is conditional on
+      written = written.then([state, blob]() mutable
+      {
+        state->write_requests++;
+        return blob.upload_metadata_async(access_condition::generate_if_match_condition(blob.properties().etag()), state->options, operation_context());
+      });
+    }
+
+    return written.then([state, blob, update, attempt](pplx::task<void> completed) -> pplx::task<void>
+    {
+      try
+      {
+        completed.get();
+        state->written++;
+        return pplx::task_from_result();
+      }
+      catch (const azure::storage::storage_exception& e)
+      {
+        web::http::status_code status = e.result().http_status_code();
+        if (status == web::http::status_codes::NotFound)
+        {
+          state->missing++;
+          return pplx::task_from_result();
+        }
+
+        if (status != web::http::status_codes::PreconditionFailed)
+        {
+          state->failed++;
+          return pplx::task_from_result();
+        }
+
+        state->conflicts++;
+        if (attempt + 1 >= state->max_attempts)
+        {
+          state->failed++;
+          return pplx::task_from_result();
+        }
+      }
+
+      cloud_blob current = blob.container().get_blob_reference(blob.name());
+      return current.download_attributes_async(access_condition(), state->options, operation_context()).then([state, current, update, attempt](pplx::task<void> read) -> pplx::task<void>
+      {
+        state->requests++;
+        try
+        {
+          read.get();
+        }
+        catch (const azure::storage::storage_exception& e)
+        {
+          if (e.result().http_status_code() == web::http::status_codes::NotFound)
+          {
+            state->missing++;
+          }
+          else
+          {
+            state->failed++;
+          }
+
+          return pplx::task_from_result();
+        }
+
+        return write_update(state, current, update, attempt + 1);
+      });
+    });
+  }
+
+  pplx::task<list_blob_item_segment> list_page(const cloud_blob_container& container, const utility::string_t& prefix, const continuation_token& token,
+    const blob_request_options& options)
+  {
+    return container.list_blobs_segmented_async(prefix, true, blob_listing_details::metadata, task_util::max_listing_results, token, options,
+      operation_context());
+  }
+}
+
+blob_update::blob_update()
+{
+}
+
+blob_update::blob_update(const utility::string_t& blob_name)
+  : blob_name(blob_name)
+{
+}
+
+update_stats::update_stats()
+  : updates(0), merged(0), unchanged(0), missing(0), written(0), failed(0), write_requests(0), conflicts(0), requests(0), seconds(0)
+{
+}
+
+double update_stats::updates_per_second() const
+{
+  return seconds > 0 ? updates / seconds : 0;
+}
+
+///
+/// Returns the fraction of the writes rejected because the blob changed after it was read
+///
+double update_stats::conflict_rate() const
+{
+  return write_requests > 0 ? static_cast<double>(conflicts) / write_requests : 0;
+}
+
+///
+/// Creates an updater writing up to 'parallelism' blobs at once, and trying each blob up to 'max_attempts' times
+/// when it changes while being updated.
+///
+bulk_property_updater::bulk_property_updater(size_t parallelism, size_t max_attempts)
+  : m_parallelism(parallelism), m_max_attempts(max_attempts)
+{
+}
+
+///
+/// Applies the updates returned by 'next_update' until it returns false to the blobs under the prefix. The updates
+/// of the same blob are merged first, so each blob is written at most once. The blobs are then listed with their
+/// properties and metadata, and only the ones that differ from their update are written, with one request for the
+/// properties and one for the metadata when both differ, as the service sets them separately. The next page of the
+/// listing is requested while the blobs of the current one are written. An update whose blob is not listed is
+/// counted as missing.
+///
+update_stats bulk_property_updater::apply(cloud_blob_container container, const utility::string_t& prefix, std::function<bool(blob_update&)> next_update) const
+{
+  std::shared_ptr<updater_state> state = std::make_shared<updater_state>(m_max_attempts);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  update_stats stats;
+  std::unordered_map<utility::string_t, std::shared_ptr<blob_update>> updates;
+  blob_update update;
+  while (next_update(update))
+  {
+    stats.updates++;
+    auto found = updates.find(update.blob_name);
+    if (found == updates.end())
+    {
+      updates[update.blob_name] = std::make_shared<blob_update>(update);
+    }
+    else
+    {
+      merge(*found->second, update);
+      stats.merged++;
+    }
+
+    update = blob_update();
+  }
+
+  pplx::task<list_blob_item_segment> listing;
+  if (!updates.empty())
+  {
+    listing = list_page(container, prefix, continuation_token(), state->options);
+  }
+
+  while (!updates.empty())
+  {
+    list_blob_item_segment segment = listing.get();
+    state->requests++;
+
+    std::vector<pending_update> pending;
+    for (const list_blob_item& item : segment.results())
+    {
+      if (!item.is_blob())
+      {
+        continue;
+      }
+
+      cloud_blob blob = item.as_blob();
+      auto found = updates.find(blob.name());
+      if (found != updates.end())
+      {
+        pending_update listed;
+        listed.blob = blob;
+        listed.update = found->second;
+        pending.push_back(listed);
+        updates.erase(found);
+      }
+    }
+
+    continuation_token token = segment.continuation_token();
+    bool more = !token.empty() && !updates.empty();
+    if (more)
+    {
+      listing = list_page(container, prefix, token, state->options);
+    }
+
+    state->next = 0;
+    task_util::run_workers(m_parallelism, [&]() -> pplx::task<bool>
+    {
+      size_t index = state->next++;
+      if (index >= pending.size())
+      {
+        return pplx::task_from_result(false);
+      }
+
+      return write_update(state, pending[index].blob, pending[index].update, 0).then([]()
+      {
+        return true;
+      });
+    }).wait();
+
+    if (!more)
+    {
+      break;
+    }
+  }
+
+  stats.unchanged = state->unchanged;
+  stats.missing = state->missing + updates.size();
+  stats.written = state->written;
+  stats.failed = state->failed;
+  stats.write_requests = state->write_requests;
+  stats.conflicts = state->conflicts;
+  stats.requests = state->requests + state->write_requests;
+  stats.seconds = task_util::seconds_since(start);
+  return stats;
+}
@@ -0,0 +1,66 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+using namespace azure::storage;
+
+#pragma once
+
+struct blob_update
+{
+  blob_update();
+  explicit blob_update(const utility::string_t& blob_name);
+
+  utility::string_t blob_name;
+  utility::string_t content_type;
+  utility::string_t content_encoding;
+  utility::string_t content_language;
+  utility::string_t cache_control;
+  utility::string_t content_disposition;
+  cloud_metadata metadata;
+  std::vector<utility::string_t> removed_metadata;
+};
+
+struct update_stats
+{
+  update_stats();
+
+  double updates_per_second() const;
+  double conflict_rate() const;
+
+  size_t updates;
+  size_t merged;
+  size_t unchanged;
+  size_t missing;
+  size_t written;
+  size_t failed;
+  size_t write_requests;
+  size_t conflicts;
+  size_t requests;
+  double seconds;
+};
+
+class bulk_property_updater
+{
+public:
+  bulk_property_updater(size_t parallelism, size_t max_attempts);
+
+  update_stats apply(cloud_blob_container container, const utility::string_t& prefix, std::function<bool(blob_update&)> next_update) const;
+
+private:
+  size_t m_parallelism;
+  size_t m_max_attempts;
+};
@@ -0,0 +1,122 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#include "stdafx.h"
+#include "md5.h"
+#include "integrity_pipeline.h"
+#include "concurrency_controller.h"
+#include "request_tracer.h"
+#include "client_context.h"
+
+using namespace azure::storage;
+
+///
+/// Parses the connection string once and creates the blob client shared by every sample. The request options
+/// are tuned once as the defaults of the client, so each operation only passes default-constructed options and
+/// picks them up without building its own copy of the settings. This version of the client library has no setting
+/// for its HTTP connections, which are kept alive by the HTTP client, so the tuning is on the requests: larger
+/// single requests and more of them in flight for the uploads of the SDK itself. The transfers of all the samples share one request
+/// tracer and one integrity pipeline hashing the blocks they upload. Each kind of transfer has its own concurrency
+/// controller learning how many requests of which size the account takes, since the latencies of block uploads,
+/// page writes, range reads and deletes are not comparable. The block sizes start at 4 MB, the size of a
+/// request of the client library, and the transfers keep their ranges at most as large as they are configured.
+///
+client_context::client_context(const utility::string_t& storage_connection_string)
+  : m_storage_account(cloud_storage_account::parse(storage_connection_string)),
+  m_block_controller(std::make_shared<concurrency_controller>(2, 32, 4 * 1024, 4 * 1024 * 1024, 4 * 1024 * 1024)),
+  m_page_controller(std::make_shared<concurrency_controller>(2, 32, 4 * 1024, 4 * 1024 * 1024, 4 * 1024 * 1024)),
+  m_range_controller(std::make_shared<concurrency_controller>(2, 32, 4 * 1024, 4 * 1024 * 1024, 4 * 1024 * 1024)),
+  m_delete_controller(std::make_shared<concurrency_controller>(2, 32, 0, 0)),
+  m_tracer(std::make_shared<request_tracer>()),
+  m_pipeline(integrity_pipeline::create_default())
+{
+  m_blob_client = m_storage_account.create_cloud_blob_client();
+
+  blob_request_options options;
+  options.set_retry_policy(exponential_retry_policy(std::chrono::seconds(2), 4));
+  options.set_server_timeout(std::chrono::seconds(30));
+  options.set_maximum_execution_time(std::chrono::minutes(5));
+
+  // Large transfers are read from the network in 1 MiB chunks instead of 64 KiB ones
+  options.set_http_buffer_size(1024 * 1024);
+
+  // Blobs up to 32 MB are uploaded with one request, larger ones with up to 8 blocks in flight instead of 1
+  options.set_single_blob_upload_threshold_in_bytes(32 * 1024 * 1024);
+  options.set_parallelism_factor(8);
+  m_blob_client.set_default_request_options(options);
+}
+
+const cloud_storage_account& client_context::storage_account() const
+{
+  return m_storage_account;
+}
+
+const cloud_blob_client& client_context::blob_client() const
+{
+  return m_blob_client;
+}
+
+std::shared_ptr<concurrency_controller> client_context::block_controller() const
+{
+  return m_block_controller;
+}
+
+std::shared_ptr<concurrency_controller> client_context::page_controller() const
+{
+  return m_page_controller;
+}
+
+std::shared_ptr<concurrency_controller> client_context::range_controller() const
+{
+  return m_range_controller;
+}
+
+std::shared_ptr<concurrency_controller> client_context::delete_controller() const
+{
+  return m_delete_controller;
+}
+
+std::shared_ptr<request_tracer> client_context::tracer() const
+{
+  return m_tracer;
+}
+
+std::shared_ptr<integrity_pipeline> client_context::pipeline() const
+{
+  return m_pipeline;
+}
+
+///
+/// Creates a container in the blob storage
+///
+cloud_blob_container client_context::create_container(const utility::string_t& container_name) const
+{
+  // Get a reference to the container
+  cloud_blob_container container = m_blob_client.get_container_reference(container_name);
+  try
+  {
+    // Create the container if it does not exist yet
+    container.create_if_not_exists(blob_container_public_access_type::off, blob_request_options(), m_tracer->create_context(U("create_container")));
+
+    return container;
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("If you are running with the default configuration, make sure the storage emulator is started.") << std::endl;
+    throw;
+  }
+}
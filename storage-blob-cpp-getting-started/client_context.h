@@ -0,0 +1,50 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+using namespace azure::storage;
+
+#pragma once
+class concurrency_controller;
+class request_tracer;
+class integrity_pipeline;
+
+class client_context
+{
+public:
+  explicit client_context(const utility::string_t& storage_connection_string);
+
+  const cloud_storage_account& storage_account() const;
+  const cloud_blob_client& blob_client() const;
+  std::shared_ptr<concurrency_controller> block_controller() const;
+  std::shared_ptr<concurrency_controller> page_controller() const;
+  std::shared_ptr<concurrency_controller> range_controller() const;
+  std::shared_ptr<concurrency_controller> delete_controller() const;
+  std::shared_ptr<request_tracer> tracer() const;
+  std::shared_ptr<integrity_pipeline> pipeline() const;
+
+  cloud_blob_container create_container(const utility::string_t& container_name) const;
+
+private:
+  cloud_storage_account m_storage_account;
+  cloud_blob_client m_blob_client;
+  std::shared_ptr<concurrency_controller> m_block_controller;
+  std::shared_ptr<concurrency_controller> m_page_controller;
+  std::shared_ptr<concurrency_controller> m_range_controller;
+  std::shared_ptr<concurrency_controller> m_delete_controller;
+  std::shared_ptr<request_tracer> m_tracer;
+  std::shared_ptr<integrity_pipeline> m_pipeline;
+};
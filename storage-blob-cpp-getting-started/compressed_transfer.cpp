@@ -0,0 +1,244 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "task_util.h"
+#include "md5.h"
+#include "integrity_pipeline.h"
+#include "mapped_file.h"
+#include "gzip_codec.h"
+#include "concurrency_controller.h"
+#include "request_tracer.h"
+#include "parallel_block_uploader.h"
+#include "compressed_transfer.h"
+
+using namespace azure::storage;
+
+const utility::string_t compressed_transfer::content_encoding(U("gzip"));
+
+namespace
+{
+  struct compress_state
+  {
+    compress_state() : block_count(0), next_block(0), bytes(0), requests(0) {}
+
+    std::shared_ptr<mapped_file> file;
+    size_t block_count;
+    std::atomic<size_t> next_block;
+    std::atomic<utility::size64_t> bytes;
+    std::atomic<size_t> requests;
+  };
+
+  typedef std::pair<pplx::task<void>, concurrency::streams::container_buffer<std::vector<uint8_t>>> pending_range;
+}
+
+///
+/// Creates a transfer compressing blocks of 'block_size' bytes of the file at the given zlib level (1 to 9),
+/// up to 'parallelism' blocks at once, and downloading ranges of that size.
+///
+compressed_transfer::compressed_transfer(size_t block_size, size_t parallelism, int level)
+  : m_block_size(block_size), m_parallelism(parallelism), m_level(level)
+{
+}
+
+///
+/// Uploads a file to a block blob compressed with gzip, and sets the content encoding of the blob so that HTTP
+/// clients reading it decompress it. Every block of the file is compressed on its own into a gzip member, on the
+/// thread pool, and uploaded as soon as it is compressed with the MD5 of the compressed bytes, so compressing
+/// the next blocks overlaps the upload of the previous ones. The members of all the blocks form one valid gzip
+/// stream. A file of a single block is sent with a single request.
+/// The returned statistics count the compressed bytes sent.
+///
+transfer_stats compressed_transfer::upload_file(cloud_block_blob block_blob, const utility::string_t& file_name) const
+{
+  std::shared_ptr<compress_state> state = std::make_shared<compress_state>();
+  state->file = mapped_file::open(file_name);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  size_t block_size = m_block_size;
+  int level = m_level;
+  state->block_count = std::max<size_t>(1, static_cast<size_t>((state->file->size() + block_size - 1) / block_size));
+  if (state->block_count > task_util::max_block_count)
+  {
+    throw std::runtime_error("The file has too many blocks, use a larger block size");
+  }
+
+  block_blob.properties().set_content_encoding(content_encoding);
+
+  if (state->block_count == 1)
+  {
+    std::vector<uint8_t> compressed = gzip_codec::compress(state->file->data(), static_cast<size_t>(state->file->size()), level);
+    concurrency::streams::istream stream = concurrency::streams::bytestream::open_istream(compressed);
+    block_blob.upload_from_stream(stream);
+    stream.close().wait();
+
+    transfer_stats stats;
+    stats.bytes = compressed.size();
+    stats.requests = 1;
+    stats.seconds = task_util::seconds_since(start);
+    return stats;
+  }
+
+  task_util::run_workers(m_parallelism, [block_blob, state, block_size, level]() -> pplx::task<bool>
+  {
+    size_t index = state->next_block++;
+    if (index >= state->block_count)
+    {
+      return pplx::task_from_result(false);
+    }
+
+    utility::size64_t offset = static_cast<utility::size64_t>(index) * block_size;
+    utility::size64_t length = std::min<utility::size64_t>(block_size, state->file->size() - offset);
+
+    return pplx::create_task([state, offset, length, level]()
+    {
+      return std::make_shared<std::vector<uint8_t>>(gzip_codec::compress(state->file->data() + offset, static_cast<size_t>(length), level));
+    }).then([block_blob, state, index, offset, length](std::shared_ptr<std::vector<uint8_t>> compressed)
+    {
+      state->file->release(offset, length);
+
+      utility::string_t content_md5 = md5_hash::to_base64(md5_hash::compute(compressed->data(), compressed->size()));
+      concurrency::streams::rawptr_buffer<uint8_t> buffer(compressed->data(), compressed->size(), std::ios::in);
+      concurrency::streams::istream block_stream(buffer);
+
+      // Every request uses its own reference so concurrent responses do not update the same blob properties
+      cloud_block_blob request_blob = block_blob.container().get_block_blob_reference(block_blob.name());
+      return request_blob.upload_block_async(parallel_block_uploader::block_id(index), block_stream, content_md5, access_condition(),
+        blob_request_options(), operation_context()).then([state, compressed, block_stream](pplx::task<void> upload)
+      {
+        block_stream.close();
+        upload.get();
+
+        state->bytes += compressed->size();
+        state->requests++;
+        return true;
+      });
+    });
+  }).wait();
+
+  std::vector<block_list_item> blocks;
+  blocks.reserve(state->block_count);
+  for (size_t index = 0; index < state->block_count; index++)
+  {
+    blocks.push_back(block_list_item(parallel_block_uploader::block_id(index)));
+  }
+
+  // The content encoding is set when the block list is committed
+  block_blob.upload_block_list(blocks);
+
+  transfer_stats stats;
+  stats.bytes = state->bytes;
+  stats.requests = state->requests + 1;
+  stats.seconds = task_util::seconds_since(start);
+  return stats;
+}
+
+///
+/// Downloads a blob to a file, decompressing it on the way when its content encoding is gzip. The blob is read in
+/// ranges, up to 'parallelism' of them requested ahead of the one being decompressed, and the ranges are decoded
+/// in order and appended to the file, so neither the compressed nor the decompressed blob is held in memory.
+/// All the ranges are requested with the ETag read at the start. A blob with another content encoding is
+/// written as it is. The returned statistics count the compressed bytes received.
+///
+transfer_stats compressed_transfer::download_to_file(cloud_blob blob, const utility::string_t& file_name) const
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  blob.download_attributes();
+  utility::size64_t size = blob.properties().size();
+  bool compressed = blob.properties().content_encoding() == content_encoding;
+  access_condition condition = access_condition::generate_if_match_condition(blob.properties().etag());
+
+  std::ofstream file(utility::conversions::to_utf8string(file_name).c_str(), std::ios::binary | std::ios::trunc);
+  if (!file)
+  {
+    throw std::runtime_error("The file could not be created");
+  }
+
+  transfer_stats stats;
+  stats.requests = 1;
+
+  gzip_decoder decoder;
+  std::vector<uint8_t> decoded;
+  std::deque<pending_range> pending;
+  utility::size64_t next_offset = 0;
+  while (next_offset < size || !pending.empty())
+  {
+    while (next_offset < size && pending.size() < std::max<size_t>(m_parallelism, 1))
+    {
+      utility::size64_t length = std::min<utility::size64_t>(m_block_size, size - next_offset);
+      concurrency::streams::container_buffer<std::vector<uint8_t>> buffer;
+      concurrency::streams::ostream stream(buffer);
+
+      cloud_blob range_blob = blob.container().get_blob_reference(blob.name(), blob.snapshot_time());
+      pending.push_back(std::make_pair(range_blob.download_range_to_stream_async(stream, next_offset, length, condition, blob_request_options(),
+        operation_context()), buffer));
+      next_offset += length;
+    }
+
+    try
+    {
+      pending.front().first.get();
+    }
+    catch (...)
+    {
+      // The ranges requested ahead are waited for, so their failures are observed too
+      for (pending_range& ahead : pending)
+      {
+        try
+        {
+          ahead.first.get();
+        }
+        catch (...)
+        {
+        }
+      }
+
+      throw;
+    }
+
+    const std::vector<uint8_t>& range = pending.front().second.collection();
+    stats.bytes += range.size();
+    stats.requests++;
+
+    if (compressed)
+    {
+      decoded.clear();
+      decoder.decode(range.data(), range.size(), decoded);
+      file.write(reinterpret_cast<const char*>(decoded.data()), decoded.size());
+    }
+    else
+    {
+      file.write(reinterpret_cast<const char*>(range.data()), range.size());
+    }
+
+    pending.pop_front();
+  }
+
+  if (compressed && size > 0)
+  {
+    decoder.finish();
+  }
+
+  file.close();
+  if (!file)
+  {
+    throw std::runtime_error("The file could not be written");
+  }
+
+  stats.seconds = task_util::seconds_since(start);
+  return stats;
+}
@@ -0,0 +1,34 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+using namespace azure::storage;
+
+#pragma once
+class compressed_transfer
+{
+public:
+  compressed_transfer(size_t block_size, size_t parallelism, int level);
+
+  transfer_stats upload_file(cloud_block_blob block_blob, const utility::string_t& file_name) const;
+  transfer_stats download_to_file(cloud_blob blob, const utility::string_t& file_name) const;
+
+  static const utility::string_t content_encoding;
+
+private:
+  size_t m_block_size;
+  size_t m_parallelism;
+  int m_level;
+};
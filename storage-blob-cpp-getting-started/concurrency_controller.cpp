@@ -0,0 +1,320 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#include "stdafx.h"
+#include "task_util.h"
+#include "concurrency_controller.h"
+
+using namespace azure::storage;
+
+struct concurrency_controller::controller_state
+{
+  controller_state()
+    : min_concurrency(1), max_concurrency(1), min_block_size(0), max_block_size(0), concurrency(1), block_size(0),
+    window(0), smoothed_latency(0), baseline_latency(0), requests(0), throttled(0), increases(0), decreases(0),
+    block_size_increases(0), block_size_decreases(0)
+  {
+  }
+
+  void record(std::chrono::steady_clock::duration latency, web::http::status_code status_code);
+  void reset_latency();
+
+  size_t min_concurrency;
+  size_t max_concurrency;
+  size_t min_block_size;
+  size_t max_block_size;
+
+  // Read without the lock by the transfers, written under it
+  std::atomic<size_t> concurrency;
+  std::atomic<size_t> block_size;
+
+  mutable std::mutex mutex;
+  size_t window;
+  double smoothed_latency;
+  double baseline_latency;
+  std::chrono::steady_clock::time_point next_decrease;
+
+  uint64_t requests;
+  uint64_t throttled;
+  uint64_t increases;
+  uint64_t decreases;
+  uint64_t block_size_increases;
+  uint64_t block_size_decreases;
+};
+
+struct concurrency_controller::run_state
+{
+  run_state() : running(0), exhausted(false), finished(false) {}
+
+  std::function<pplx::task<bool>()> step;
+  std::mutex mutex;
+  size_t running;
+  bool exhausted;
+  bool finished;
+  std::exception_ptr error;
+  pplx::task_completion_event<void> completed;
+};
+
+///
+/// Creates a controller keeping between 'min_concurrency' and 'max_concurrency' requests in flight, with
+/// requests of 'min_block_size' to 'max_block_size' bytes. It starts from the minimum concurrency and probes
+/// upwards. The block size starts from 'initial_block_size', the size the transfers are configured with, or from
+/// the minimum when it is 0. Page uploads need block sizes that are multiples of 512 bytes, which doubling and
+/// halving preserve.
+///
+concurrency_controller::concurrency_controller(size_t min_concurrency, size_t max_concurrency, size_t min_block_size, size_t max_block_size,
+  size_t initial_block_size)
+  : m_state(std::make_shared<controller_state>())
+{
+  m_state->min_concurrency = std::max<size_t>(min_concurrency, 1);
+  m_state->max_concurrency = std::max(max_concurrency, m_state->min_concurrency);
+  m_state->min_block_size = min_block_size;
+  m_state->max_block_size = std::max(max_block_size, min_block_size);
+  m_state->concurrency = m_state->min_concurrency;
+  m_state->block_size = std::min(std::max(initial_block_size, m_state->min_block_size), m_state->max_block_size);
+}
+
+size_t concurrency_controller::concurrency() const
+{
+  return m_state->concurrency;
+}
+
+size_t concurrency_controller::block_size() const
+{
+  return m_state->block_size;
+}
+
+///
+/// Returns an operation context reporting the latency and the status code of each of its requests to the
+/// controller. Retries are requests of their own, so a 503 retried successfully by the storage client still
+/// slows the transfer down.
+///
+operation_context concurrency_controller::create_context() const
+{
+  std::shared_ptr<controller_state> state = m_state;
+  std::shared_ptr<std::chrono::steady_clock::time_point> sent = std::make_shared<std::chrono::steady_clock::time_point>();
+
+  operation_context context;
+  context.set_sending_request([sent](web::http::http_request&, operation_context)
+  {
+    *sent = std::chrono::steady_clock::now();
+  });
+  context.set_response_received([state, sent](web::http::http_request&, const web::http::http_response& response, operation_context)
+  {
+    state->record(std::chrono::steady_clock::now() - *sent, response.status_code());
+  });
+
+  return context;
+}
+
+void concurrency_controller::record(std::chrono::steady_clock::duration latency, web::http::status_code status_code)
+{
+  m_state->record(latency, status_code);
+}
+
+///
+/// Adjusts the limits after a response, with additive increase and multiplicative decrease:
+/// - a throttled response (503 Server Busy, or 500 Operation Timed Out) halves the concurrency, at most once per
+///   round trip, since the responses to the requests already in flight report the same overload;
+/// - every window of as many responses as the concurrency compares the smoothed latency to the lowest latency
+///   seen. Below twice the lowest, one more request is allowed in flight, or once the maximum is reached the
+///   block size doubles. Above it, requests are queuing: the concurrency drops by a quarter and the block size
+///   halves.
+/// The latencies are reset when the block size changes, since they depend on it.
+///
+void concurrency_controller::controller_state::record(std::chrono::steady_clock::duration latency, web::http::status_code status_code)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  requests++;
+
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  double milliseconds = std::chrono::duration<double, std::milli>(latency).count();
+
+  if (status_code == web::http::status_codes::ServiceUnavailable || status_code == web::http::status_codes::InternalError)
+  {
+    throttled++;
+    if (now >= next_decrease)
+    {
+      concurrency = std::max(min_concurrency, concurrency / 2);
+      decreases++;
+      window = 0;
+      next_decrease = now + std::chrono::microseconds(static_cast<int64_t>(std::max(smoothed_latency, milliseconds) * 1000));
+    }
+
+    return;
+  }
+
+  smoothed_latency = smoothed_latency > 0 ? smoothed_latency * 0.9 + milliseconds * 0.1 : milliseconds;
+  baseline_latency = baseline_latency > 0 ? std::min(baseline_latency, milliseconds) : milliseconds;
+
+  if (++window < concurrency)
+  {
+    return;
+  }
+
+  window = 0;
+  if (smoothed_latency < 2 * baseline_latency)
+  {
+    if (concurrency < max_concurrency)
+    {
+      concurrency++;
+      increases++;
+    }
+    else if (block_size < max_block_size)
+    {
+      block_size = std::min(block_size * 2, max_block_size);
+      block_size_increases++;
+      reset_latency();
+    }
+  }
+  else
+  {
+    size_t current = concurrency;
+    concurrency = std::max(min_concurrency, current - std::max<size_t>(current / 4, 1));
+    decreases++;
+    if (block_size > min_block_size)
+    {
+      block_size = std::max(block_size / 2, min_block_size);
+      block_size_decreases++;
+      reset_latency();
+    }
+    else
+    {
+      // The lowest latency slowly follows the current one, so a service that became slower for good
+      // does not keep the concurrency at its minimum
+      baseline_latency += (smoothed_latency - baseline_latency) * 0.1;
+    }
+  }
+}
+
+void concurrency_controller::controller_state::reset_latency()
+{
+  smoothed_latency = 0;
+  baseline_latency = 0;
+}
+
+///
+/// Runs the step with as many calls in flight as the concurrency allows, re-reading the limit every time a call
+/// completes. Like task_util::run_workers, the returned task completes once the step reports that there is no
+/// more work and every call has completed, and fails with the first error.
+///
+pplx::task<void> concurrency_controller::run(std::function<pplx::task<bool>()> step) const
+{
+  std::shared_ptr<run_state> run = std::make_shared<run_state>();
+  run->step = step;
+
+  launch(m_state, run);
+  return pplx::create_task(run->completed);
+}
+
+///
+/// Starts calls until the concurrency is reached, or completes the run once nothing is left in flight
+///
+void concurrency_controller::launch(std::shared_ptr<controller_state> state, std::shared_ptr<run_state> run)
+{
+  for (;;)
+  {
+    {
+      std::lock_guard<std::mutex> lock(run->mutex);
+      if (run->exhausted || run->error || run->running >= state->concurrency)
+      {
+        if (run->running == 0 && !run->finished)
+        {
+          run->finished = true;
+          if (run->error)
+          {
+            run->completed.set_exception(run->error);
+          }
+          else
+          {
+            run->completed.set();
+          }
+        }
+
+        return;
+      }
+
+      run->running++;
+    }
+
+    pplx::task<bool> next;
+    try
+    {
+      next = run->step();
+    }
+    catch (...)
+    {
+      next = pplx::task_from_exception<bool>(std::current_exception());
+    }
+
+    next.then([state, run](pplx::task<bool> completed)
+    {
+      {
+        std::lock_guard<std::mutex> lock(run->mutex);
+        try
+        {
+          run->exhausted = !completed.get() || run->exhausted;
+        }
+        catch (...)
+        {
+          if (!run->error)
+          {
+            run->error = std::current_exception();
+          }
+        }
+
+        run->running--;
+      }
+
+      launch(state, run);
+    });
+  }
+}
+
+///
+/// Returns the context to send a request with: one reporting to the controller when there is one
+///
+operation_context concurrency_controller::context_for(const std::shared_ptr<concurrency_controller>& controller)
+{
+  return controller ? controller->create_context() : operation_context();
+}
+
+///
+/// Runs the step under the controller when there is one, otherwise on a fixed number of workers
+///
+pplx::task<void> concurrency_controller::run_workers(const std::shared_ptr<concurrency_controller>& controller, size_t workers, std::function<pplx::task<bool>()> step)
+{
+  return controller ? controller->run(step) : task_util::run_workers(workers, step);
+}
+
+web::json::value concurrency_controller::to_json() const
+{
+  std::lock_guard<std::mutex> lock(m_state->mutex);
+
+  web::json::value metrics = web::json::value::object();
+  metrics[U("concurrency")] = web::json::value::number(static_cast<uint64_t>(m_state->concurrency.load()));
+  metrics[U("block_size")] = web::json::value::number(static_cast<uint64_t>(m_state->block_size.load()));
+  metrics[U("requests")] = web::json::value::number(m_state->requests);
+  metrics[U("throttled")] = web::json::value::number(m_state->throttled);
+  metrics[U("concurrency_increases")] = web::json::value::number(m_state->increases);
+  metrics[U("concurrency_decreases")] = web::json::value::number(m_state->decreases);
+  metrics[U("block_size_increases")] = web::json::value::number(m_state->block_size_increases);
+  metrics[U("block_size_decreases")] = web::json::value::number(m_state->block_size_decreases);
+  metrics[U("smoothed_latency_ms")] = web::json::value::number(m_state->smoothed_latency);
+  metrics[U("baseline_latency_ms")] = web::json::value::number(m_state->baseline_latency);
+  return metrics;
+}
@@ -0,0 +1,48 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+using namespace azure::storage;
+
+#pragma once
+class concurrency_controller
+{
+public:
+  concurrency_controller(size_t min_concurrency, size_t max_concurrency, size_t min_block_size, size_t max_block_size, size_t initial_block_size = 0);
+
+  size_t concurrency() const;
+  size_t block_size() const;
+
+  operation_context create_context() const;
+  void record(std::chrono::steady_clock::duration latency, web::http::status_code status_code);
+  pplx::task<void> run(std::function<pplx::task<bool>()> step) const;
+
+  web::json::value to_json() const;
+
+  static operation_context context_for(const std::shared_ptr<concurrency_controller>& controller);
+  static pplx::task<void> run_workers(const std::shared_ptr<concurrency_controller>& controller, size_t workers, std::function<pplx::task<bool>()> step);
+
+private:
+  concurrency_controller(const concurrency_controller&);
+  concurrency_controller& operator=(const concurrency_controller&);
+
+  struct controller_state;
+  struct run_state;
+
+  static void launch(std::shared_ptr<controller_state> state, std::shared_ptr<run_state> run);
+
+  std::shared_ptr<controller_state> m_state;
+};
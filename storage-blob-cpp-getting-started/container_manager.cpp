@@ -0,0 +1,186 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "task_util.h"
+#include "container_manager.h"
+
+using namespace azure::storage;
+
+namespace
+{
+  struct delete_state
+  {
+    delete_state() : parallelism(0), page_size(0), requests(0) {}
+
+    cloud_blob_client blob_client;
+    utility::string_t prefix;
+    size_t parallelism;
+    int page_size;
+    std::atomic<size_t> requests;
+  };
+
+  pplx::task<container_result_segment> list_page(std::shared_ptr<delete_state> state, const continuation_token& token)
+  {
+    state->requests++;
+    return state->blob_client.list_containers_segmented_async(state->prefix, container_listing_details::none, state->page_size, token, blob_request_options(), operation_context());
+  }
+
+  ///
+  /// Deletes the containers of a listing page. The request for the following page is sent before the deletes
+  /// start, so the next page is ready by the time the current one has been processed.
+  ///
+  pplx::task<void> delete_pages(std::shared_ptr<delete_state> state, pplx::task<container_result_segment> page)
+  {
+    return page.then([state](container_result_segment segment)
+    {
+      continuation_token token = segment.continuation_token();
+      bool has_next = !token.empty();
+
+      pplx::task<container_result_segment> next_page;
+      if (has_next)
+      {
+        next_page = list_page(state, token);
+      }
+
+      std::shared_ptr<std::vector<cloud_blob_container>> containers = std::make_shared<std::vector<cloud_blob_container>>(segment.results());
+      std::shared_ptr<std::atomic<size_t>> next_index = std::make_shared<std::atomic<size_t>>(0);
+
+      auto step = [state, containers, next_index]() -> pplx::task<bool>
+      {
+        size_t index = (*next_index)++;
+        if (index >= containers->size())
+        {
+          return pplx::task_from_result(false);
+        }
+
+        cloud_blob_container container = (*containers)[index];
+        return container.delete_container_if_exists_async().then([state](bool)
+        {
+          state->requests++;
+          return true;
+        });
+      };
+
+      return task_util::run_workers(state->parallelism, step).then([state, has_next, next_page](pplx::task<void> deleted)
+      {
+        try
+        {
+          deleted.get();
+        }
+        catch (...)
+        {
+          // The next page requested ahead is not needed any more, its outcome is only observed
+          if (has_next)
+          {
+            next_page.then([](pplx::task<container_result_segment> abandoned)
+            {
+              try
+              {
+                abandoned.get();
+              }
+              catch (const std::exception&)
+              {
+              }
+            });
+          }
+
+          throw;
+        }
+
+        return has_next ? delete_pages(state, next_page) : pplx::task_from_result();
+      });
+    });
+  }
+}
+
+container_manager::container_manager(size_t parallelism, int page_size)
+  : m_parallelism(parallelism), m_page_size(page_size)
+{
+}
+
+///
+/// Creates the given containers and waits for all of them to be created.
+///
+transfer_stats container_manager::create_containers(const cloud_blob_client& blob_client, const std::vector<utility::string_t>& container_names) const
+{
+  return create_containers_async(blob_client, container_names).get();
+}
+
+///
+/// Creates the given containers, with up to 'parallelism' create requests in flight at once.
+/// Containers that already exist are left untouched.
+///
+pplx::task<transfer_stats> container_manager::create_containers_async(const cloud_blob_client& blob_client, const std::vector<utility::string_t>& container_names) const
+{
+  std::shared_ptr<std::vector<utility::string_t>> names = std::make_shared<std::vector<utility::string_t>>(container_names);
+  std::shared_ptr<std::atomic<size_t>> next_index = std::make_shared<std::atomic<size_t>>(0);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  auto step = [blob_client, names, next_index]() -> pplx::task<bool>
+  {
+    size_t index = (*next_index)++;
+    if (index >= names->size())
+    {
+      return pplx::task_from_result(false);
+    }
+
+    cloud_blob_container container = blob_client.get_container_reference((*names)[index]);
+    return container.create_if_not_exists_async().then([](bool)
+    {
+      return true;
+    });
+  };
+
+  return task_util::run_workers(m_parallelism, step).then([names, start]()
+  {
+    transfer_stats stats;
+    stats.requests = names->size();
+    stats.seconds = task_util::seconds_since(start);
+    return stats;
+  });
+}
+
+///
+/// Deletes every container whose name starts with the prefix and waits for all of them to be deleted.
+///
+transfer_stats container_manager::delete_containers(const cloud_blob_client& blob_client, const utility::string_t& prefix) const
+{
+  return delete_containers_async(blob_client, prefix).get();
+}
+
+///
+/// Deletes every container whose name starts with the prefix. The containers are listed one page at a time,
+/// the next page being fetched while the current one is deleted with up to 'parallelism' requests in flight.
+///
+pplx::task<transfer_stats> container_manager::delete_containers_async(const cloud_blob_client& blob_client, const utility::string_t& prefix) const
+{
+  std::shared_ptr<delete_state> state = std::make_shared<delete_state>();
+  state->blob_client = blob_client;
+  state->prefix = prefix;
+  state->parallelism = m_parallelism;
+  state->page_size = m_page_size;
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  return delete_pages(state, list_page(state, continuation_token())).then([state, start]()
+  {
+    transfer_stats stats;
+    stats.requests = state->requests;
+    stats.seconds = task_util::seconds_since(start);
+    return stats;
+  });
+}
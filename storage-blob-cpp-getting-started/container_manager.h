@@ -0,0 +1,34 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+using namespace azure::storage;
+
+#pragma once
+class container_manager
+{
+public:
+  container_manager(size_t parallelism, int page_size);
+
+  transfer_stats create_containers(const cloud_blob_client& blob_client, const std::vector<utility::string_t>& container_names) const;
+  pplx::task<transfer_stats> create_containers_async(const cloud_blob_client& blob_client, const std::vector<utility::string_t>& container_names) const;
+
+  transfer_stats delete_containers(const cloud_blob_client& blob_client, const utility::string_t& prefix) const;
+  pplx::task<transfer_stats> delete_containers_async(const cloud_blob_client& blob_client, const utility::string_t& prefix) const;
+
+private:
+  size_t m_parallelism;
+  int m_page_size;
+};
@@ -0,0 +1,337 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#include "stdafx.h"
+#include "task_util.h"
+#include "request_tracer.h"
+#include "blob_lister.h"
+#include "copy_orchestrator.h"
+
+using namespace azure::storage;
+
+struct copy_orchestrator::copy_entry
+{
+  utility::string_t name;
+  copy_status status;
+  utility::size64_t bytes_copied;
+  utility::size64_t total_bytes;
+  std::chrono::steady_clock::time_point next_poll;
+  std::chrono::milliseconds poll_interval;
+};
+
+struct copy_orchestrator::copy_table
+{
+  copy_table() : requests(0) {}
+
+  std::vector<copy_entry> entries;
+  std::map<utility::string_t, size_t> indexes;
+  std::vector<size_t> pending;
+  copy_progress progress;
+  std::atomic<size_t> requests;
+};
+
+copy_progress::copy_progress()
+  : started(0), succeeded(0), failed(0), pending(0), bytes_copied(0), total_bytes(0)
+{
+}
+
+///
+/// Creates an orchestrator that sends up to 'parallelism' requests at once. The state of a pending copy is first
+/// checked after 'initial_poll_interval', and the interval doubles after every check up to 'max_poll_interval'.
+///
+copy_orchestrator::copy_orchestrator(size_t parallelism, std::chrono::milliseconds initial_poll_interval, std::chrono::milliseconds max_poll_interval)
+  : m_parallelism(parallelism), m_initial_poll_interval(initial_poll_interval), m_max_poll_interval(max_poll_interval)
+{
+}
+
+///
+/// Records the copies started and the checks of their state on a tracer
+///
+void copy_orchestrator::set_tracer(std::shared_ptr<request_tracer> tracer)
+{
+  m_tracer = tracer;
+}
+
+///
+/// Copies every blob of the source container under the prefix to the target container with server-side copies,
+/// and waits for all of them to complete. The copies are started one listing page at a time, and the copies
+/// still pending are checked between pages, so a large container is never listed in full before its first
+/// copies complete. 'progress' is called after every page and every check. The source blobs must be readable
+/// by the target account, which is the case within the same storage account.
+///
+transfer_stats copy_orchestrator::copy_container(cloud_blob_container source, cloud_blob_container target, const utility::string_t& prefix, progress_handler progress) const
+{
+  copy_table table;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  blob_lister lister(source, prefix, true, utility::string_t(), task_util::max_listing_results, 1);
+  blob_listing page;
+  while (lister.next_page(page))
+  {
+    start_copies(table, source, target, page);
+    poll_copies(table, target, prefix);
+    if (progress)
+    {
+      progress(table.progress);
+    }
+  }
+
+  while (!table.pending.empty())
+  {
+    std::chrono::steady_clock::time_point next_poll = std::chrono::steady_clock::time_point::max();
+    for (size_t index : table.pending)
+    {
+      next_poll = std::min(next_poll, table.entries[index].next_poll);
+    }
+
+    std::this_thread::sleep_until(next_poll);
+    poll_copies(table, target, prefix);
+    if (progress)
+    {
+      progress(table.progress);
+    }
+  }
+
+  transfer_stats stats;
+  stats.bytes = table.progress.bytes_copied;
+  stats.requests = table.requests;
+  stats.seconds = task_util::seconds_since(start);
+  return stats;
+}
+
+///
+/// Starts the copy of every blob of a listing page, with up to 'parallelism' requests in flight. Copies
+/// completed by the time the service answers, like most copies within an account, are never checked again.
+///
+void copy_orchestrator::start_copies(copy_table& table, cloud_blob_container source, cloud_blob_container target, const blob_listing& page) const
+{
+  std::vector<copy_entry> started(page.size());
+  std::atomic<size_t> next(0);
+  std::chrono::milliseconds poll_interval = m_initial_poll_interval;
+  std::shared_ptr<request_tracer> tracer = m_tracer;
+  blob_request_options options;
+
+  task_util::run_workers(m_parallelism, [&]() -> pplx::task<bool>
+  {
+    size_t index = next++;
+    if (index >= page.size())
+    {
+      return pplx::task_from_result(false);
+    }
+
+    copy_entry& entry = started[index];
+    entry.name = page.name(index);
+    entry.status = copy_status::invalid;
+    entry.bytes_copied = 0;
+    entry.total_bytes = page[index].size;
+    entry.poll_interval = poll_interval;
+
+    web::uri source_uri = source.get_blob_reference(entry.name).uri().primary_uri();
+    cloud_blob blob = target.get_blob_reference(entry.name);
+    return blob.start_copy_async(source_uri, access_condition(), access_condition(), options, request_tracer::context_for(tracer, U("start_copy"))).then([&table, &entry, blob, poll_interval](pplx::task<utility::string_t> copy)
+    {
+      table.requests++;
+      try
+      {
+        copy.get();
+
+        copy_state state = blob.copy_state();
+        entry.status = state.status();
+        entry.bytes_copied = entry.status == copy_status::success ? entry.total_bytes : state.bytes_copied();
+        entry.next_poll = std::chrono::steady_clock::now() + poll_interval;
+      }
+      catch (const azure::storage::storage_exception&)
+      {
+        // A copy that could not be started, for example because its source was deleted, is counted as failed
+        entry.status = copy_status::failed;
+      }
+
+      return true;
+    });
+  }).wait();
+
+  for (copy_entry& entry : started)
+  {
+    size_t index = table.entries.size();
+    table.indexes[entry.name] = index;
+    table.progress.started++;
+    table.progress.total_bytes += entry.total_bytes;
+    table.progress.bytes_copied += entry.bytes_copied;
+
+    if (entry.status == copy_status::pending)
+    {
+      table.pending.push_back(index);
+      table.progress.pending++;
+    }
+    else if (entry.status == copy_status::success)
+    {
+      table.progress.succeeded++;
+    }
+    else
+    {
+      table.progress.failed++;
+    }
+
+    table.entries.push_back(entry);
+  }
+}
+
+///
+/// Checks the copies whose next poll is due, and backs off the ones still pending. The state of a few copies is
+/// read with one Get Blob Properties request each. When more copies are due than there are pages in a listing
+/// of the target blobs, a single listing with the copy details reads them all, 5000 blobs per request. Only a
+/// target found missing fails its copy: a copy whose state could not be read is backed off and checked again.
+///
+void copy_orchestrator::poll_copies(copy_table& table, cloud_blob_container target, const utility::string_t& prefix) const
+{
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  std::vector<size_t> due;
+  for (size_t index : table.pending)
+  {
+    if (table.entries[index].next_poll <= now)
+    {
+      due.push_back(index);
+    }
+  }
+
+  if (due.empty())
+  {
+    return;
+  }
+
+  size_t listing_requests = (table.entries.size() + task_util::max_listing_results - 1) / task_util::max_listing_results;
+  std::vector<copy_state> states(table.entries.size());
+  // One byte per copy, the workers setting the flags of different copies at once
+  std::vector<char> updated(table.entries.size(), false);
+  blob_request_options options;
+
+  if (listing_requests < due.size())
+  {
+    bool listed = false;
+    try
+    {
+      continuation_token token;
+      do
+      {
+        list_blob_item_segment segment = target.list_blobs_segmented(prefix, true, blob_listing_details::copy, task_util::max_listing_results, token, options,
+          request_tracer::context_for(m_tracer, U("list_blobs")));
+        table.requests++;
+        for (const list_blob_item& item : segment.results())
+        {
+          auto found = item.is_blob() ? table.indexes.find(item.as_blob().name()) : table.indexes.end();
+          if (found != table.indexes.end())
+          {
+            states[found->second] = item.as_blob().copy_state();
+            updated[found->second] = true;
+          }
+        }
+
+        token = segment.continuation_token();
+      } while (!token.empty());
+
+      listed = true;
+    }
+    catch (const std::exception&)
+    {
+      // The copies not listed yet keep their state, and are listed again after backing off
+    }
+
+    // A due copy missing from a complete listing had its target deleted, it is counted as failed
+    if (listed)
+    {
+      for (size_t index : due)
+      {
+        updated[index] = true;
+      }
+    }
+  }
+  else
+  {
+    std::atomic<size_t> next(0);
+    task_util::run_workers(m_parallelism, [&]() -> pplx::task<bool>
+    {
+      size_t position = next++;
+      if (position >= due.size())
+      {
+        return pplx::task_from_result(false);
+      }
+
+      size_t index = due[position];
+      cloud_blob blob = target.get_blob_reference(table.entries[index].name);
+      return blob.download_attributes_async(access_condition(), options, request_tracer::context_for(m_tracer, U("download_attributes")))
+        .then([&table, &states, &updated, blob, index](pplx::task<void> attributes)
+      {
+        table.requests++;
+        try
+        {
+          attributes.get();
+          states[index] = blob.copy_state();
+          updated[index] = true;
+        }
+        catch (const azure::storage::storage_exception& e)
+        {
+          // The state of a deleted target is left invalid, and the copy counted as failed. Other errors, such as
+          // throttling or a timeout, leave the copy pending.
+          updated[index] = e.result().http_status_code() == web::http::status_codes::NotFound;
+        }
+        catch (const std::exception&)
+        {
+        }
+
+        return true;
+      });
+    }).wait();
+  }
+
+  std::vector<size_t> pending;
+  for (size_t index : table.pending)
+  {
+    copy_entry& entry = table.entries[index];
+    if (updated[index])
+    {
+      const copy_state& state = states[index];
+      utility::size64_t bytes_copied = state.status() == copy_status::success ? entry.total_bytes : state.bytes_copied();
+      table.progress.bytes_copied += bytes_copied - entry.bytes_copied;
+      entry.bytes_copied = bytes_copied;
+      entry.status = state.status();
+    }
+
+    if (entry.status == copy_status::pending)
+    {
+      if (entry.next_poll <= now)
+      {
+        entry.poll_interval = std::min(entry.poll_interval * 2, m_max_poll_interval);
+        entry.next_poll = now + entry.poll_interval;
+      }
+
+      pending.push_back(index);
+      continue;
+    }
+
+    table.progress.pending--;
+    if (entry.status == copy_status::success)
+    {
+      table.progress.succeeded++;
+    }
+    else
+    {
+      table.progress.failed++;
+    }
+  }
+
+  table.pending.swap(pending);
+}
@@ -0,0 +1,56 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+using namespace azure::storage;
+
+#pragma once
+
+struct copy_progress
+{
+  copy_progress();
+
+  size_t started;
+  size_t succeeded;
+  size_t failed;
+  size_t pending;
+  utility::size64_t bytes_copied;
+  utility::size64_t total_bytes;
+};
+
+class copy_orchestrator
+{
+public:
+  typedef std::function<void(const copy_progress&)> progress_handler;
+
+  copy_orchestrator(size_t parallelism, std::chrono::milliseconds initial_poll_interval, std::chrono::milliseconds max_poll_interval);
+
+  transfer_stats copy_container(cloud_blob_container source, cloud_blob_container target, const utility::string_t& prefix, progress_handler progress) const;
+
+  void set_tracer(std::shared_ptr<request_tracer> tracer);
+
+private:
+  struct copy_entry;
+  struct copy_table;
+
+  void start_copies(copy_table& table, cloud_blob_container source, cloud_blob_container target, const blob_listing& page) const;
+  void poll_copies(copy_table& table, cloud_blob_container target, const utility::string_t& prefix) const;
+
+  size_t m_parallelism;
+  std::chrono::milliseconds m_initial_poll_interval;
+  std::chrono::milliseconds m_max_poll_interval;
+  std::shared_ptr<request_tracer> m_tracer;
+};
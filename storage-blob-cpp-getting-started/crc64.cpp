@@ -0,0 +1,110 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#include "stdafx.h"
+#include "crc64.h"
+
+namespace
+{
+  ///
+  /// Tables of the slicing-by-8 algorithm: table[k][b] is the CRC of byte b followed by k zero bytes,
+  /// so 8 bytes are folded in with 8 independent lookups instead of 64 dependent shifts.
+  ///
+  typedef std::array<std::array<uint64_t, 256>, 8> crc_tables;
+
+  const crc_tables& tables()
+  {
+    static const crc_tables values = []()
+    {
+      crc_tables result;
+      for (size_t b = 0; b < 256; b++)
+      {
+        uint64_t crc = b;
+        for (int bit = 0; bit < 8; bit++)
+        {
+          crc = (crc >> 1) ^ ((crc & 1) ? crc64::polynomial : 0);
+        }
+
+        result[0][b] = crc;
+      }
+
+      for (size_t k = 1; k < 8; k++)
+      {
+        for (size_t b = 0; b < 256; b++)
+        {
+          uint64_t previous = result[k - 1][b];
+          result[k][b] = (previous >> 8) ^ result[0][previous & 0xFF];
+        }
+      }
+
+      return result;
+    }();
+
+    return values;
+  }
+}
+
+const uint64_t crc64::polynomial;
+
+///
+/// Computes the CRC64 used by the storage service for transactional integrity (x-ms-content-crc64),
+/// with the reflected polynomial 0x9A6C9329AC4BC9B5. Pass the result of a previous call as 'crc'
+/// to continue the computation with more data.
+///
+uint64_t crc64::compute(const uint8_t* data, size_t length, uint64_t crc)
+{
+  const crc_tables& table = tables();
+  crc = ~crc;
+
+  for (; length >= 8; data += 8, length -= 8)
+  {
+    uint64_t word = 0;
+    for (size_t i = 0; i < 8; i++)
+    {
+      word |= static_cast<uint64_t>(data[i]) << (8 * i);
+    }
+
+    word ^= crc;
+    crc = table[7][word & 0xFF] ^ table[6][(word >> 8) & 0xFF] ^ table[5][(word >> 16) & 0xFF] ^ table[4][(word >> 24) & 0xFF] ^
+      table[3][(word >> 32) & 0xFF] ^ table[2][(word >> 40) & 0xFF] ^ table[1][(word >> 48) & 0xFF] ^ table[0][word >> 56];
+  }
+
+  for (; length > 0; data++, length--)
+  {
+    crc = (crc >> 8) ^ table[0][(crc ^ *data) & 0xFF];
+  }
+
+  return ~crc;
+}
+
+///
+/// Computes the same CRC one bit at a time. Slow, kept as the reference for the table driven version.
+///
+uint64_t crc64::compute_bitwise(const uint8_t* data, size_t length, uint64_t crc)
+{
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++)
+  {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++)
+    {
+      crc = (crc >> 1) ^ ((crc & 1) ? polynomial : 0);
+    }
+  }
+
+  return ~crc;
+}
@@ -0,0 +1,324 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#include "stdafx.h"
+#include "task_util.h"
+#include "mapped_file.h"
+#include "md5.h"
+#include "integrity_pipeline.h"
+#include "request_tracer.h"
+#include "delta_block_uploader.h"
+
+using namespace azure::storage;
+
+namespace
+{
+  // Largest block of a block blob
+  const size_t max_block_size = 4 * 1024 * 1024;
+
+  ///
+  /// Random values added to the rolling hash for every byte. They are generated from a fixed seed so the
+  /// same content is always split at the same positions, on every platform.
+  ///
+  const std::array<uint64_t, 256>& gear_table()
+  {
+    static const std::array<uint64_t, 256> table = []()
+    {
+      std::array<uint64_t, 256> values;
+      uint64_t seed = 0x9e3779b97f4a7c15ULL;
+      for (uint64_t& value : values)
+      {
+        // splitmix64
+        seed += 0x9e3779b97f4a7c15ULL;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        value = z ^ (z >> 31);
+      }
+
+      return values;
+    }();
+
+    return table;
+  }
+
+  struct chunk
+  {
+    utility::size64_t offset;
+    size_t length;
+    utility::string_t id;
+    utility::string_t md5;
+  };
+
+  struct upload_state
+  {
+    upload_state() : next_chunk(0), bytes(0), skipped_bytes(0), requests(0) {}
+
+    std::shared_ptr<mapped_file> file;
+    std::vector<chunk> chunks;
+    std::vector<size_t> missing;
+    std::atomic<size_t> next_chunk;
+    std::atomic<utility::size64_t> bytes;
+    std::atomic<utility::size64_t> skipped_bytes;
+    std::atomic<size_t> requests;
+  };
+}
+
+///
+/// Creates an uploader splitting files in chunks of about average_chunk_size bytes (rounded down to a power of two),
+/// never shorter than a quarter of it nor longer than four times it, and uploading up to 'parallelism' chunks at a time.
+///
+delta_block_uploader::delta_block_uploader(size_t average_chunk_size, size_t parallelism)
+  : m_parallelism(parallelism)
+{
+  size_t average = 64;
+  while (average * 2 <= average_chunk_size)
+  {
+    average *= 2;
+  }
+
+  m_average_chunk_size = average;
+  m_min_chunk_size = average / 4;
+  m_max_chunk_size = average * 4;
+  if (m_max_chunk_size > max_block_size)
+  {
+    throw std::invalid_argument("The average chunk size must be at most 1 MiB");
+  }
+}
+
+///
+/// Computes the ids of the chunks on a pipeline shared with other transfers. Without one, every upload starts
+/// its own threads.
+///
+void delta_block_uploader::set_pipeline(std::shared_ptr<integrity_pipeline> pipeline)
+{
+  m_pipeline = pipeline;
+}
+
+///
+/// Records the requests of the uploads on a tracer, the block lists read as well as the chunks sent
+///
+void delta_block_uploader::set_tracer(std::shared_ptr<request_tracer> tracer)
+{
+  m_tracer = tracer;
+}
+
+///
+/// Splits data in content-defined chunks and returns the offset and length of each one. A gear rolling hash runs
+/// over the data and a chunk ends where the top bits of the hash are all zero, so the boundaries depend on the
+/// content around them: inserting or removing bytes only changes the chunks around the change.
+/// A stricter condition before the average size and a looser one after it keep most chunks close to the average.
+///
+std::vector<std::pair<utility::size64_t, size_t>> delta_block_uploader::split(const uint8_t* data, utility::size64_t size) const
+{
+  const std::array<uint64_t, 256>& gear = gear_table();
+
+  size_t bits = 0;
+  while ((static_cast<size_t>(1) << bits) < m_average_chunk_size)
+  {
+    bits++;
+  }
+
+  const uint64_t strict_mask = ~0ULL << (64 - (bits + 1));
+  const uint64_t loose_mask = ~0ULL << (64 - (bits - 1));
+
+  std::vector<std::pair<utility::size64_t, size_t>> chunks;
+  utility::size64_t start = 0;
+  while (start < size)
+  {
+    size_t remaining = static_cast<size_t>(std::min<utility::size64_t>(size - start, m_max_chunk_size));
+    size_t length = remaining;
+    if (remaining > m_min_chunk_size)
+    {
+      const uint8_t* chunk_data = data + start;
+      uint64_t hash = 0;
+      size_t position = m_min_chunk_size;
+      size_t normal = std::min(m_average_chunk_size, remaining);
+      for (; position < normal; position++)
+      {
+        hash = (hash << 1) + gear[chunk_data[position]];
+        if ((hash & strict_mask) == 0)
+        {
+          break;
+        }
+      }
+
+      if (position == normal)
+      {
+        for (; position < remaining; position++)
+        {
+          hash = (hash << 1) + gear[chunk_data[position]];
+          if ((hash & loose_mask) == 0)
+          {
+            break;
+          }
+        }
+      }
+
+      length = position < remaining ? position + 1 : remaining;
+    }
+
+    chunks.push_back(std::make_pair(start, length));
+    start += length;
+  }
+
+  return chunks;
+}
+
+///
+/// Uploads a new version of a file to a block blob and waits for the upload to complete.
+///
+transfer_stats delta_block_uploader::upload_file(cloud_block_blob block_blob, const utility::string_t& file_name) const
+{
+  return upload_file_async(block_blob, file_name).get();
+}
+
+///
+/// Uploads a file to a block blob, only sending the chunks the blob does not already have. The file is split in
+/// content-defined chunks, and the id of each block is the MD5 of its content, computed on an integrity
+/// pipeline. The block list of the blob (committed and uncommitted blocks) tells which chunks are already
+/// stored: those are reused by the new block list and only the others are uploaded, each distinct chunk once.
+/// Uploading a file that changed a little since the previous version only sends the chunks around the changes.
+///
+pplx::task<transfer_stats> delta_block_uploader::upload_file_async(cloud_block_blob block_blob, const utility::string_t& file_name) const
+{
+  std::shared_ptr<upload_state> state = std::make_shared<upload_state>();
+  state->file = mapped_file::open(file_name);
+
+  std::shared_ptr<integrity_pipeline> pipeline = m_pipeline ? m_pipeline : integrity_pipeline::create_default();
+
+  // The chunks are counted before any of them is queued, so a rejected file is not being hashed once it is unmapped
+  std::vector<std::pair<utility::size64_t, size_t>> boundaries = split(state->file->data(), state->file->size());
+  if (boundaries.size() > task_util::max_block_count)
+  {
+    throw std::runtime_error("The file has too many chunks, use a larger chunk size");
+  }
+
+  std::vector<pplx::task<block_digest>> digests;
+  for (const auto& boundary : boundaries)
+  {
+    chunk current;
+    current.offset = boundary.first;
+    current.length = boundary.second;
+    state->chunks.push_back(current);
+
+    digests.push_back(pipeline->hash_async(state->file->data() + current.offset, current.length));
+  }
+
+  size_t parallelism = m_parallelism;
+  std::shared_ptr<request_tracer> tracer = m_tracer;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  // Waiting for every chunk keeps the file mapped until the pipeline is done with it
+  return pplx::when_all(digests.begin(), digests.end()).then([block_blob, state, tracer](std::vector<block_digest> chunk_digests)
+  {
+    for (size_t i = 0; i < chunk_digests.size(); i++)
+    {
+      state->chunks[i].id = chunk_digests[i].content_md5();
+      state->chunks[i].md5 = state->chunks[i].id;
+    }
+
+    return block_blob.download_block_list_async(block_listing_filter::all, access_condition(), blob_request_options(), request_tracer::context_for(tracer, U("download_block_list")));
+  }).then([](pplx::task<std::vector<block_list_item>> listing)
+  {
+    try
+    {
+      return listing.get();
+    }
+    catch (const azure::storage::storage_exception& e)
+    {
+      // The blob does not exist yet, every chunk is new
+      if (e.result().http_status_code() == web::http::status_codes::NotFound)
+      {
+        return std::vector<block_list_item>();
+      }
+
+      throw;
+    }
+  }).then([block_blob, state, parallelism, tracer](std::vector<block_list_item> existing_blocks)
+  {
+    state->requests++;
+
+    std::map<utility::string_t, utility::size64_t> stored;
+    for (const block_list_item& block : existing_blocks)
+    {
+      stored[block.id()] = block.size();
+    }
+
+    // Chunks already stored are reused, and a chunk repeated in the file is only uploaded once
+    std::set<utility::string_t> scheduled;
+    for (size_t i = 0; i < state->chunks.size(); i++)
+    {
+      const chunk& current = state->chunks[i];
+      auto block = stored.find(current.id);
+      if ((block != stored.end() && block->second == current.length) || !scheduled.insert(current.id).second)
+      {
+        state->skipped_bytes += current.length;
+        continue;
+      }
+
+      state->missing.push_back(i);
+    }
+
+    auto step = [block_blob, state, tracer]() -> pplx::task<bool>
+    {
+      size_t next = state->next_chunk++;
+      if (next >= state->missing.size())
+      {
+        return pplx::task_from_result(false);
+      }
+
+      const chunk& current = state->chunks[state->missing[next]];
+      concurrency::streams::istream chunk_stream = state->file->view(current.offset, current.length);
+      utility::size64_t offset = current.offset;
+      size_t length = current.length;
+
+      return block_blob.upload_block_async(current.id, chunk_stream, current.md5, access_condition(), blob_request_options(),
+        request_tracer::context_for(tracer, U("upload_block"))).then([state, chunk_stream, offset, length](pplx::task<void> upload)
+      {
+        chunk_stream.close();
+        upload.get();
+
+        state->file->release(offset, length);
+        state->bytes += length;
+        state->requests++;
+        return true;
+      });
+    };
+
+    return task_util::run_workers(parallelism, step);
+  }).then([block_blob, state, tracer]() mutable
+  {
+    // The latest version of a block is the one just uploaded, or the committed one when it was reused
+    std::vector<block_list_item> blocks;
+    blocks.reserve(state->chunks.size());
+    for (const chunk& current : state->chunks)
+    {
+      blocks.push_back(block_list_item(current.id));
+    }
+
+    return block_blob.upload_block_list_async(blocks, access_condition(), blob_request_options(), request_tracer::context_for(tracer, U("upload_block_list")));
+  }).then([state, start]()
+  {
+    transfer_stats stats;
+    stats.bytes = state->bytes;
+    stats.skipped_bytes = state->skipped_bytes;
+    stats.requests = state->requests + 1;
+    stats.seconds = task_util::seconds_since(start);
+    return stats;
+  });
+}
@@ -0,0 +1,41 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+using namespace azure::storage;
+
+#pragma once
+class delta_block_uploader
+{
+public:
+  delta_block_uploader(size_t average_chunk_size, size_t parallelism);
+
+  transfer_stats upload_file(cloud_block_blob block_blob, const utility::string_t& file_name) const;
+  pplx::task<transfer_stats> upload_file_async(cloud_block_blob block_blob, const utility::string_t& file_name) const;
+
+  void set_pipeline(std::shared_ptr<integrity_pipeline> pipeline);
+  void set_tracer(std::shared_ptr<request_tracer> tracer);
+
+  std::vector<std::pair<utility::size64_t, size_t>> split(const uint8_t* data, utility::size64_t size) const;
+
+private:
+  size_t m_min_chunk_size;
+  size_t m_average_chunk_size;
+  size_t m_max_chunk_size;
+  size_t m_parallelism;
+  std::shared_ptr<integrity_pipeline> m_pipeline;
+  std::shared_ptr<request_tracer> m_tracer;
+};
@@ -0,0 +1,368 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#include "stdafx.h"
+#include "task_util.h"
+#include "concurrency_controller.h"
+#include "request_tracer.h"
+#include "mapped_file.h"
+#include "md5.h"
+#include "integrity_pipeline.h"
+#include "local_directory.h"
+#include "parallel_range_downloader.h"
+#include "file_batch_uploader.h"
+#include "directory_sync.h"
+
+using namespace azure::storage;
+
+const utility::string_t directory_sync::modified_metadata(U("mtime"));
+
+namespace
+{
+  struct remote_file
+  {
+    utility::size64_t size;
+    int64_t modified;
+    utility::string_t content_md5;
+  };
+
+  typedef std::unordered_map<utility::string_t, remote_file> remote_index;
+  typedef std::unordered_map<utility::string_t, local_file> local_index;
+
+  struct sync_state
+  {
+    sync_state() : next(0), bytes(0), skipped_bytes(0), requests(0) {}
+
+    std::atomic<size_t> next;
+    std::atomic<utility::size64_t> bytes;
+    std::atomic<utility::size64_t> skipped_bytes;
+    std::atomic<size_t> requests;
+
+    std::mutex mutex;
+    // The files to upload, found while comparing the tree with the container
+    std::vector<batch_file> changed_files;
+    // The name and the modification time of the files downloaded after the small ones
+    std::vector<std::pair<utility::string_t, int64_t>> large_files;
+  };
+
+  ///
+  /// Lists the blobs under the prefix with their metadata, indexed by their name relative to the prefix.
+  ///
+  remote_index index_remote(cloud_blob_container container, const utility::string_t& prefix, std::shared_ptr<request_tracer> tracer, std::atomic<size_t>& requests)
+  {
+    remote_index index;
+    continuation_token token;
+    do
+    {
+      list_blob_item_segment segment = container.list_blobs_segmented(prefix, true, blob_listing_details::metadata, task_util::max_listing_results, token,
+        blob_request_options(), request_tracer::context_for(tracer, U("list_blobs")));
+      requests++;
+
+      for (const list_blob_item& item : segment.results())
+      {
+        if (!item.is_blob())
+        {
+          continue;
+        }
+
+        cloud_blob blob = item.as_blob();
+        remote_file file;
+        file.size = blob.properties().size();
+        file.content_md5 = blob.properties().content_md5();
+
+        // Blobs not uploaded by a synchronizer have no recorded time
+        file.modified = -1;
+        auto modified = blob.metadata().find(directory_sync::modified_metadata);
+        if (modified != blob.metadata().end())
+        {
+          utility::istringstream_t(modified->second) >> file.modified;
+        }
+
+        index[blob.name().substr(prefix.size())] = file;
+      }
+
+      token = segment.continuation_token();
+    } while (!token.empty());
+
+    return index;
+  }
+
+  ///
+  /// Returns whether a blob name relative to the prefix names a file inside the directory it is downloaded to.
+  /// Names which are absolute, hold a backslash or a colon, as in a drive, or have an empty, '.' or '..' segment
+  /// could write elsewhere, or fail, and are rejected.
+  ///
+  bool is_safe_name(const utility::string_t& name)
+  {
+    if (name.empty() || name.find(U('\\')) != utility::string_t::npos || name.find(U(':')) != utility::string_t::npos)
+    {
+      return false;
+    }
+
+    size_t start = 0;
+    while (true)
+    {
+      size_t end = name.find(U('/'), start);
+      utility::string_t segment = name.substr(start, end == utility::string_t::npos ? utility::string_t::npos : end - start);
+      if (segment.empty() || segment == U(".") || segment == U(".."))
+      {
+        return false;
+      }
+
+      if (end == utility::string_t::npos)
+      {
+        return true;
+      }
+
+      start = end + 1;
+    }
+  }
+
+  utility::string_t file_md5(const utility::string_t& path)
+  {
+    std::shared_ptr<mapped_file> file = mapped_file::open(path);
+    return md5_hash::to_base64(md5_hash::compute(file->data(), static_cast<size_t>(file->size())));
+  }
+
+  ///
+  /// Returns whether the content of a local file differs from its blob. Files of the same size and modification
+  /// time are assumed unchanged without being read. When only the time differs, the content MD5 decides.
+  ///
+  bool has_changed(const local_file& local, const remote_file& remote, const utility::string_t& path)
+  {
+    if (local.size != remote.size)
+    {
+      return true;
+    }
+
+    if (local.modified == remote.modified)
+    {
+      return false;
+    }
+
+    return remote.content_md5.empty() || file_md5(path) != remote.content_md5;
+  }
+}
+
+///
+/// Creates a synchronizer sending up to 'parallelism' requests at once. Files up to 'block_size' bytes are
+/// transferred with a single request, several files at a time, larger ones in blocks or ranges of that size.
+/// Large files are uploaded together with the small ones, and downloaded one at a time.
+///
+directory_sync::directory_sync(size_t block_size, size_t parallelism)
+  : m_block_size(block_size), m_parallelism(parallelism)
+{
+}
+
+///
+/// Hashes the blocks of the files uploaded in blocks on a pipeline shared with other transfers
+///
+void directory_sync::set_pipeline(std::shared_ptr<integrity_pipeline> pipeline)
+{
+  m_pipeline = pipeline;
+}
+
+///
+/// Records the listings, the metadata updates and the transfers of the synchronizations on a tracer
+///
+void directory_sync::set_tracer(std::shared_ptr<request_tracer> tracer)
+{
+  m_tracer = tracer;
+}
+
+///
+/// Uploads the files of a local directory tree that are missing or different in the container, under the prefix.
+/// The tree is walked while the container is listed, and each side is indexed by name in a hash table. The files
+/// found different are then sent together by a batch uploader, so large files do not hold up the small ones.
+/// Every uploaded blob records the modification time of its file in its metadata and its content MD5, so a
+/// later upload of an unchanged tree costs the listing alone. Blobs without a local file are left in place.
+///
+transfer_stats directory_sync::upload(const utility::string_t& directory, cloud_blob_container container, const utility::string_t& prefix) const
+{
+  std::shared_ptr<sync_state> state = std::make_shared<sync_state>();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::shared_ptr<request_tracer> tracer = m_tracer;
+  pplx::task<remote_index> listing = pplx::create_task([container, prefix, state, tracer]()
+  {
+    return index_remote(container, prefix, tracer, state->requests);
+  });
+
+  std::vector<local_file> files = local_directory::list_files(directory, m_parallelism);
+  remote_index remote = listing.get();
+
+  task_util::run_workers(m_parallelism, [&]() -> pplx::task<bool>
+  {
+    size_t index = state->next++;
+    if (index >= files.size())
+    {
+      return pplx::task_from_result(false);
+    }
+
+    const local_file& file = files[index];
+    utility::string_t path = directory + U("/") + file.name;
+    cloud_block_blob blob = container.get_block_blob_reference(prefix + file.name);
+
+    auto found = remote.find(file.name);
+    if (found != remote.end() && !has_changed(file, found->second, path))
+    {
+      state->skipped_bytes += file.size;
+      if (found->second.modified == file.modified)
+      {
+        return pplx::task_from_result(true);
+      }
+
+      // Same content with another time, only the recorded time is updated
+      blob.metadata()[modified_metadata] = utility::conversions::print_string(file.modified);
+      return blob.upload_metadata_async(access_condition(), blob_request_options(), request_tracer::context_for(tracer, U("upload_metadata"))).then([state]()
+      {
+        state->requests++;
+        return true;
+      });
+    }
+
+    // The metadata and the content MD5 are sent with the blob, or with the block list of a large file
+    batch_file changed(path, prefix + file.name, file.size);
+    changed.metadata[modified_metadata] = utility::conversions::print_string(file.modified);
+    changed.content_md5 = file_md5(path);
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->changed_files.push_back(changed);
+    return pplx::task_from_result(true);
+  }).wait();
+
+  file_batch_uploader uploader(m_block_size, m_block_size, m_parallelism);
+  uploader.set_pipeline(m_pipeline);
+  uploader.set_tracer(m_tracer);
+  transfer_stats uploaded = uploader.upload(state->changed_files, container);
+
+  transfer_stats stats;
+  stats.bytes = uploaded.bytes;
+  stats.skipped_bytes = state->skipped_bytes;
+  stats.requests = state->requests + uploaded.requests;
+  stats.seconds = task_util::seconds_since(start);
+  return stats;
+}
+
+///
+/// Downloads the blobs under the prefix that are missing or different in a local directory tree, creating the
+/// directories as needed. The downloaded files get the modification time recorded in the metadata of their blob,
+/// so a later download of an unchanged container costs the listing alone. Local files without a blob are left
+/// in place. Blobs whose name could lead out of the directory are not downloaded, and their names are returned.
+///
+sync_download directory_sync::download(cloud_blob_container container, const utility::string_t& prefix, const utility::string_t& directory) const
+{
+  std::shared_ptr<sync_state> state = std::make_shared<sync_state>();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::shared_ptr<request_tracer> tracer = m_tracer;
+  pplx::task<remote_index> listing = pplx::create_task([container, prefix, state, tracer]()
+  {
+    return index_remote(container, prefix, tracer, state->requests);
+  });
+
+  local_index local;
+  for (local_file& file : local_directory::list_files(directory, m_parallelism))
+  {
+    local[file.name] = file;
+  }
+
+  sync_download result;
+  std::vector<std::pair<utility::string_t, remote_file>> remote;
+  for (const auto& listed : listing.get())
+  {
+    if (is_safe_name(listed.first))
+    {
+      remote.push_back(listed);
+    }
+    else
+    {
+      result.rejected_names.push_back(listed.first);
+    }
+  }
+
+  size_t block_size = m_block_size;
+  task_util::run_workers(m_parallelism, [&]() -> pplx::task<bool>
+  {
+    size_t index = state->next++;
+    if (index >= remote.size())
+    {
+      return pplx::task_from_result(false);
+    }
+
+    const utility::string_t& name = remote[index].first;
+    const remote_file& file = remote[index].second;
+    utility::string_t path = directory + U("/") + name;
+
+    auto found = local.find(name);
+    if (found != local.end() && !has_changed(found->second, file, path))
+    {
+      state->skipped_bytes += file.size;
+      if (file.modified >= 0 && found->second.modified != file.modified)
+      {
+        local_directory::set_modified_time(path, file.modified);
+      }
+
+      return pplx::task_from_result(true);
+    }
+
+    local_directory::create_parent_directories(directory, name);
+    if (file.size > block_size)
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->large_files.push_back(std::make_pair(name, file.modified));
+      return pplx::task_from_result(true);
+    }
+
+    cloud_blob blob = container.get_blob_reference(prefix + name);
+    int64_t modified = file.modified;
+    utility::size64_t size = file.size;
+    return blob.download_to_file_async(path, access_condition(), blob_request_options(), request_tracer::context_for(tracer, U("download_blob"))).then([state, path, modified, size](pplx::task<void> download)
+    {
+      download.get();
+      if (modified >= 0)
+      {
+        local_directory::set_modified_time(path, modified);
+      }
+
+      state->bytes += size;
+      state->requests++;
+      return true;
+    });
+  }).wait();
+
+  parallel_range_downloader downloader(m_block_size, m_parallelism);
+  downloader.set_tracer(m_tracer);
+  for (const auto& large_file : state->large_files)
+  {
+    utility::string_t path = directory + U("/") + large_file.first;
+    transfer_stats stats = downloader.download_to_file(container.get_blob_reference(prefix + large_file.first), path);
+    state->bytes += stats.bytes;
+    state->requests += stats.requests;
+
+    if (large_file.second >= 0)
+    {
+      local_directory::set_modified_time(path, large_file.second);
+    }
+  }
+
+  result.stats.bytes = state->bytes;
+  result.stats.skipped_bytes = state->skipped_bytes;
+  result.stats.requests = state->requests;
+  result.stats.seconds = task_util::seconds_since(start);
+  return result;
+}
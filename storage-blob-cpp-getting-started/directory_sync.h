@@ -0,0 +1,46 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+using namespace azure::storage;
+
+#pragma once
+
+struct sync_download
+{
+  transfer_stats stats;
+  std::vector<utility::string_t> rejected_names;
+};
+
+class directory_sync
+{
+public:
+  directory_sync(size_t block_size, size_t parallelism);
+
+  transfer_stats upload(const utility::string_t& directory, cloud_blob_container container, const utility::string_t& prefix) const;
+  sync_download download(cloud_blob_container container, const utility::string_t& prefix, const utility::string_t& directory) const;
+
+  void set_pipeline(std::shared_ptr<integrity_pipeline> pipeline);
+  void set_tracer(std::shared_ptr<request_tracer> tracer);
+
+  static const utility::string_t modified_metadata;
+
+private:
+  size_t m_block_size;
+  size_t m_parallelism;
+  std::shared_ptr<integrity_pipeline> m_pipeline;
+  std::shared_ptr<request_tracer> m_tracer;
+};
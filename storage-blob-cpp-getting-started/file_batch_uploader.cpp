@@ -0,0 +1,394 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "task_util.h"
+#include "md5.h"
+#include "integrity_pipeline.h"
+#include "mapped_file.h"
+#include "concurrency_controller.h"
+#include "request_tracer.h"
+#include "parallel_block_uploader.h"
+#include "file_batch_uploader.h"
+
+using namespace azure::storage;
+
+namespace
+{
+  // Marks the unit sending a whole file with a single request
+  const size_t single_put = static_cast<size_t>(-1);
+
+  struct upload_unit
+  {
+    size_t file;
+    size_t block;
+    utility::size64_t offset;
+    utility::size64_t length;
+  };
+
+  struct worker_queue
+  {
+    worker_queue() : units(0), bytes(0) {}
+
+    std::mutex mutex;
+    std::deque<upload_unit> queue;
+
+    // Read without the lock to choose the queue to steal from
+    std::atomic<size_t> units;
+    std::atomic<utility::size64_t> bytes;
+  };
+
+  struct block_upload
+  {
+    block_upload() : block_count(0), remaining(0) {}
+
+    std::mutex mutex;
+    std::shared_ptr<mapped_file> file;
+    size_t block_count;
+    std::atomic<size_t> remaining;
+  };
+
+  struct batch_state
+  {
+    batch_state(size_t workers, std::shared_ptr<integrity_pipeline> pipeline) : queues(workers), pipeline(pipeline), failed(false), bytes(0), requests(0) {}
+
+    std::vector<batch_file> files;
+    cloud_blob_container container;
+    std::vector<worker_queue> queues;
+    std::unordered_map<size_t, std::unique_ptr<block_upload>> block_uploads;
+    std::shared_ptr<integrity_pipeline> pipeline;
+    std::shared_ptr<request_tracer> tracer;
+
+    std::atomic<bool> failed;
+    std::atomic<utility::size64_t> bytes;
+    std::atomic<size_t> requests;
+  };
+
+  ///
+  /// Takes the next unit of a worker: the first one of its own queue, else the last one of the queue holding
+  /// the most bytes. Returns false once every queue is empty.
+  ///
+  bool take_unit(batch_state& state, size_t worker, upload_unit& unit)
+  {
+    worker_queue* queue = &state.queues[worker];
+    for (;;)
+    {
+      {
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (!queue->queue.empty())
+        {
+          if (queue == &state.queues[worker])
+          {
+            unit = queue->queue.front();
+            queue->queue.pop_front();
+          }
+          else
+          {
+            unit = queue->queue.back();
+            queue->queue.pop_back();
+          }
+
+          queue->units--;
+          queue->bytes -= unit.length;
+          return true;
+        }
+      }
+
+      queue = nullptr;
+      utility::size64_t most = 0;
+      for (worker_queue& victim : state.queues)
+      {
+        if (victim.units > 0 && (queue == nullptr || victim.bytes > most))
+        {
+          queue = &victim;
+          most = victim.bytes;
+        }
+      }
+
+      if (queue == nullptr)
+      {
+        return false;
+      }
+    }
+  }
+
+  ///
+  /// Maps a file sent in blocks the first time one of its blocks is taken, and checks it still has the size it
+  /// was scheduled with.
+  ///
+  std::shared_ptr<mapped_file> open_blocks(const batch_file& file, block_upload& upload)
+  {
+    std::lock_guard<std::mutex> lock(upload.mutex);
+    if (!upload.file)
+    {
+      upload.file = mapped_file::open(file.path);
+      if (upload.file->size() != file.size)
+      {
+        throw std::runtime_error("The file changed while it was uploaded");
+      }
+    }
+
+    return upload.file;
+  }
+
+  cloud_block_blob blob_reference(const batch_state& state, const batch_file& file)
+  {
+    cloud_block_blob blob = state.container.get_block_blob_reference(file.blob_name);
+    blob.metadata() = file.metadata;
+    if (!file.content_md5.empty())
+    {
+      blob.properties().set_content_md5(file.content_md5);
+    }
+
+    return blob;
+  }
+
+  ///
+  /// Sends a unit: a whole file with a single Put Blob, or one block of a larger file. The worker sending the
+  /// last block of a file also commits its block list.
+  ///
+  pplx::task<void> upload_unit_async(std::shared_ptr<batch_state> state, const upload_unit& unit)
+  {
+    const batch_file& file = state->files[unit.file];
+    if (unit.block == single_put)
+    {
+      std::shared_ptr<mapped_file> content = mapped_file::open(file.path);
+      concurrency::streams::istream stream = content->view(0, content->size());
+      return blob_reference(*state, file).upload_from_stream_async(stream, access_condition(), blob_request_options(),
+        request_tracer::context_for(state->tracer, U("upload_blob"))).then([state, content, stream](pplx::task<void> upload)
+      {
+        stream.close();
+        upload.get();
+
+        state->bytes += content->size();
+        state->requests++;
+      });
+    }
+
+    block_upload& upload = *state->block_uploads.at(unit.file);
+    std::shared_ptr<mapped_file> content = open_blocks(file, upload);
+    size_t file_index = unit.file;
+    size_t block = unit.block;
+    utility::size64_t offset = unit.offset;
+    utility::size64_t length = unit.length;
+
+    return state->pipeline->hash_async(content->data() + offset, static_cast<size_t>(length)).then([state, content, file_index, block, offset, length](block_digest digest)
+    {
+      cloud_block_blob blob = state->container.get_block_blob_reference(state->files[file_index].blob_name);
+      concurrency::streams::istream stream = content->view(offset, length);
+      return blob.upload_block_async(parallel_block_uploader::block_id(block), stream, digest.content_md5(), access_condition(), blob_request_options(),
+        request_tracer::context_for(state->tracer, U("upload_block"))).then([state, content, stream, offset, length](pplx::task<void> upload)
+      {
+        stream.close();
+        upload.get();
+
+        content->release(offset, length);
+        state->bytes += length;
+        state->requests++;
+      });
+    }).then([state, file_index]() -> pplx::task<void>
+    {
+      block_upload& upload = *state->block_uploads.at(file_index);
+      if (--upload.remaining > 0)
+      {
+        return pplx::task_from_result();
+      }
+
+      std::vector<block_list_item> blocks;
+      blocks.reserve(upload.block_count);
+      for (size_t index = 0; index < upload.block_count; index++)
+      {
+        blocks.push_back(block_list_item(parallel_block_uploader::block_id(index)));
+      }
+
+      // The file is unmapped once its block list is committed
+      upload.file.reset();
+      return blob_reference(*state, state->files[file_index]).upload_block_list_async(blocks, access_condition(), blob_request_options(),
+        request_tracer::context_for(state->tracer, U("upload_block_list"))).then([state]()
+      {
+        state->requests++;
+      });
+    });
+  }
+
+  ///
+  /// Runs a single worker: keeps taking units until every queue is empty, or until another worker has failed
+  ///
+  pplx::task<void> run_queue_worker(std::shared_ptr<batch_state> state, size_t worker)
+  {
+    upload_unit unit;
+    if (state->failed || !take_unit(*state, worker, unit))
+    {
+      return pplx::task_from_result();
+    }
+
+    pplx::task<void> upload;
+    try
+    {
+      upload = upload_unit_async(state, unit);
+    }
+    catch (...)
+    {
+      state->failed = true;
+      return pplx::task_from_exception<void>(std::current_exception());
+    }
+
+    return upload.then([state, worker](pplx::task<void> completed)
+    {
+      try
+      {
+        completed.get();
+      }
+      catch (...)
+      {
+        state->failed = true;
+        throw;
+      }
+
+      return run_queue_worker(state, worker);
+    });
+  }
+}
+
+batch_file::batch_file()
+  : size(0)
+{
+}
+
+batch_file::batch_file(const utility::string_t& path, const utility::string_t& blob_name, utility::size64_t size)
+  : path(path), blob_name(blob_name), size(size)
+{
+}
+
+///
+/// Creates an uploader sending up to 'parallelism' requests at once. Files up to 'single_put_threshold' bytes
+/// are sent with a single Put Blob request, larger ones in blocks of 'block_size' bytes.
+///
+file_batch_uploader::file_batch_uploader(size_t single_put_threshold, size_t block_size, size_t parallelism)
+  : m_single_put_threshold(single_put_threshold), m_block_size(block_size), m_parallelism(parallelism > 0 ? parallelism : 1)
+{
+}
+
+///
+/// Shares a hashing pipeline with other transfers. Without one, every batch starts its own, with a thread per
+/// worker.
+///
+void file_batch_uploader::set_pipeline(std::shared_ptr<integrity_pipeline> pipeline)
+{
+  m_pipeline = pipeline;
+}
+
+///
+/// Records the Put Blob, Put Block and Put Block List requests of the batches on a tracer
+///
+void file_batch_uploader::set_tracer(std::shared_ptr<request_tracer> tracer)
+{
+  m_tracer = tracer;
+}
+
+///
+/// Uploads a batch of files to block blobs and waits for the uploads to complete.
+///
+transfer_stats file_batch_uploader::upload(const std::vector<batch_file>& files, cloud_blob_container container) const
+{
+  return upload_async(files, container).get();
+}
+
+///
+/// Uploads a batch of files to block blobs, many of them at once. The time to upload a small file is mostly the
+/// latency of its request, so the files are not sent one after the other but as units of work shared by the
+/// workers: a small file is one unit, a large file one unit per block, and the last block of a file commits it.
+/// The units are dealt from the largest to the smallest to the queue holding the fewest bytes, and each worker
+/// takes the largest unit of its own queue first. A worker whose queue is empty steals the smallest unit of the
+/// queue holding the most bytes, so a few large files spread over every worker instead of holding up the rest.
+/// The sizes given with the files are only used to schedule them: a file sent in blocks must not change.
+///
+pplx::task<transfer_stats> file_batch_uploader::upload_async(const std::vector<batch_file>& files, cloud_blob_container container) const
+{
+  std::shared_ptr<batch_state> state = std::make_shared<batch_state>(m_parallelism, m_pipeline ? m_pipeline : std::make_shared<integrity_pipeline>(m_parallelism));
+  state->files = files;
+  state->container = container;
+  state->tracer = m_tracer;
+
+  std::vector<upload_unit> units;
+  for (size_t index = 0; index < files.size(); index++)
+  {
+    const batch_file& file = files[index];
+    if (file.size <= m_single_put_threshold)
+    {
+      upload_unit unit = { index, single_put, 0, file.size };
+      units.push_back(unit);
+      continue;
+    }
+
+    size_t block_count = static_cast<size_t>((file.size + m_block_size - 1) / m_block_size);
+    if (block_count > task_util::max_block_count)
+    {
+      throw std::runtime_error("The file has too many blocks, use a larger block size");
+    }
+
+    std::unique_ptr<block_upload> upload(new block_upload());
+    upload->block_count = block_count;
+    upload->remaining = block_count;
+    state->block_uploads[index] = std::move(upload);
+
+    for (size_t block = 0; block < block_count; block++)
+    {
+      utility::size64_t offset = static_cast<utility::size64_t>(block) * m_block_size;
+      upload_unit unit = { index, block, offset, std::min<utility::size64_t>(m_block_size, file.size - offset) };
+      units.push_back(unit);
+    }
+  }
+
+  std::stable_sort(units.begin(), units.end(), [](const upload_unit& left, const upload_unit& right)
+  {
+    return left.length > right.length;
+  });
+
+  for (const upload_unit& unit : units)
+  {
+    worker_queue* lightest = &state->queues[0];
+    for (worker_queue& queue : state->queues)
+    {
+      if (queue.bytes < lightest->bytes || (queue.bytes == lightest->bytes && queue.units < lightest->units))
+      {
+        lightest = &queue;
+      }
+    }
+
+    lightest->queue.push_back(unit);
+    lightest->units++;
+    lightest->bytes += unit.length;
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::vector<pplx::task<void>> workers;
+  workers.reserve(m_parallelism);
+  for (size_t worker = 0; worker < m_parallelism; worker++)
+  {
+    workers.push_back(run_queue_worker(state, worker));
+  }
+
+  return pplx::when_all(workers.begin(), workers.end()).then([state, start]()
+  {
+    transfer_stats stats;
+    stats.bytes = state->bytes;
+    stats.requests = state->requests;
+    stats.seconds = task_util::seconds_since(start);
+    return stats;
+  });
+}
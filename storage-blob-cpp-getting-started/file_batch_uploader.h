@@ -0,0 +1,50 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+using namespace azure::storage;
+
+#pragma once
+
+struct batch_file
+{
+  batch_file();
+  batch_file(const utility::string_t& path, const utility::string_t& blob_name, utility::size64_t size);
+
+  utility::string_t path;
+  utility::string_t blob_name;
+  utility::size64_t size;
+  cloud_metadata metadata;
+  utility::string_t content_md5;
+};
+
+class file_batch_uploader
+{
+public:
+  file_batch_uploader(size_t single_put_threshold, size_t block_size, size_t parallelism);
+
+  transfer_stats upload(const std::vector<batch_file>& files, cloud_blob_container container) const;
+  pplx::task<transfer_stats> upload_async(const std::vector<batch_file>& files, cloud_blob_container container) const;
+
+  void set_pipeline(std::shared_ptr<integrity_pipeline> pipeline);
+  void set_tracer(std::shared_ptr<request_tracer> tracer);
+
+private:
+  size_t m_single_put_threshold;
+  size_t m_block_size;
+  size_t m_parallelism;
+  std::shared_ptr<integrity_pipeline> m_pipeline;
+  std::shared_ptr<request_tracer> m_tracer;
+};
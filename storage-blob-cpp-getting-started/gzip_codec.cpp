@@ -0,0 +1,137 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "gzip_codec.h"
+
+#include <zlib.h>
+
+namespace
+{
+  // Adds 16 to the default window bits of zlib for a gzip header and trailer instead of a zlib one
+  const int gzip_window_bits = 15 + 16;
+
+  // Adds 32 to the default window bits of zlib to accept either a gzip or a zlib header
+  const int any_window_bits = 15 + 32;
+
+  // Size of the buffer the decompressed data is written to
+  const size_t output_chunk_size = 64 * 1024;
+}
+
+///
+/// Compresses a buffer into a complete gzip member. Members compressed separately can be written one after the
+/// other: the result is still a valid gzip stream, which any gzip decoder reads as a whole.
+///
+std::vector<uint8_t> gzip_codec::compress(const uint8_t* data, size_t length, int level)
+{
+  z_stream stream;
+  std::memset(&stream, 0, sizeof(stream));
+  if (deflateInit2(&stream, level, Z_DEFLATED, gzip_window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+    throw std::runtime_error("The compressor could not be initialized");
+  }
+
+  std::vector<uint8_t> output(deflateBound(&stream, static_cast<uLong>(length)));
+  stream.next_in = const_cast<Bytef*>(data);
+  stream.avail_in = static_cast<uInt>(length);
+  stream.next_out = output.data();
+  stream.avail_out = static_cast<uInt>(output.size());
+
+  int result = deflate(&stream, Z_FINISH);
+  output.resize(stream.total_out);
+  deflateEnd(&stream);
+
+  if (result != Z_STREAM_END)
+  {
+    throw std::runtime_error("The data could not be compressed");
+  }
+
+  return output;
+}
+
+struct gzip_decoder::decoder_state
+{
+  decoder_state() : member_ended(false)
+  {
+    std::memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, any_window_bits) != Z_OK)
+    {
+      throw std::runtime_error("The decompressor could not be initialized");
+    }
+  }
+
+  ~decoder_state()
+  {
+    inflateEnd(&stream);
+  }
+
+  z_stream stream;
+  bool member_ended;
+};
+
+gzip_decoder::gzip_decoder()
+  : m_state(std::make_shared<decoder_state>())
+{
+}
+
+///
+/// Decompresses the next part of a gzip stream, of any length, and appends the result to the output.
+/// The stream may hold several gzip members one after the other.
+///
+void gzip_decoder::decode(const uint8_t* data, size_t length, std::vector<uint8_t>& output)
+{
+  z_stream& stream = m_state->stream;
+  stream.next_in = const_cast<Bytef*>(data);
+  stream.avail_in = static_cast<uInt>(length);
+
+  while (stream.avail_in > 0)
+  {
+    if (m_state->member_ended)
+    {
+      // Another member follows the one that ended
+      inflateReset(&stream);
+      m_state->member_ended = false;
+    }
+
+    size_t written = output.size();
+    output.resize(written + output_chunk_size);
+    stream.next_out = output.data() + written;
+    stream.avail_out = static_cast<uInt>(output_chunk_size);
+
+    int result = inflate(&stream, Z_NO_FLUSH);
+    output.resize(output.size() - stream.avail_out);
+
+    if (result == Z_STREAM_END)
+    {
+      m_state->member_ended = true;
+    }
+    else if (result != Z_OK && result != Z_BUF_ERROR)
+    {
+      throw std::runtime_error("The compressed data is corrupted");
+    }
+  }
+}
+
+///
+/// Checks the stream decoded so far ends with a complete gzip member
+///
+void gzip_decoder::finish() const
+{
+  if (!m_state->member_ended)
+  {
+    throw std::runtime_error("The compressed data is truncated");
+  }
+}
@@ -0,0 +1,40 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#pragma once
+
+class gzip_codec
+{
+public:
+  static std::vector<uint8_t> compress(const uint8_t* data, size_t length, int level);
+};
+
+class gzip_decoder
+{
+public:
+  gzip_decoder();
+
+  void decode(const uint8_t* data, size_t length, std::vector<uint8_t>& output);
+  void finish() const;
+
+private:
+  gzip_decoder(const gzip_decoder&);
+  gzip_decoder& operator=(const gzip_decoder&);
+
+  struct decoder_state;
+
+  std::shared_ptr<decoder_state> m_state;
+};
@@ -0,0 +1,186 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#include "stdafx.h"
+#include "md5.h"
+#include "integrity_pipeline.h"
+
+namespace
+{
+  // Number of messages hashed together by md5_hash::update_parallel
+  const size_t batch_size = 4;
+
+  struct hash_job
+  {
+    const uint8_t* data;
+    size_t length;
+    pplx::task_completion_event<block_digest> completion;
+  };
+}
+
+block_digest::block_digest()
+{
+  md5.fill(0);
+}
+
+///
+/// Returns the MD5 encoded for the Content-MD5 header, or the content MD5 parameter of the SDK
+///
+utility::string_t block_digest::content_md5() const
+{
+  return md5_hash::to_base64(md5);
+}
+
+struct integrity_pipeline::pipeline_state
+{
+  pipeline_state() : stopping(false) {}
+
+  void run();
+
+  std::mutex mutex;
+  std::condition_variable jobs_available;
+  std::deque<hash_job> jobs;
+  bool stopping;
+};
+
+///
+/// Creates a pool of threads hashing blocks for the uploads. Hashing on these threads lets the blocks
+/// ahead of the ones being sent be hashed while the network is busy, instead of hashing each block on the
+/// thread sending it, right before sending it.
+///
+integrity_pipeline::integrity_pipeline(size_t threads)
+  : m_state(std::make_shared<pipeline_state>())
+{
+  size_t count = threads > 0 ? threads : 1;
+  for (size_t i = 0; i < count; i++)
+  {
+    std::shared_ptr<pipeline_state> state = m_state;
+    m_workers.push_back(std::thread([state]()
+    {
+      state->run();
+    }));
+  }
+}
+
+///
+/// Creates the pipeline used by a transfer that is not given one, with a thread per hardware thread
+///
+std::shared_ptr<integrity_pipeline> integrity_pipeline::create_default()
+{
+  return std::make_shared<integrity_pipeline>(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+///
+/// Hashes the blocks already queued and stops the threads
+///
+integrity_pipeline::~integrity_pipeline()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->stopping = true;
+  }
+
+  m_state->jobs_available.notify_all();
+
+  for (std::thread& worker : m_workers)
+  {
+    // The pipeline can be released by a continuation of its last hash, running on one of its threads
+    if (worker.get_id() == std::this_thread::get_id())
+    {
+      worker.detach();
+    }
+    else
+    {
+      worker.join();
+    }
+  }
+}
+
+///
+/// Queues a block to compute its MD5. The data must stay valid until the returned task completes.
+///
+pplx::task<block_digest> integrity_pipeline::hash_async(const uint8_t* data, size_t length)
+{
+  hash_job job;
+  job.data = data;
+  job.length = length;
+  pplx::task<block_digest> result(job.completion);
+
+  {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->jobs.push_back(job);
+  }
+
+  m_state->jobs_available.notify_one();
+  return result;
+}
+
+///
+/// Takes the oldest queued block, with up to 3 more blocks of the same length so their MD5 is computed
+/// with the multi-buffer version, and completes their tasks.
+///
+void integrity_pipeline::pipeline_state::run()
+{
+  while (true)
+  {
+    std::vector<hash_job> batch;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (jobs.empty() && !stopping)
+      {
+        jobs_available.wait(lock);
+      }
+
+      if (jobs.empty())
+      {
+        return;
+      }
+
+      batch.push_back(jobs.front());
+      jobs.pop_front();
+
+      for (auto it = jobs.begin(); it != jobs.end() && batch.size() < batch_size;)
+      {
+        if (it->length == batch.front().length)
+        {
+          batch.push_back(*it);
+          it = jobs.erase(it);
+        }
+        else
+        {
+          ++it;
+        }
+      }
+    }
+
+    md5_hash hashes[batch_size];
+    const uint8_t* data[batch_size];
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+      data[i] = batch[i].data;
+    }
+
+    md5_hash::update_parallel(hashes, data, batch.size(), batch.front().length);
+
+    for (size_t i = 0; i < batch.size(); i++)
+    {
+      block_digest digest;
+      digest.md5 = hashes[i].finish();
+      batch[i].completion.set(digest);
+    }
+  }
+}
@@ -0,0 +1,47 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#pragma once
+
+struct block_digest
+{
+  block_digest();
+
+  utility::string_t content_md5() const;
+
+  md5_hash::digest md5;
+};
+
+class integrity_pipeline
+{
+public:
+  explicit integrity_pipeline(size_t threads);
+  ~integrity_pipeline();
+
+  static std::shared_ptr<integrity_pipeline> create_default();
+
+  pplx::task<block_digest> hash_async(const uint8_t* data, size_t length);
+
+private:
+  integrity_pipeline(const integrity_pipeline&);
+  integrity_pipeline& operator=(const integrity_pipeline&);
+
+  struct pipeline_state;
+
+  std::shared_ptr<pipeline_state> m_state;
+  std::vector<std::thread> m_workers;
+};
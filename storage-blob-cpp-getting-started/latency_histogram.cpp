@@ -0,0 +1,177 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#include "stdafx.h"
+#include "latency_histogram.h"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+///
+/// Creates an empty histogram. Latencies are kept in nanoseconds in log-linear buckets: every power of two
+/// is split in 32 buckets, so a percentile is reported within about 3% of the real value with a fixed
+/// amount of memory, whatever the number of samples.
+///
+latency_histogram::latency_histogram()
+  : m_counts(new std::atomic<uint64_t>[bucket_count]), m_count(0), m_sum(0), m_max(0)
+{
+  for (size_t i = 0; i < bucket_count; i++)
+  {
+    m_counts[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+///
+/// Adds a sample. It only updates a few atomic counters, so it can be called from any thread
+/// while the operations being measured are running.
+///
+void latency_histogram::record(std::chrono::steady_clock::duration latency)
+{
+  int64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+  uint64_t value = nanoseconds > 0 ? static_cast<uint64_t>(nanoseconds) : 0;
+
+  m_counts[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+  m_count.fetch_add(1, std::memory_order_relaxed);
+  m_sum.fetch_add(value, std::memory_order_relaxed);
+
+  uint64_t current = m_max.load(std::memory_order_relaxed);
+  while (value > current && !m_max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+  {
+  }
+}
+
+///
+/// Adds the samples of another histogram to this one
+///
+void latency_histogram::merge(const latency_histogram& other)
+{
+  for (size_t i = 0; i < bucket_count; i++)
+  {
+    m_counts[i].fetch_add(other.m_counts[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+
+  m_count.fetch_add(other.m_count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  m_sum.fetch_add(other.m_sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+  uint64_t value = other.m_max.load(std::memory_order_relaxed);
+  uint64_t current = m_max.load(std::memory_order_relaxed);
+  while (value > current && !m_max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+  {
+  }
+}
+
+utility::size64_t latency_histogram::count() const
+{
+  return m_count.load(std::memory_order_relaxed);
+}
+
+double latency_histogram::mean_microseconds() const
+{
+  uint64_t count = m_count.load(std::memory_order_relaxed);
+  return count > 0 ? static_cast<double>(m_sum.load(std::memory_order_relaxed)) / static_cast<double>(count) / 1000.0 : 0;
+}
+
+double latency_histogram::max_microseconds() const
+{
+  return static_cast<double>(m_max.load(std::memory_order_relaxed)) / 1000.0;
+}
+
+///
+/// Returns the latency under which the given percentage of the samples are, as the upper bound of the bucket
+/// holding that sample (never more than the largest sample)
+///
+double latency_histogram::percentile_microseconds(double percent) const
+{
+  uint64_t count = m_count.load(std::memory_order_relaxed);
+  if (count == 0)
+  {
+    return 0;
+  }
+
+  uint64_t target = static_cast<uint64_t>(std::ceil(percent / 100.0 * static_cast<double>(count)));
+  target = target > 0 ? target : 1;
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < bucket_count; i++)
+  {
+    seen += m_counts[i].load(std::memory_order_relaxed);
+    if (seen >= target)
+    {
+      return static_cast<double>(std::min(bucket_upper_bound(i), m_max.load(std::memory_order_relaxed))) / 1000.0;
+    }
+  }
+
+  return max_microseconds();
+}
+
+///
+/// Returns the summary of the distribution: the number of samples, and the mean, p50, p90, p99 and maximum
+/// latencies in microseconds
+///
+web::json::value latency_histogram::to_json() const
+{
+  web::json::value summary = web::json::value::object();
+  summary[U("count")] = web::json::value::number(count());
+  summary[U("mean_us")] = web::json::value::number(mean_microseconds());
+  summary[U("p50_us")] = web::json::value::number(percentile_microseconds(50));
+  summary[U("p90_us")] = web::json::value::number(percentile_microseconds(90));
+  summary[U("p99_us")] = web::json::value::number(percentile_microseconds(99));
+  summary[U("max_us")] = web::json::value::number(max_microseconds());
+  return summary;
+}
+
+///
+/// Values below 32 ns have a bucket each. Above, the position of the highest bit set selects the power of two
+/// and the next 5 bits the bucket within it.
+///
+size_t latency_histogram::bucket_index(uint64_t nanoseconds)
+{
+  if (nanoseconds < sub_bucket_count)
+  {
+    return static_cast<size_t>(nanoseconds);
+  }
+
+#if defined(_MSC_VER) && defined(_M_X64)
+  unsigned long highest_bit;
+  _BitScanReverse64(&highest_bit, nanoseconds);
+#elif defined(__GNUC__)
+  size_t highest_bit = 63 - static_cast<size_t>(__builtin_clzll(nanoseconds));
+#else
+  size_t highest_bit = 0;
+  for (uint64_t value = nanoseconds; value > 1; value >>= 1)
+  {
+    highest_bit++;
+  }
+#endif
+
+  size_t shift = static_cast<size_t>(highest_bit) - sub_bucket_bits;
+  size_t sub_bucket = static_cast<size_t>(nanoseconds >> shift) - sub_bucket_count;
+  return sub_bucket_count + shift * sub_bucket_count + sub_bucket;
+}
+
+uint64_t latency_histogram::bucket_upper_bound(size_t index)
+{
+  if (index < sub_bucket_count)
+  {
+    return index;
+  }
+
+  size_t shift = (index - sub_bucket_count) / sub_bucket_count;
+  uint64_t sub_bucket = sub_bucket_count + (index - sub_bucket_count) % sub_bucket_count;
+  return ((sub_bucket + 1) << shift) - 1;
+}
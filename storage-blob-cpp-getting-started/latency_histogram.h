@@ -0,0 +1,50 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#pragma once
+
+class latency_histogram
+{
+public:
+  latency_histogram();
+
+  void record(std::chrono::steady_clock::duration latency);
+  void merge(const latency_histogram& other);
+
+  utility::size64_t count() const;
+  double mean_microseconds() const;
+  double max_microseconds() const;
+  double percentile_microseconds(double percent) const;
+
+  web::json::value to_json() const;
+
+private:
+  latency_histogram(const latency_histogram&);
+  latency_histogram& operator=(const latency_histogram&);
+
+  static size_t bucket_index(uint64_t nanoseconds);
+  static uint64_t bucket_upper_bound(size_t index);
+
+  static const size_t sub_bucket_bits = 5;
+  static const size_t sub_bucket_count = 1 << sub_bucket_bits;
+  static const size_t bucket_count = sub_bucket_count + (64 - sub_bucket_bits) * sub_bucket_count;
+
+  std::unique_ptr<std::atomic<uint64_t>[]> m_counts;
+  std::atomic<uint64_t> m_count;
+  std::atomic<uint64_t> m_sum;
+  std::atomic<uint64_t> m_max;
+};
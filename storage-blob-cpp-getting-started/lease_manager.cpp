@@ -0,0 +1,439 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#include "stdafx.h"
+#include "request_tracer.h"
+#include "lease_manager.h"
+
+using namespace azure::storage;
+
+namespace
+{
+  // Length of a tick of the timer wheel, renewals due within the same tick are sent together
+  const std::chrono::milliseconds tick_length(100);
+
+  // Delay before retrying a renewal that failed with a transient error
+  const std::chrono::milliseconds retry_delay(1000);
+
+  const size_t wheel_bits = 6;
+  const size_t wheel_slots = 1 << wheel_bits;
+  const size_t wheel_levels = 3;
+
+  ///
+  /// A hierarchical timer wheel of three levels of 64 slots. The first level holds the timers due in the next
+  /// 64 ticks, one slot per tick, and every other level covers spans 64 times longer. Each time a level wraps,
+  /// the next slot of the level above is moved down, so scheduling and firing a timer costs O(1) whatever the
+  /// number of timers.
+  ///
+  template <typename T>
+  class timer_wheel
+  {
+  public:
+    timer_wheel() : m_current(0), m_levels(wheel_levels, std::vector<std::vector<std::pair<uint64_t, T>>>(wheel_slots))
+    {
+    }
+
+    uint64_t current() const
+    {
+      return m_current;
+    }
+
+    ///
+    /// Schedules a timer for the given tick. Timers in the past fire on the next tick.
+    ///
+    void schedule(uint64_t tick, const T& value)
+    {
+      const uint64_t horizon = static_cast<uint64_t>(1) << (wheel_bits * wheel_levels);
+      place(std::min(std::max(tick, m_current + 1), m_current + horizon - 1), value);
+    }
+
+    ///
+    /// Moves to the next tick and adds the timers it fires to 'due'
+    ///
+    void advance(std::vector<T>& due)
+    {
+      m_current++;
+      for (size_t level = 1; level < wheel_levels; level++)
+      {
+        if ((m_current & ((static_cast<uint64_t>(1) << (wheel_bits * level)) - 1)) != 0)
+        {
+          break;
+        }
+
+        std::vector<std::pair<uint64_t, T>> timers;
+        timers.swap(m_levels[level][(m_current >> (wheel_bits * level)) & (wheel_slots - 1)]);
+        for (const auto& timer : timers)
+        {
+          place(timer.first, timer.second);
+        }
+      }
+
+      std::vector<std::pair<uint64_t, T>>& slot = m_levels[0][m_current & (wheel_slots - 1)];
+      for (const auto& timer : slot)
+      {
+        due.push_back(timer.second);
+      }
+
+      slot.clear();
+    }
+
+  private:
+    void place(uint64_t tick, const T& value)
+    {
+      uint64_t delta = tick - m_current;
+      size_t level = 0;
+      while (level + 1 < wheel_levels && delta >= (static_cast<uint64_t>(1) << (wheel_bits * (level + 1))))
+      {
+        level++;
+      }
+
+      m_levels[level][(tick >> (wheel_bits * level)) & (wheel_slots - 1)].push_back(std::make_pair(tick, value));
+    }
+
+    uint64_t m_current;
+    std::vector<std::vector<std::vector<std::pair<uint64_t, T>>>> m_levels;
+  };
+
+  struct held_lease
+  {
+    std::function<pplx::task<void>(const access_condition&, const blob_request_options&)> renew;
+    std::function<pplx::task<void>(const access_condition&, const blob_request_options&)> release;
+    std::function<void(const utility::string_t&)> on_lost;
+    std::chrono::steady_clock::time_point expires;
+    uint64_t generation;
+  };
+}
+
+struct lease_manager::manager_state
+{
+  manager_state() : parallelism(1), stopped(false), next_generation(0), in_flight(0), start(std::chrono::steady_clock::now()) {}
+
+  ///
+  /// Returns the tick of the timer wheel a point in time falls in
+  ///
+  uint64_t tick_of(std::chrono::steady_clock::time_point time) const
+  {
+    return time > start ? static_cast<uint64_t>((time - start) / tick_length) : 0;
+  }
+
+  std::chrono::seconds lease_duration;
+  size_t parallelism;
+
+  mutable std::mutex mutex;
+  std::condition_variable stopping;
+  bool stopped;
+  uint64_t next_generation;
+  size_t in_flight;
+  std::chrono::steady_clock::time_point start;
+
+  // The timers hold the lease id and the generation of the hold, so that a lease released and acquired
+  // again does not get the renewals of its previous hold
+  std::map<utility::string_t, held_lease> leases;
+  timer_wheel<std::pair<utility::string_t, uint64_t>> wheel;
+  // The renewals fired by the wheel and not sent yet
+  std::deque<std::pair<utility::string_t, uint64_t>> pending;
+};
+
+///
+/// Creates a lease manager acquiring leases of 'lease_duration' (15 to 60 seconds), and starts its timer thread.
+/// Every lease is renewed when half of its duration has elapsed, with up to 'parallelism' renewals in flight.
+///
+lease_manager::lease_manager(std::chrono::seconds lease_duration, size_t parallelism)
+  : m_state(std::make_shared<manager_state>())
+{
+  m_state->lease_duration = lease_duration;
+  m_state->parallelism = parallelism > 0 ? parallelism : 1;
+  m_timer = std::thread(run_timer, m_state);
+}
+
+///
+/// Stops the timer thread and releases the leases still held, so that other holders can take them right away.
+/// Renewals still in flight find their lease gone when they complete.
+///
+lease_manager::~lease_manager()
+{
+  std::map<utility::string_t, held_lease> leases;
+  {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    m_state->stopped = true;
+    leases.swap(m_state->leases);
+  }
+
+  m_state->stopping.notify_all();
+  m_timer.join();
+
+  std::vector<pplx::task<void>> releases;
+  for (const auto& lease : leases)
+  {
+    releases.push_back(lease.second.release(access_condition::generate_lease_condition(lease.first), blob_request_options()));
+  }
+
+  for (pplx::task<void>& release : releases)
+  {
+    try
+    {
+      release.get();
+    }
+    catch (const std::exception&)
+    {
+      // A lease that could not be released expires by itself
+    }
+  }
+}
+
+///
+/// Acquires a lease on a blob and keeps it renewed until it is released. 'on_lost' is called if a renewal fails,
+/// after which the lease is no longer held.
+///
+utility::string_t lease_manager::acquire(cloud_blob blob, lost_handler on_lost)
+{
+  std::chrono::steady_clock::time_point acquired = std::chrono::steady_clock::now();
+  std::shared_ptr<request_tracer> tracer = m_tracer;
+  utility::string_t lease_id = blob.acquire_lease(lease_time(m_state->lease_duration), utility::string_t(), access_condition(), blob_request_options(),
+    request_tracer::context_for(tracer, U("acquire_lease")));
+
+  return hold(lease_id, acquired, [blob, tracer](const access_condition& condition, const blob_request_options& options) mutable
+  {
+    return blob.renew_lease_async(condition, options, request_tracer::context_for(tracer, U("renew_lease")));
+  }, [blob, tracer](const access_condition& condition, const blob_request_options& options) mutable
+  {
+    return blob.release_lease_async(condition, options, request_tracer::context_for(tracer, U("release_lease")));
+  }, on_lost);
+}
+
+///
+/// Acquires a lease on a container and keeps it renewed until it is released. 'on_lost' is called if a renewal
+/// fails, after which the lease is no longer held.
+///
+utility::string_t lease_manager::acquire(cloud_blob_container container, lost_handler on_lost)
+{
+  std::chrono::steady_clock::time_point acquired = std::chrono::steady_clock::now();
+  std::shared_ptr<request_tracer> tracer = m_tracer;
+  utility::string_t lease_id = container.acquire_lease(lease_time(m_state->lease_duration), utility::string_t(), access_condition(), blob_request_options(),
+    request_tracer::context_for(tracer, U("acquire_lease")));
+
+  return hold(lease_id, acquired, [container, tracer](const access_condition& condition, const blob_request_options& options) mutable
+  {
+    return container.renew_lease_async(condition, options, request_tracer::context_for(tracer, U("renew_lease")));
+  }, [container, tracer](const access_condition& condition, const blob_request_options& options) mutable
+  {
+    return container.release_lease_async(condition, options, request_tracer::context_for(tracer, U("release_lease")));
+  }, on_lost);
+}
+
+///
+/// Stops renewing a lease and releases it
+///
+void lease_manager::release(const utility::string_t& lease_id)
+{
+  lease_operation release;
+  {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    auto lease = m_state->leases.find(lease_id);
+    if (lease == m_state->leases.end())
+    {
+      throw std::invalid_argument("The lease is not held by this manager");
+    }
+
+    release = lease->second.release;
+    m_state->leases.erase(lease);
+  }
+
+  release(access_condition::generate_lease_condition(lease_id), blob_request_options()).get();
+}
+
+///
+/// Returns whether a lease is still held: it was not released nor lost, and has not expired
+///
+bool lease_manager::is_held(const utility::string_t& lease_id) const
+{
+  std::lock_guard<std::mutex> lock(m_state->mutex);
+  auto lease = m_state->leases.find(lease_id);
+  return lease != m_state->leases.end() && lease->second.expires > std::chrono::steady_clock::now();
+}
+
+size_t lease_manager::size() const
+{
+  std::lock_guard<std::mutex> lock(m_state->mutex);
+  return m_state->leases.size();
+}
+
+///
+/// Records the acquisitions, the renewals and the releases of the leases acquired from now on, on a tracer
+///
+void lease_manager::set_tracer(std::shared_ptr<request_tracer> tracer)
+{
+  m_tracer = tracer;
+}
+
+///
+/// Records a newly acquired lease and schedules its first renewal
+///
+utility::string_t lease_manager::hold(const utility::string_t& lease_id, std::chrono::steady_clock::time_point acquired, lease_operation renew, lease_operation release, lost_handler on_lost)
+{
+  std::lock_guard<std::mutex> lock(m_state->mutex);
+
+  held_lease lease;
+  lease.renew = renew;
+  lease.release = release;
+  lease.on_lost = on_lost;
+  lease.expires = acquired + m_state->lease_duration;
+  lease.generation = m_state->next_generation++;
+  m_state->leases[lease_id] = lease;
+
+  m_state->wheel.schedule(m_state->tick_of(acquired + m_state->lease_duration / 2), std::make_pair(lease_id, lease.generation));
+  return lease_id;
+}
+
+///
+/// The timer thread: advances the wheel once per tick and queues the renewals of the leases it fires. The
+/// renewals are sent without waiting for them, so a slow request never holds up the wheel.
+///
+void lease_manager::run_timer(std::shared_ptr<manager_state> state)
+{
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while (!state->stopped)
+  {
+    std::chrono::steady_clock::time_point next_tick = state->start + tick_length * static_cast<int64_t>(state->wheel.current() + 1);
+    if (state->stopping.wait_until(lock, next_tick, [state]() { return state->stopped; }))
+    {
+      break;
+    }
+
+    std::vector<std::pair<utility::string_t, uint64_t>> due;
+    uint64_t now = state->tick_of(std::chrono::steady_clock::now());
+    while (state->wheel.current() < now)
+    {
+      state->wheel.advance(due);
+    }
+
+    if (!due.empty())
+    {
+      state->pending.insert(state->pending.end(), due.begin(), due.end());
+      lock.unlock();
+      start_renewals(state);
+      lock.lock();
+    }
+  }
+}
+
+///
+/// Sends the queued renewals while fewer than 'parallelism' are in flight, each completed renewal sending the
+/// next ones. A request is abandoned when its lease expires. A renewed lease is scheduled again for the middle of
+/// its new duration. A renewal rejected by the service, or still failing when the lease expires, loses the lease,
+/// other failures are retried a second later.
+///
+void lease_manager::start_renewals(std::shared_ptr<manager_state> state)
+{
+  while (true)
+  {
+    std::pair<utility::string_t, uint64_t> timer;
+    lease_operation renew;
+    std::chrono::steady_clock::time_point expires;
+    lost_handler on_lost;
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (state->stopped || state->in_flight >= state->parallelism || state->pending.empty())
+      {
+        return;
+      }
+
+      timer = state->pending.front();
+      state->pending.pop_front();
+      auto lease = state->leases.find(timer.first);
+      if (lease == state->leases.end() || lease->second.generation != timer.second)
+      {
+        continue;
+      }
+
+      if (lease->second.expires <= std::chrono::steady_clock::now())
+      {
+        on_lost = lease->second.on_lost;
+        state->leases.erase(lease);
+      }
+      else
+      {
+        renew = lease->second.renew;
+        expires = lease->second.expires;
+        state->in_flight++;
+      }
+    }
+
+    if (on_lost)
+    {
+      on_lost(timer.first);
+      continue;
+    }
+
+    std::chrono::steady_clock::time_point sent = std::chrono::steady_clock::now();
+    blob_request_options options;
+    options.set_maximum_execution_time(std::chrono::duration_cast<std::chrono::milliseconds>(expires - sent));
+
+    renew(access_condition::generate_lease_condition(timer.first), options).then([state, timer, sent](pplx::task<void> renewal)
+    {
+      bool renewed = false;
+      int status_code = 0;
+      try
+      {
+        renewal.get();
+        renewed = true;
+      }
+      catch (const azure::storage::storage_exception& e)
+      {
+        status_code = e.result().http_status_code();
+      }
+      catch (const std::exception&)
+      {
+        // Failures without a response, such as a request out of time, are retried while the lease lasts
+      }
+
+      lost_handler on_lost;
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->in_flight--;
+
+        auto lease = state->leases.find(timer.first);
+        if (lease != state->leases.end() && lease->second.generation == timer.second)
+        {
+          std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+          bool rejected = status_code == web::http::status_codes::NotFound || status_code == web::http::status_codes::Conflict || status_code == web::http::status_codes::PreconditionFailed;
+          if (renewed)
+          {
+            lease->second.expires = sent + state->lease_duration;
+            state->wheel.schedule(state->tick_of(sent + state->lease_duration / 2), timer);
+          }
+          else if (!rejected && now + retry_delay < lease->second.expires)
+          {
+            state->wheel.schedule(state->tick_of(now + retry_delay), timer);
+          }
+          else
+          {
+            on_lost = lease->second.on_lost;
+            state->leases.erase(lease);
+          }
+        }
+      }
+
+      if (on_lost)
+      {
+        on_lost(timer.first);
+      }
+
+      start_renewals(state);
+    });
+  }
+}
@@ -0,0 +1,52 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+using namespace azure::storage;
+
+#pragma once
+class lease_manager
+{
+public:
+  typedef std::function<void(const utility::string_t& lease_id)> lost_handler;
+
+  lease_manager(std::chrono::seconds lease_duration, size_t parallelism);
+  ~lease_manager();
+
+  utility::string_t acquire(cloud_blob blob, lost_handler on_lost);
+  utility::string_t acquire(cloud_blob_container container, lost_handler on_lost);
+  void release(const utility::string_t& lease_id);
+  bool is_held(const utility::string_t& lease_id) const;
+  size_t size() const;
+
+  void set_tracer(std::shared_ptr<request_tracer> tracer);
+
+private:
+  lease_manager(const lease_manager&);
+  lease_manager& operator=(const lease_manager&);
+
+  struct manager_state;
+
+  typedef std::function<pplx::task<void>(const access_condition& condition, const blob_request_options& options)> lease_operation;
+
+  utility::string_t hold(const utility::string_t& lease_id, std::chrono::steady_clock::time_point acquired, lease_operation renew, lease_operation release, lost_handler on_lost);
+  static void run_timer(std::shared_ptr<manager_state> state);
+  static void start_renewals(std::shared_ptr<manager_state> state);
+
+  std::shared_ptr<manager_state> m_state;
+  std::thread m_timer;
+  std::shared_ptr<request_tracer> m_tracer;
+};
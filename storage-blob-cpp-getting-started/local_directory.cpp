@@ -0,0 +1,247 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#include "stdafx.h"
+#include "local_directory.h"
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#endif
+
+#ifdef _WIN32
+namespace
+{
+  // Number of 100 ns intervals between 1601-01-01, the origin of the file times, and 1970-01-01
+  const uint64_t unix_epoch_file_time = 116444736000000000ULL;
+}
+#endif
+
+///
+/// Lists every regular file under 'root', with its path relative to 'root' using '/' separators. The tree is
+/// walked by 'threads' threads sharing a queue of directories still to read, so the directories with many
+/// entries do not hold up the others. The order of the files is unspecified.
+///
+std::vector<local_file> local_directory::list_files(const utility::string_t& root, size_t threads)
+{
+  std::mutex mutex;
+  std::condition_variable work_ready;
+  std::deque<utility::string_t> queue(1, utility::string_t());
+  size_t busy = 0;
+  std::exception_ptr error;
+  std::vector<local_file> result;
+
+  auto walk = [&]()
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+      // Done once the queue is empty and no thread is reading a directory that could add to it
+      work_ready.wait(lock, [&]() { return !queue.empty() || busy == 0 || error; });
+      if (queue.empty() || error)
+      {
+        work_ready.notify_all();
+        return;
+      }
+
+      utility::string_t relative = queue.front();
+      queue.pop_front();
+      busy++;
+      lock.unlock();
+
+      std::vector<utility::string_t> directories;
+      std::vector<local_file> files;
+      std::exception_ptr failure;
+      try
+      {
+        read_directory(relative.empty() ? root : root + U("/") + relative, directories, files);
+      }
+      catch (...)
+      {
+        failure = std::current_exception();
+      }
+
+      lock.lock();
+      busy--;
+      if (failure && !error)
+      {
+        error = failure;
+      }
+
+      utility::string_t prefix = relative.empty() ? relative : relative + U("/");
+      for (const utility::string_t& directory : directories)
+      {
+        queue.push_back(prefix + directory);
+      }
+
+      for (local_file& file : files)
+      {
+        file.name = prefix + file.name;
+        result.push_back(file);
+      }
+
+      work_ready.notify_all();
+    }
+  };
+
+  std::vector<std::thread> walkers;
+  for (size_t i = 1; i < threads; i++)
+  {
+    walkers.push_back(std::thread(walk));
+  }
+
+  walk();
+  for (std::thread& walker : walkers)
+  {
+    walker.join();
+  }
+
+  if (error)
+  {
+    std::rethrow_exception(error);
+  }
+
+  return result;
+}
+
+///
+/// Reads the entries of one directory, splitting the sub-directories from the regular files.
+/// Symbolic links are not followed, so a link to a parent directory cannot make the walk loop.
+///
+void local_directory::read_directory(const utility::string_t& path, std::vector<utility::string_t>& directories, std::vector<local_file>& files)
+{
+#ifdef _WIN32
+  WIN32_FIND_DATAW data;
+  HANDLE find = FindFirstFileW((path + U("\\*")).c_str(), &data);
+  if (find == INVALID_HANDLE_VALUE)
+  {
+    throw std::runtime_error("The directory could not be read");
+  }
+
+  do
+  {
+    utility::string_t name(data.cFileName);
+    if (name == U(".") || name == U("..") || (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0)
+    {
+      continue;
+    }
+
+    if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
+    {
+      directories.push_back(name);
+      continue;
+    }
+
+    uint64_t modified = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+
+    local_file file;
+    file.name = name;
+    file.size = (static_cast<utility::size64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    file.modified = static_cast<int64_t>((modified - unix_epoch_file_time) / 10000000);
+    files.push_back(file);
+  } while (FindNextFileW(find, &data));
+
+  FindClose(find);
+#else
+  DIR* directory = opendir(path.c_str());
+  if (directory == nullptr)
+  {
+    throw std::runtime_error("The directory could not be read");
+  }
+
+  while (struct dirent* entry = readdir(directory))
+  {
+    utility::string_t name(entry->d_name);
+    if (name == "." || name == "..")
+    {
+      continue;
+    }
+
+    struct stat status;
+    if (lstat((path + "/" + name).c_str(), &status) != 0)
+    {
+      continue;
+    }
+
+    if (S_ISDIR(status.st_mode))
+    {
+      directories.push_back(name);
+    }
+    else if (S_ISREG(status.st_mode))
+    {
+      local_file file;
+      file.name = name;
+      file.size = static_cast<utility::size64_t>(status.st_size);
+      file.modified = static_cast<int64_t>(status.st_mtime);
+      files.push_back(file);
+    }
+  }
+
+  closedir(directory);
+#endif
+}
+
+///
+/// Creates the directories on the path of a file relative to 'root', when they do not exist yet
+///
+void local_directory::create_parent_directories(const utility::string_t& root, const utility::string_t& name)
+{
+  for (size_t separator = name.find(U('/')); separator != utility::string_t::npos; separator = name.find(U('/'), separator + 1))
+  {
+    utility::string_t directory = root + U("/") + name.substr(0, separator);
+#ifdef _WIN32
+    CreateDirectoryW(directory.c_str(), nullptr);
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+  }
+}
+
+///
+/// Sets the last modification time of a file, in seconds since 1970-01-01
+///
+void local_directory::set_modified_time(const utility::string_t& path, int64_t modified)
+{
+#ifdef _WIN32
+  HANDLE file = CreateFileW(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    throw std::runtime_error("The file could not be opened");
+  }
+
+  uint64_t time = static_cast<uint64_t>(modified) * 10000000 + unix_epoch_file_time;
+  FILETIME file_time;
+  file_time.dwLowDateTime = static_cast<DWORD>(time);
+  file_time.dwHighDateTime = static_cast<DWORD>(time >> 32);
+  BOOL set = SetFileTime(file, nullptr, nullptr, &file_time);
+  CloseHandle(file);
+  if (!set)
+  {
+    throw std::runtime_error("The file time could not be set");
+  }
+#else
+  struct timeval times[2];
+  times[0].tv_sec = static_cast<time_t>(modified);
+  times[0].tv_usec = 0;
+  times[1] = times[0];
+  if (utimes(path.c_str(), times) != 0)
+  {
+    throw std::runtime_error("The file time could not be set");
+  }
+#endif
+}
@@ -0,0 +1,36 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#pragma once
+
+struct local_file
+{
+  utility::string_t name;
+  utility::size64_t size;
+  int64_t modified;
+};
+
+class local_directory
+{
+public:
+  static std::vector<local_file> list_files(const utility::string_t& root, size_t threads);
+  static void create_parent_directories(const utility::string_t& root, const utility::string_t& name);
+  static void set_modified_time(const utility::string_t& path, int64_t modified);
+
+private:
+  static void read_directory(const utility::string_t& path, std::vector<utility::string_t>& directories, std::vector<local_file>& files);
+};
@@ -0,0 +1,342 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "mapped_file.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::mapped_file()
+  : m_data(nullptr), m_size(0),
+#ifdef _WIN32
+  m_file(INVALID_HANDLE_VALUE), m_mapping(nullptr)
+#else
+  m_file(-1)
+#endif
+{
+}
+
+mapped_file::~mapped_file()
+{
+#ifdef _WIN32
+  if (m_data != nullptr)
+  {
+    UnmapViewOfFile(m_data);
+  }
+  if (m_mapping != nullptr)
+  {
+    CloseHandle(m_mapping);
+  }
+  if (m_file != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(m_file);
+  }
+#else
+  if (m_data != nullptr)
+  {
+    munmap(m_data, static_cast<size_t>(m_size));
+  }
+  if (m_file != -1)
+  {
+    close(m_file);
+  }
+#endif
+}
+
+///
+/// Creates (or truncates) a file with the given size and maps it in memory for writing.
+/// The file is allocated up front so independent ranges can be written at their offset in any order.
+///
+std::shared_ptr<mapped_file> mapped_file::create(const utility::string_t& file_name, utility::size64_t size)
+{
+  std::shared_ptr<mapped_file> file(new mapped_file());
+  file->m_size = size;
+
+#ifdef _WIN32
+  file->m_file = CreateFileW(file_name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file->m_file == INVALID_HANDLE_VALUE)
+  {
+    throw std::runtime_error("The file could not be created");
+  }
+
+  LARGE_INTEGER end;
+  end.QuadPart = static_cast<LONGLONG>(size);
+  if (!SetFilePointerEx(file->m_file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(file->m_file))
+  {
+    throw std::runtime_error("The file could not be allocated");
+  }
+#else
+  file->m_file = ::open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (file->m_file == -1)
+  {
+    throw std::runtime_error("The file could not be created");
+  }
+
+  if (ftruncate(file->m_file, static_cast<off_t>(size)) != 0)
+  {
+    throw std::runtime_error("The file could not be allocated");
+  }
+#endif
+
+  file->map(true);
+  return file;
+}
+
+///
+/// Opens an existing file and maps it in memory for reading. The system is told that the mapping is read
+/// sequentially, so it reads ahead and drops the pages already read first.
+///
+std::shared_ptr<mapped_file> mapped_file::open(const utility::string_t& file_name)
+{
+  std::shared_ptr<mapped_file> file(new mapped_file());
+
+#ifdef _WIN32
+  file->m_file = CreateFileW(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file->m_file == INVALID_HANDLE_VALUE)
+  {
+    throw std::runtime_error("The file could not be opened");
+  }
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file->m_file, &size))
+  {
+    throw std::runtime_error("The file size could not be read");
+  }
+
+  file->m_size = static_cast<utility::size64_t>(size.QuadPart);
+  file->map(false);
+#else
+  file->m_file = ::open(file_name.c_str(), O_RDONLY);
+  if (file->m_file == -1)
+  {
+    throw std::runtime_error("The file could not be opened");
+  }
+
+  struct stat status;
+  if (fstat(file->m_file, &status) != 0)
+  {
+    throw std::runtime_error("The file size could not be read");
+  }
+
+  file->m_size = static_cast<utility::size64_t>(status.st_size);
+  file->map(false);
+
+  if (file->m_data != nullptr)
+  {
+    // Only a hint, the mapping works the same if it is ignored
+    madvise(file->m_data, static_cast<size_t>(file->m_size), MADV_SEQUENTIAL);
+  }
+#endif
+
+  return file;
+}
+
+///
+/// Opens a file for writing in place, creating it when it does not exist, and sets its size. The content within
+/// the new size is kept. The file is made sparse, so the ranges never written take no space on disk.
+///
+std::shared_ptr<mapped_file> mapped_file::open_for_update(const utility::string_t& file_name, utility::size64_t size)
+{
+  std::shared_ptr<mapped_file> file(new mapped_file());
+  file->m_size = size;
+
+#ifdef _WIN32
+  file->m_file = CreateFileW(file_name.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file->m_file == INVALID_HANDLE_VALUE)
+  {
+    throw std::runtime_error("The file could not be opened");
+  }
+
+  // Only a hint, a file system without sparse files stores the zeros
+  DWORD returned = 0;
+  DeviceIoControl(file->m_file, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returned, nullptr);
+
+  LARGE_INTEGER end;
+  end.QuadPart = static_cast<LONGLONG>(size);
+  if (!SetFilePointerEx(file->m_file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(file->m_file))
+  {
+    throw std::runtime_error("The file could not be allocated");
+  }
+#else
+  file->m_file = ::open(file_name.c_str(), O_RDWR | O_CREAT, 0644);
+  if (file->m_file == -1)
+  {
+    throw std::runtime_error("The file could not be opened");
+  }
+
+  // A file grown by truncation is sparse on the usual file systems
+  if (ftruncate(file->m_file, static_cast<off_t>(size)) != 0)
+  {
+    throw std::runtime_error("The file could not be allocated");
+  }
+#endif
+
+  file->map(true);
+  return file;
+}
+
+///
+/// Maps the whole file in memory. Empty files are not mapped.
+///
+void mapped_file::map(bool writable)
+{
+  if (m_size == 0)
+  {
+    return;
+  }
+
+#ifdef _WIN32
+  m_mapping = CreateFileMappingW(m_file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+  if (m_mapping == nullptr)
+  {
+    throw std::runtime_error("The file could not be mapped");
+  }
+
+  m_data = static_cast<uint8_t*>(MapViewOfFile(m_mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+  if (m_data == nullptr)
+  {
+    throw std::runtime_error("The file could not be mapped");
+  }
+#else
+  void* data = mmap(nullptr, static_cast<size_t>(m_size), writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m_file, 0);
+  if (data == MAP_FAILED)
+  {
+    throw std::runtime_error("The file could not be mapped");
+  }
+
+  m_data = static_cast<uint8_t*>(data);
+#endif
+}
+
+uint8_t* mapped_file::data() const
+{
+  return m_data;
+}
+
+utility::size64_t mapped_file::size() const
+{
+  return m_size;
+}
+
+///
+/// Writes the modified pages of the mapping back to the file
+///
+void mapped_file::flush() const
+{
+  if (m_data == nullptr)
+  {
+    return;
+  }
+
+#ifdef _WIN32
+  if (!FlushViewOfFile(m_data, 0))
+  {
+    throw std::runtime_error("The file could not be flushed");
+  }
+#else
+  if (msync(m_data, static_cast<size_t>(m_size), MS_SYNC) != 0)
+  {
+    throw std::runtime_error("The file could not be flushed");
+  }
+#endif
+}
+
+///
+/// Returns a stream reading a range of the mapping in place, without copying it. The file must stay
+/// alive until the stream is no longer used.
+///
+concurrency::streams::istream mapped_file::view(utility::size64_t offset, utility::size64_t length) const
+{
+  if (offset > m_size || length > m_size - offset)
+  {
+    throw std::out_of_range("The range is outside of the file");
+  }
+
+  if (length == 0)
+  {
+    return concurrency::streams::bytestream::open_istream(std::vector<uint8_t>());
+  }
+
+  concurrency::streams::rawptr_buffer<uint8_t> buffer(static_cast<const uint8_t*>(m_data + offset), static_cast<size_t>(length), std::ios::in);
+  return concurrency::streams::istream(buffer);
+}
+
+///
+/// Zeroes a range of a writable mapping. Where the file system allows it, the range is deallocated from the file
+/// instead of being written, so cleared ranges take no space on disk.
+///
+void mapped_file::clear(utility::size64_t offset, utility::size64_t length) const
+{
+  if (offset > m_size || length > m_size - offset)
+  {
+    throw std::out_of_range("The range is outside of the file");
+  }
+
+  if (length == 0)
+  {
+    return;
+  }
+
+#ifdef _WIN32
+  FILE_ZERO_DATA_INFORMATION zero;
+  zero.FileOffset.QuadPart = static_cast<LONGLONG>(offset);
+  zero.BeyondFinalZero.QuadPart = static_cast<LONGLONG>(offset + length);
+  DWORD returned = 0;
+  if (DeviceIoControl(m_file, FSCTL_SET_ZERO_DATA, &zero, sizeof(zero), nullptr, 0, &returned, nullptr))
+  {
+    return;
+  }
+#elif defined(FALLOC_FL_PUNCH_HOLE)
+  if (fallocate(m_file, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(offset), static_cast<off_t>(length)) == 0)
+  {
+    return;
+  }
+#endif
+
+  std::memset(m_data + offset, 0, static_cast<size_t>(length));
+}
+
+///
+/// Tells the system that a range of a read-only mapping is not needed anymore, so its pages leave the
+/// memory of the process right away. Reading the range again reads it from the file.
+///
+void mapped_file::release(utility::size64_t offset, utility::size64_t length) const
+{
+#ifndef _WIN32
+  if (m_data == nullptr)
+  {
+    return;
+  }
+
+  // Only the pages entirely inside the range are released
+  utility::size64_t page = static_cast<utility::size64_t>(sysconf(_SC_PAGESIZE));
+  utility::size64_t start = (offset + page - 1) / page * page;
+  utility::size64_t end = std::min(offset + length, m_size) / page * page;
+  if (start < end)
+  {
+    madvise(m_data + start, static_cast<size_t>(end - start), MADV_DONTNEED);
+  }
+#else
+  // The pages of a file mapping are trimmed from the working set by the system
+  (void)offset;
+  (void)length;
+#endif
+}
@@ -0,0 +1,50 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#pragma once
+class mapped_file
+{
+public:
+  ~mapped_file();
+
+  static std::shared_ptr<mapped_file> create(const utility::string_t& file_name, utility::size64_t size);
+  static std::shared_ptr<mapped_file> open(const utility::string_t& file_name);
+  static std::shared_ptr<mapped_file> open_for_update(const utility::string_t& file_name, utility::size64_t size);
+
+  uint8_t* data() const;
+  utility::size64_t size() const;
+  void flush() const;
+
+  concurrency::streams::istream view(utility::size64_t offset, utility::size64_t length) const;
+  void release(utility::size64_t offset, utility::size64_t length) const;
+  void clear(utility::size64_t offset, utility::size64_t length) const;
+
+private:
+  mapped_file();
+  mapped_file(const mapped_file&);
+  mapped_file& operator=(const mapped_file&);
+
+  void map(bool writable);
+
+  uint8_t* m_data;
+  utility::size64_t m_size;
+#ifdef _WIN32
+  HANDLE m_file;
+  HANDLE m_mapping;
+#else
+  int m_file;
+#endif
+};
@@ -0,0 +1,336 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#include "stdafx.h"
+#include "md5.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MD5_HASH_SSE2
+#endif
+
+namespace
+{
+  // Per round shift amounts and sine derived constants of RFC 1321
+  const uint32_t shifts[64] =
+  {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+  };
+
+  const uint32_t constants[64] =
+  {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+  };
+
+  uint32_t rotate_left(uint32_t value, uint32_t count)
+  {
+    return (value << count) | (value >> (32 - count));
+  }
+
+  uint32_t read_word(const uint8_t* data)
+  {
+    return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8) |
+      (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+  }
+
+#ifdef MD5_HASH_SSE2
+  const size_t lane_count = 4;
+
+  __m128i rotate_left(__m128i value, uint32_t count)
+  {
+    return _mm_or_si128(_mm_sll_epi32(value, _mm_cvtsi32_si128(static_cast<int>(count))),
+      _mm_srl_epi32(value, _mm_cvtsi32_si128(static_cast<int>(32 - count))));
+  }
+
+  ///
+  /// Runs the MD5 compression function on one 64 byte block of each of 4 independent messages, one message
+  /// per 32 bit lane. MD5 can not be split within a message, but the same instructions apply to all the lanes.
+  ///
+  void transform_lanes(__m128i state[4], const uint8_t* const blocks[lane_count])
+  {
+    __m128i words[16];
+    for (size_t i = 0; i < 16; i++)
+    {
+      words[i] = _mm_set_epi32(static_cast<int>(read_word(blocks[3] + i * 4)), static_cast<int>(read_word(blocks[2] + i * 4)),
+        static_cast<int>(read_word(blocks[1] + i * 4)), static_cast<int>(read_word(blocks[0] + i * 4)));
+    }
+
+    const __m128i ones = _mm_set1_epi32(-1);
+    __m128i a = state[0];
+    __m128i b = state[1];
+    __m128i c = state[2];
+    __m128i d = state[3];
+
+    for (size_t i = 0; i < 64; i++)
+    {
+      __m128i f;
+      size_t g;
+      if (i < 16)
+      {
+        f = _mm_or_si128(_mm_and_si128(b, c), _mm_andnot_si128(b, d));
+        g = i;
+      }
+      else if (i < 32)
+      {
+        f = _mm_or_si128(_mm_and_si128(d, b), _mm_andnot_si128(d, c));
+        g = (5 * i + 1) % 16;
+      }
+      else if (i < 48)
+      {
+        f = _mm_xor_si128(_mm_xor_si128(b, c), d);
+        g = (3 * i + 5) % 16;
+      }
+      else
+      {
+        f = _mm_xor_si128(c, _mm_or_si128(b, _mm_xor_si128(d, ones)));
+        g = (7 * i) % 16;
+      }
+
+      __m128i sum = _mm_add_epi32(_mm_add_epi32(a, f), _mm_add_epi32(_mm_set1_epi32(static_cast<int>(constants[i])), words[g]));
+      a = d;
+      d = c;
+      c = b;
+      b = _mm_add_epi32(b, rotate_left(sum, shifts[i]));
+    }
+
+    state[0] = _mm_add_epi32(state[0], a);
+    state[1] = _mm_add_epi32(state[1], b);
+    state[2] = _mm_add_epi32(state[2], c);
+    state[3] = _mm_add_epi32(state[3], d);
+  }
+#endif
+}
+
+///
+/// Computes the MD5 hash used by the storage service to check the integrity of the content it receives
+/// and stores (the Content-MD5 header). Data can be added in any number of pieces.
+///
+md5_hash::md5_hash()
+  : m_length(0)
+{
+  m_state[0] = 0x67452301;
+  m_state[1] = 0xefcdab89;
+  m_state[2] = 0x98badcfe;
+  m_state[3] = 0x10325476;
+}
+
+void md5_hash::update(const uint8_t* data, size_t length)
+{
+  size_t buffered = static_cast<size_t>(m_length % 64);
+  m_length += length;
+
+  if (buffered > 0)
+  {
+    size_t count = std::min(length, 64 - buffered);
+    std::memcpy(m_buffer + buffered, data, count);
+    data += count;
+    length -= count;
+    buffered += count;
+
+    if (buffered < 64)
+    {
+      return;
+    }
+
+    transform(m_buffer);
+  }
+
+  // Whole blocks are hashed in place
+  for (; length >= 64; data += 64, length -= 64)
+  {
+    transform(data);
+  }
+
+  std::memcpy(m_buffer, data, length);
+}
+
+///
+/// Pads the data and returns the hash. The object must not be updated afterwards.
+///
+md5_hash::digest md5_hash::finish()
+{
+  uint64_t bit_length = m_length * 8;
+
+  uint8_t padding[64] = { 0x80 };
+  size_t buffered = static_cast<size_t>(m_length % 64);
+  update(padding, buffered < 56 ? 56 - buffered : 120 - buffered);
+
+  uint8_t length_bytes[8];
+  for (size_t i = 0; i < 8; i++)
+  {
+    length_bytes[i] = static_cast<uint8_t>(bit_length >> (8 * i));
+  }
+  update(length_bytes, 8);
+
+  digest result;
+  for (size_t i = 0; i < 16; i++)
+  {
+    result[i] = static_cast<uint8_t>(m_state[i / 4] >> (8 * (i % 4)));
+  }
+
+  return result;
+}
+
+md5_hash::digest md5_hash::compute(const uint8_t* data, size_t length)
+{
+  md5_hash hash;
+  hash.update(data, length);
+  return hash.finish();
+}
+
+///
+/// Adds 'length' bytes to each of 'count' hashes, from a different buffer for each. With SSE2, the whole 64 byte
+/// blocks of 4 messages are hashed at once, which is close to 4 times the speed of hashing them one after another.
+/// The hashes must be at a 64 byte boundary (for example new ones) to use the parallel path.
+///
+void md5_hash::update_parallel(md5_hash* hashes, const uint8_t* const* data, size_t count, size_t length)
+{
+  size_t first = 0;
+
+#ifdef MD5_HASH_SSE2
+  bool aligned = true;
+  for (size_t i = 0; i < count; i++)
+  {
+    aligned = aligned && hashes[i].m_length % 64 == 0;
+  }
+
+  // Groups of at least two messages are hashed together, a last single message is hashed alone below
+  for (; aligned && length >= 64 && first + 1 < count; first += lane_count)
+  {
+    // Unused lanes hash the first message of the group again, their result is dropped
+    size_t lanes = std::min(lane_count, count - first);
+    const uint8_t* blocks[lane_count];
+    uint32_t values[4][lane_count];
+    for (size_t lane = 0; lane < lane_count; lane++)
+    {
+      size_t source = first + (lane < lanes ? lane : 0);
+      blocks[lane] = data[source];
+      for (size_t word = 0; word < 4; word++)
+      {
+        values[word][lane] = hashes[source].m_state[word];
+      }
+    }
+
+    __m128i state[4];
+    for (size_t word = 0; word < 4; word++)
+    {
+      state[word] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values[word]));
+    }
+
+    size_t processed = 0;
+    for (; processed + 64 <= length; processed += 64)
+    {
+      transform_lanes(state, blocks);
+      for (size_t lane = 0; lane < lane_count; lane++)
+      {
+        blocks[lane] += 64;
+      }
+    }
+
+    for (size_t word = 0; word < 4; word++)
+    {
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(values[word]), state[word]);
+    }
+
+    for (size_t lane = 0; lane < lanes; lane++)
+    {
+      md5_hash& hash = hashes[first + lane];
+      for (size_t word = 0; word < 4; word++)
+      {
+        hash.m_state[word] = values[word][lane];
+      }
+
+      hash.m_length += processed;
+      hash.update(data[first + lane] + processed, length - processed);
+    }
+  }
+#endif
+
+  for (size_t i = first; i < count; i++)
+  {
+    hashes[i].update(data[i], length);
+  }
+}
+
+///
+/// Encodes a hash the way the service expects it in the Content-MD5 header
+///
+utility::string_t md5_hash::to_base64(const digest& value)
+{
+  return utility::conversions::to_base64(std::vector<unsigned char>(value.begin(), value.end()));
+}
+
+void md5_hash::transform(const uint8_t* block)
+{
+  uint32_t words[16];
+  for (size_t i = 0; i < 16; i++)
+  {
+    words[i] = read_word(block + i * 4);
+  }
+
+  uint32_t a = m_state[0];
+  uint32_t b = m_state[1];
+  uint32_t c = m_state[2];
+  uint32_t d = m_state[3];
+
+  for (size_t i = 0; i < 64; i++)
+  {
+    uint32_t f;
+    size_t g;
+    if (i < 16)
+    {
+      f = (b & c) | (~b & d);
+      g = i;
+    }
+    else if (i < 32)
+    {
+      f = (d & b) | (~d & c);
+      g = (5 * i + 1) % 16;
+    }
+    else if (i < 48)
+    {
+      f = b ^ c ^ d;
+      g = (3 * i + 5) % 16;
+    }
+    else
+    {
+      f = c ^ (b | ~d);
+      g = (7 * i) % 16;
+    }
+
+    uint32_t rotated = rotate_left(a + f + constants[i] + words[g], shifts[i]);
+    a = d;
+    d = c;
+    c = b;
+    b = b + rotated;
+  }
+
+  m_state[0] += a;
+  m_state[1] += b;
+  m_state[2] += c;
+  m_state[3] += d;
+}
@@ -0,0 +1,39 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#pragma once
+class md5_hash
+{
+public:
+  typedef std::array<uint8_t, 16> digest;
+
+  md5_hash();
+
+  void update(const uint8_t* data, size_t length);
+  digest finish();
+
+  static digest compute(const uint8_t* data, size_t length);
+  static void update_parallel(md5_hash* hashes, const uint8_t* const* data, size_t count, size_t length);
+  static utility::string_t to_base64(const digest& value);
+
+private:
+  void transform(const uint8_t* block);
+
+  uint32_t m_state[4];
+  uint64_t m_length;
+  uint8_t m_buffer[64];
+};
@@ -0,0 +1,1634 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+#include "stdafx.h"
+#include "mock_blob_service.h"
+
+using namespace web::http;
+
+namespace
+{
+  const utility::string_t account_name(U("devstoreaccount1"));
+  const utility::string_t account_key(U("Eby8vdM02xNOcqFlqUwJPLlmEtlCDXJ1OUzFT50uSRZ6IFsuFq2UVErCz4I6tq/K1SZFPTOtr/KBHBeksoGMGw=="));
+  const utility::size64_t page_size = 512;
+  const size_t default_max_results = 5000;
+  const char* const default_service_properties =
+    "<?xml version=\"1.0\" encoding=\"utf-8\"?><StorageServiceProperties>"
+    "<Logging><Version>1.0</Version><Delete>false</Delete><Read>false</Read><Write>false</Write><RetentionPolicy><Enabled>false</Enabled></RetentionPolicy></Logging>"
+    "<HourMetrics><Version>1.0</Version><Enabled>false</Enabled><RetentionPolicy><Enabled>false</Enabled></RetentionPolicy></HourMetrics>"
+    "<MinuteMetrics><Version>1.0</Version><Enabled>false</Enabled><RetentionPolicy><Enabled>false</Enabled></RetentionPolicy></MinuteMetrics>"
+    "<Cors /></StorageServiceProperties>";
+
+  struct mock_lease
+  {
+    mock_lease() : duration(0), infinite(false) {}
+
+    utility::string_t id;
+    std::chrono::steady_clock::time_point expiry;
+    std::chrono::seconds duration;
+    bool infinite;
+
+    bool active() const
+    {
+      return !id.empty() && (infinite || std::chrono::steady_clock::now() < expiry);
+    }
+  };
+
+  struct mock_blob
+  {
+    mock_blob() : committed_block_count(0) {}
+
+    utility::string_t type;
+    std::vector<uint8_t> data;
+    std::vector<std::pair<utility::string_t, utility::size64_t>> committed_blocks;
+    std::map<utility::string_t, std::vector<uint8_t>> uncommitted_blocks;
+    std::vector<bool> written_pages;
+    size_t committed_block_count;
+    std::map<utility::string_t, utility::string_t> metadata;
+    std::map<utility::string_t, utility::string_t> properties;
+    utility::string_t etag;
+    utility::string_t last_modified;
+    utility::string_t copy_id;
+    mock_lease lease;
+  };
+
+  struct mock_container
+  {
+    std::map<utility::string_t, mock_blob> blobs;
+    std::map<utility::string_t, std::map<utility::string_t, mock_blob>> snapshots;
+    utility::string_t acl;
+    std::map<utility::string_t, utility::string_t> metadata;
+    utility::string_t etag;
+    utility::string_t last_modified;
+    mock_lease lease;
+  };
+
+  // The blob headers that are stored as properties and returned on reads, with the name they are returned with
+  const std::pair<const utility::char_t*, const utility::char_t*> property_headers[] =
+  {
+    std::make_pair(U("x-ms-blob-content-type"), U("Content-Type")),
+    std::make_pair(U("x-ms-blob-content-encoding"), U("Content-Encoding")),
+    std::make_pair(U("x-ms-blob-content-language"), U("Content-Language")),
+    std::make_pair(U("x-ms-blob-content-md5"), U("Content-MD5")),
+    std::make_pair(U("x-ms-blob-cache-control"), U("Cache-Control")),
+    std::make_pair(U("x-ms-blob-content-disposition"), U("Content-Disposition")),
+  };
+
+  // The copy properties, returned as headers on reads, with the name they are listed with
+  const std::pair<const utility::char_t*, const utility::char_t*> copy_properties[] =
+  {
+    std::make_pair(U("x-ms-copy-id"), U("CopyId")),
+    std::make_pair(U("x-ms-copy-source"), U("CopySource")),
+    std::make_pair(U("x-ms-copy-status"), U("CopyStatus")),
+    std::make_pair(U("x-ms-copy-progress"), U("CopyProgress")),
+  };
+
+  ///
+  /// A failed request, turned into an error response with the storage service error format
+  ///
+  struct mock_error
+  {
+    mock_error(status_code status, const utility::string_t& code) : status(status), code(code) {}
+
+    status_code status;
+    utility::string_t code;
+  };
+
+  template<typename T>
+  utility::string_t to_string_t(T value)
+  {
+    utility::ostringstream_t stream;
+    stream << value;
+    return stream.str();
+  }
+
+  utility::size64_t to_size(const utility::string_t& value)
+  {
+    utility::istringstream_t stream(value);
+    utility::size64_t result = 0;
+    stream >> result;
+    return result;
+  }
+
+  utility::string_t header(const http_request& request, const utility::string_t& name)
+  {
+    auto it = request.headers().find(name);
+    return it != request.headers().end() ? it->second : utility::string_t();
+  }
+
+  utility::string_t xml_escape(const utility::string_t& value)
+  {
+    utility::string_t escaped;
+    for (utility::char_t c : value)
+    {
+      switch (c)
+      {
+      case U('&'): escaped += U("&amp;"); break;
+      case U('<'): escaped += U("&lt;"); break;
+      case U('>'): escaped += U("&gt;"); break;
+      case U('"'): escaped += U("&quot;"); break;
+      default: escaped += c; break;
+      }
+    }
+
+    return escaped;
+  }
+
+  ///
+  /// Parses a "bytes=start-end" range header. Returns false if there is no range.
+  ///
+  bool parse_range(const utility::string_t& value, utility::size64_t& start, utility::size64_t& end)
+  {
+    size_t equals = value.find(U('='));
+    size_t dash = value.find(U('-'), equals);
+    if (equals == utility::string_t::npos || dash == utility::string_t::npos)
+    {
+      return false;
+    }
+
+    start = to_size(value.substr(equals + 1, dash - equals - 1));
+    utility::string_t last = value.substr(dash + 1);
+    end = last.empty() ? std::numeric_limits<utility::size64_t>::max() : to_size(last);
+    return true;
+  }
+
+  bool parse_request_range(const http_request& request, utility::size64_t& start, utility::size64_t& end)
+  {
+    utility::string_t range = header(request, U("x-ms-range"));
+    if (range.empty())
+    {
+      range = header(request, U("Range"));
+    }
+
+    return parse_range(range, start, end);
+  }
+
+  void check_lease(const mock_lease& lease, const http_request& request)
+  {
+    utility::string_t lease_id = header(request, U("x-ms-lease-id"));
+    if (lease.active())
+    {
+      if (lease_id.empty())
+      {
+        throw mock_error(status_codes::PreconditionFailed, U("LeaseIdMissing"));
+      }
+
+      if (lease_id != lease.id)
+      {
+        throw mock_error(status_codes::PreconditionFailed, U("LeaseIdMismatchWithBlobOperation"));
+      }
+    }
+    else if (!lease_id.empty())
+    {
+      throw mock_error(status_codes::PreconditionFailed, U("LeaseNotPresentWithBlobOperation"));
+    }
+  }
+
+  ///
+  /// Checks the If-Match and If-None-Match conditions of a request as the service does: a read whose If-None-Match
+  /// matches is answered with 304 (not modified), a write with 409 when the condition is '*' and 412 otherwise.
+  ///
+  void check_etag(const utility::string_t& etag, const http_request& request)
+  {
+    utility::string_t if_match = header(request, U("If-Match"));
+    if (!if_match.empty() && if_match != U("*") && if_match != etag)
+    {
+      throw mock_error(status_codes::PreconditionFailed, U("ConditionNotMet"));
+    }
+
+    utility::string_t if_none_match = header(request, U("If-None-Match"));
+    if (!if_none_match.empty() && (if_none_match == U("*") || if_none_match == etag))
+    {
+      if (request.method() == methods::GET || request.method() == methods::HEAD)
+      {
+        throw mock_error(status_codes::NotModified, U("ConditionNotMet"));
+      }
+
+      throw if_none_match == U("*") ? mock_error(status_codes::Conflict, U("BlobAlreadyExists")) : mock_error(status_codes::PreconditionFailed, U("ConditionNotMet"));
+    }
+  }
+
+  ///
+  /// Runs functions at a given point in time on a single thread, used to delay the responses
+  /// without blocking the threads of the listener.
+  ///
+  class delay_scheduler
+  {
+  public:
+    delay_scheduler() : m_stopped(true) {}
+    ~delay_scheduler() { stop(); }
+
+    void start()
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (!m_stopped)
+      {
+        return;
+      }
+
+      m_stopped = false;
+      m_thread = std::thread([this]() { run(); });
+    }
+
+    void stop()
+    {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopped)
+        {
+          return;
+        }
+
+        m_stopped = true;
+      }
+
+      m_wake.notify_all();
+      m_thread.join();
+    }
+
+    void schedule(std::chrono::steady_clock::time_point when, std::function<void()> action)
+    {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stopped)
+        {
+          // Requests still being processed after the service is closed are answered right away
+          lock.unlock();
+          action();
+          return;
+        }
+
+        m_actions.insert(std::make_pair(when, action));
+      }
+
+      m_wake.notify_all();
+    }
+
+  private:
+    void run()
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (!m_stopped || !m_actions.empty())
+      {
+        if (m_actions.empty())
+        {
+          m_wake.wait(lock);
+          continue;
+        }
+
+        auto next = m_actions.begin();
+        if (!m_stopped && next->first > std::chrono::steady_clock::now())
+        {
+          m_wake.wait_until(lock, next->first);
+          continue;
+        }
+
+        std::function<void()> action = next->second;
+        m_actions.erase(next);
+
+        lock.unlock();
+        action();
+        lock.lock();
+      }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> m_actions;
+    std::thread m_thread;
+    bool m_stopped;
+  };
+
+  ///
+  /// Writes each run of consecutive pages set in 'pages' as a range of a page list
+  ///
+  void write_page_ranges(utility::ostringstream_t& xml, const utility::char_t* element, const std::vector<bool>& pages)
+  {
+    for (size_t page = 0; page < pages.size(); page++)
+    {
+      if (!pages[page])
+      {
+        continue;
+      }
+
+      size_t last = page;
+      while (last + 1 < pages.size() && pages[last + 1])
+      {
+        last++;
+      }
+
+      xml << U("<") << element << U("><Start>") << page * page_size << U("</Start><End>") << (last + 1) * page_size - 1
+        << U("</End></") << element << U(">");
+      page = last;
+    }
+  }
+}
+
+struct mock_blob_service::service_state
+{
+  service_state(const utility::string_t& endpoint)
+    : endpoint(endpoint), listener(web::uri(endpoint)), latency(0), bandwidth(0), error_rate(0),
+    error_status(status_codes::ServiceUnavailable), service_properties(default_service_properties), etag_counter(0), random(std::random_device()())
+  {
+  }
+
+  static void handle(std::shared_ptr<service_state> state, http_request request);
+  size_t process(const http_request& request, const std::vector<unsigned char>& body, http_response& response);
+
+  size_t process_account(const http_request& request, const std::vector<unsigned char>& body,
+    const std::map<utility::string_t, utility::string_t>& query, http_response& response);
+  size_t process_container(const http_request& request, const std::vector<unsigned char>& body,
+    const std::map<utility::string_t, utility::string_t>& query, const utility::string_t& container_name, http_response& response);
+  size_t process_blob(const http_request& request, const std::vector<unsigned char>& body, const std::map<utility::string_t, utility::string_t>& query,
+    const utility::string_t& container_name, const utility::string_t& blob_name, http_response& response);
+
+  size_t process_snapshot(const http_request& request, const std::map<utility::string_t, utility::string_t>& query, mock_container& container,
+    const utility::string_t& blob_name, const utility::string_t& snapshot_time, const utility::string_t& comp, http_response& response);
+
+  size_t list_containers(const std::map<utility::string_t, utility::string_t>& query, http_response& response);
+  size_t list_blobs(const mock_container& container, const utility::string_t& container_name, const std::map<utility::string_t, utility::string_t>& query, http_response& response);
+  size_t get_blob(const http_request& request, const mock_blob& blob, http_response& response);
+  size_t lease(const http_request& request, mock_lease& lease, http_response& response);
+
+  void put_block_list(mock_blob& blob, const std::vector<unsigned char>& body);
+  void copy_blob(mock_blob& target, const utility::string_t& source);
+  void touch(utility::string_t& etag, utility::string_t& last_modified);
+  static void set_blob_headers(const mock_blob& blob, http_response& response);
+  static void set_xml_body(http_response& response, const utility::string_t& xml, size_t& size);
+
+  utility::string_t endpoint;
+  web::http::experimental::listener::http_listener listener;
+  delay_scheduler scheduler;
+
+  std::chrono::microseconds latency;
+  utility::size64_t bandwidth;
+  double error_rate;
+  status_code error_status;
+
+  std::mutex mutex;
+  std::map<utility::string_t, mock_container> containers;
+  std::string service_properties;
+  uint64_t etag_counter;
+  std::mt19937 random;
+};
+
+///
+/// Creates an in-process stand-in for the blob service, listening on the given endpoint (for example
+/// http://127.0.0.1:10000). It keeps containers and blobs in memory and implements the operations used by
+/// the samples: containers, Put Blob, Put Block, Put Block List, Get Block List, Get Blob with ranges,
+/// Put Page, Get Page Ranges, Append Block, properties, metadata, listing, copy and leases.
+/// Requests are not authenticated.
+///
+mock_blob_service::mock_blob_service(const utility::string_t& endpoint)
+  : m_state(std::make_shared<service_state>(endpoint))
+{
+  // The listener belongs to the state, so its handler only holds a weak reference to it
+  std::weak_ptr<service_state> weak_state = m_state;
+  m_state->listener.support([weak_state](http_request request)
+  {
+    std::shared_ptr<service_state> state = weak_state.lock();
+    if (state)
+    {
+      service_state::handle(state, request);
+    }
+  });
+}
+
+mock_blob_service::~mock_blob_service()
+{
+  try
+  {
+    close();
+  }
+  catch (...)
+  {
+  }
+}
+
+///
+/// Adds a fixed delay to every response
+///
+void mock_blob_service::set_latency(std::chrono::microseconds latency)
+{
+  std::lock_guard<std::mutex> lock(m_state->mutex);
+  m_state->latency = latency;
+}
+
+///
+/// Delays every response by the time needed to transfer its request and response bodies at the given rate.
+/// Zero means unlimited.
+///
+void mock_blob_service::set_bandwidth(utility::size64_t bytes_per_second)
+{
+  std::lock_guard<std::mutex> lock(m_state->mutex);
+  m_state->bandwidth = bytes_per_second;
+}
+
+///
+/// Fails the given fraction of the requests with an error status, 503 (server busy) or 500 for example
+///
+void mock_blob_service::set_error_rate(double probability, status_code status_code)
+{
+  std::lock_guard<std::mutex> lock(m_state->mutex);
+  m_state->error_rate = probability;
+  m_state->error_status = status_code;
+}
+
+void mock_blob_service::open()
+{
+  m_state->scheduler.start();
+  m_state->listener.open().wait();
+}
+
+void mock_blob_service::close()
+{
+  m_state->listener.close().wait();
+  m_state->scheduler.stop();
+}
+
+///
+/// Returns the connection string to use with cloud_storage_account::parse to send the requests to this service
+///
+utility::string_t mock_blob_service::connection_string() const
+{
+  utility::string_t endpoint = m_state->endpoint;
+  if (!endpoint.empty() && endpoint.back() == U('/'))
+  {
+    endpoint.pop_back();
+  }
+
+  return U("DefaultEndpointsProtocol=http;AccountName=") + account_name + U(";AccountKey=") + account_key +
+    U(";BlobEndpoint=") + endpoint + U("/") + account_name;
+}
+
+///
+/// Reads the request body, processes the request and sends the response once the simulated
+/// latency and transfer time have elapsed. The state is kept alive until the request is processed.
+///
+void mock_blob_service::service_state::handle(std::shared_ptr<service_state> state, http_request request)
+{
+  request.extract_vector().then([state, request](pplx::task<std::vector<unsigned char>> body_task)
+  {
+    std::vector<unsigned char> body;
+    try
+    {
+      body = body_task.get();
+    }
+    catch (...)
+    {
+    }
+
+    http_response response;
+    size_t response_size = state->process(request, body, response);
+
+    std::chrono::microseconds delay;
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      delay = state->latency;
+      if (state->bandwidth > 0)
+      {
+        delay += std::chrono::microseconds((body.size() + response_size) * 1000000 / state->bandwidth);
+      }
+    }
+
+    if (delay.count() == 0)
+    {
+      request.reply(response);
+      return;
+    }
+
+    state->scheduler.schedule(std::chrono::steady_clock::now() + delay, [request, response]()
+    {
+      request.reply(response);
+    });
+  });
+}
+
+///
+/// Dispatches a request to the account, container or blob handlers and turns failures into error responses.
+/// Returns the size of the response body.
+///
+size_t mock_blob_service::service_state::process(const http_request& request, const std::vector<unsigned char>& body, http_response& response)
+{
+  size_t size = 0;
+  response.headers().add(U("x-ms-request-id"), utility::uuid_to_string(utility::new_uuid()));
+  response.headers().add(U("x-ms-version"), U("2015-04-05"));
+  response.headers().add(U("Date"), utility::datetime::utc_now().to_string(utility::datetime::RFC_1123));
+
+  try
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (error_rate > 0 && std::uniform_real_distribution<double>(0, 1)(random) < error_rate)
+    {
+      throw mock_error(error_status, error_status == status_codes::ServiceUnavailable ? U("ServerBusy") : U("InternalError"));
+    }
+
+    std::vector<utility::string_t> segments = web::uri::split_path(request.request_uri().path());
+    std::map<utility::string_t, utility::string_t> query = web::uri::split_query(request.request_uri().query());
+    for (auto& parameter : query)
+    {
+      parameter.second = web::uri::decode(parameter.second);
+    }
+
+    if (segments.empty() || web::uri::decode(segments[0]) != account_name)
+    {
+      throw mock_error(status_codes::BadRequest, U("InvalidUri"));
+    }
+
+    if (segments.size() == 1)
+    {
+      return process_account(request, body, query, response);
+    }
+
+    utility::string_t container_name = web::uri::decode(segments[1]);
+    if (segments.size() == 2)
+    {
+      return process_container(request, body, query, container_name, response);
+    }
+
+    utility::string_t blob_name;
+    for (size_t i = 2; i < segments.size(); i++)
+    {
+      blob_name += (i > 2 ? U("/") : U("")) + web::uri::decode(segments[i]);
+    }
+
+    return process_blob(request, body, query, container_name, blob_name, response);
+  }
+  catch (const mock_error& e)
+  {
+    response = http_response(e.status);
+    response.headers().add(U("x-ms-error-code"), e.code);
+    if (e.status == status_codes::NotModified)
+    {
+      return 0;
+    }
+
+    set_xml_body(response, U("<?xml version=\"1.0\" encoding=\"utf-8\"?><Error><Code>") + e.code + U("</Code><Message>") + e.code + U("</Message></Error>"), size);
+    return size;
+  }
+}
+
+size_t mock_blob_service::service_state::process_account(const http_request& request, const std::vector<unsigned char>& body,
+  const std::map<utility::string_t, utility::string_t>& query, http_response& response)
+{
+  auto comp = query.find(U("comp"));
+  if (request.method() == methods::GET && comp != query.end() && comp->second == U("list"))
+  {
+    return list_containers(query, response);
+  }
+
+  auto restype = query.find(U("restype"));
+  if (restype != query.end() && restype->second == U("service") && comp != query.end() && comp->second == U("properties"))
+  {
+    if (request.method() == methods::PUT)
+    {
+      service_properties.assign(body.begin(), body.end());
+      response.set_status_code(status_codes::Accepted);
+      return 0;
+    }
+
+    size_t size = service_properties.size();
+    response.set_status_code(status_codes::OK);
+    response.set_body(service_properties, "application/xml");
+    return size;
+  }
+
+  throw mock_error(status_codes::BadRequest, U("UnsupportedOperation"));
+}
+
+size_t mock_blob_service::service_state::process_container(const http_request& request, const std::vector<unsigned char>& body,
+  const std::map<utility::string_t, utility::string_t>& query, const utility::string_t& container_name, http_response& response)
+{
+  auto restype = query.find(U("restype"));
+  if (restype == query.end() || restype->second != U("container"))
+  {
+    throw mock_error(status_codes::BadRequest, U("InvalidQueryParameterValue"));
+  }
+
+  auto comp_parameter = query.find(U("comp"));
+  utility::string_t comp = comp_parameter != query.end() ? comp_parameter->second : utility::string_t();
+  auto container = containers.find(container_name);
+
+  if (request.method() == methods::PUT && comp.empty())
+  {
+    if (container != containers.end())
+    {
+      throw mock_error(status_codes::Conflict, U("ContainerAlreadyExists"));
+    }
+
+    mock_container& created = containers[container_name];
+    touch(created.etag, created.last_modified);
+    response.set_status_code(status_codes::Created);
+    response.headers().add(U("ETag"), created.etag);
+    response.headers().add(U("Last-Modified"), created.last_modified);
+    return 0;
+  }
+
+  if (container == containers.end())
+  {
+    throw mock_error(status_codes::NotFound, U("ContainerNotFound"));
+  }
+
+  if (request.method() == methods::DEL && comp.empty())
+  {
+    check_lease(container->second.lease, request);
+    containers.erase(container);
+    response.set_status_code(status_codes::Accepted);
+    return 0;
+  }
+
+  if ((request.method() == methods::GET || request.method() == methods::HEAD) && comp.empty())
+  {
+    response.set_status_code(status_codes::OK);
+    response.headers().add(U("ETag"), container->second.etag);
+    response.headers().add(U("Last-Modified"), container->second.last_modified);
+    for (const auto& metadata : container->second.metadata)
+    {
+      response.headers().add(U("x-ms-meta-") + metadata.first, metadata.second);
+    }
+    return 0;
+  }
+
+  if (request.method() == methods::GET && comp == U("list"))
+  {
+    return list_blobs(container->second, container_name, query, response);
+  }
+
+  if (request.method() == methods::PUT && comp == U("metadata"))
+  {
+    container->second.metadata.clear();
+    for (const auto& h : request.headers())
+    {
+      if (h.first.compare(0, 10, U("x-ms-meta-")) == 0)
+      {
+        container->second.metadata[h.first.substr(10)] = h.second;
+      }
+    }
+
+    touch(container->second.etag, container->second.last_modified);
+    response.set_status_code(status_codes::OK);
+    response.headers().add(U("ETag"), container->second.etag);
+    response.headers().add(U("Last-Modified"), container->second.last_modified);
+    return 0;
+  }
+
+  if (request.method() == methods::PUT && comp == U("lease"))
+  {
+    return lease(request, container->second.lease, response);
+  }
+
+  if (comp == U("acl"))
+  {
+    mock_container& target = container->second;
+    if (request.method() == methods::PUT)
+    {
+      target.acl = utility::conversions::to_string_t(std::string(body.begin(), body.end()));
+      touch(target.etag, target.last_modified);
+    }
+
+    size_t size = 0;
+    response.set_status_code(status_codes::OK);
+    response.headers().add(U("ETag"), target.etag);
+    response.headers().add(U("Last-Modified"), target.last_modified);
+    if (request.method() == methods::GET)
+    {
+      set_xml_body(response, target.acl.empty() ? U("<?xml version=\"1.0\" encoding=\"utf-8\"?><SignedIdentifiers />") : target.acl, size);
+    }
+    return size;
+  }
+
+  throw mock_error(status_codes::BadRequest, U("UnsupportedOperation"));
+}
+
+size_t mock_blob_service::service_state::process_blob(const http_request& request, const std::vector<unsigned char>& body, const std::map<utility::string_t, utility::string_t>& query,
+  const utility::string_t& container_name, const utility::string_t& blob_name, http_response& response)
+{
+  auto container = containers.find(container_name);
+  if (container == containers.end())
+  {
+    throw mock_error(status_codes::NotFound, U("ContainerNotFound"));
+  }
+
+  auto comp_parameter = query.find(U("comp"));
+  utility::string_t comp = comp_parameter != query.end() ? comp_parameter->second : utility::string_t();
+  auto existing = container->second.blobs.find(blob_name);
+
+  auto snapshot_parameter = query.find(U("snapshot"));
+  if (snapshot_parameter != query.end())
+  {
+    return process_snapshot(request, query, container->second, blob_name, snapshot_parameter->second, comp, response);
+  }
+
+  if (request.method() == methods::PUT && comp.empty())
+  {
+    mock_blob created;
+    if (existing != container->second.blobs.end())
+    {
+      check_lease(existing->second.lease, request);
+      check_etag(existing->second.etag, request);
+      created.lease = existing->second.lease;
+    }
+
+    utility::string_t copy_source = header(request, U("x-ms-copy-source"));
+    if (!copy_source.empty())
+    {
+      copy_blob(created, copy_source);
+      response.set_status_code(status_codes::Accepted);
+      response.headers().add(U("x-ms-copy-id"), created.copy_id);
+      response.headers().add(U("x-ms-copy-status"), U("success"));
+    }
+    else
+    {
+      created.type = header(request, U("x-ms-blob-type"));
+      if (created.type == U("BlockBlob"))
+      {
+        created.data.assign(body.begin(), body.end());
+      }
+      else if (created.type == U("PageBlob"))
+      {
+        utility::size64_t size = to_size(header(request, U("x-ms-blob-content-length")));
+        if (size % page_size != 0)
+        {
+          throw mock_error(status_codes::BadRequest, U("InvalidHeaderValue"));
+        }
+
+        created.data.assign(static_cast<size_t>(size), 0);
+        created.written_pages.assign(static_cast<size_t>(size / page_size), false);
+      }
+      else if (created.type != U("AppendBlob"))
+      {
+        throw mock_error(status_codes::BadRequest, U("InvalidHeaderValue"));
+      }
+
+      for (const auto& h : property_headers)
+      {
+        utility::string_t value = header(request, h.first);
+        if (!value.empty())
+        {
+          created.properties[h.second] = value;
+        }
+      }
+
+      for (const auto& h : request.headers())
+      {
+        if (h.first.compare(0, 10, U("x-ms-meta-")) == 0)
+        {
+          created.metadata[h.first.substr(10)] = h.second;
+        }
+      }
+
+      response.set_status_code(status_codes::Created);
+    }
+
+    touch(created.etag, created.last_modified);
+    mock_blob& stored = container->second.blobs[blob_name];
+    stored = created;
+    response.headers().add(U("ETag"), stored.etag);
+    response.headers().add(U("Last-Modified"), stored.last_modified);
+    return 0;
+  }
+
+  if (request.method() == methods::PUT && comp == U("block"))
+  {
+    mock_blob& blob = container->second.blobs[blob_name];
+    if (blob.type.empty())
+    {
+      // Uncommitted blocks create a blob that is not visible until a block list is committed
+      blob.type = U("BlockBlob");
+    }
+
+    check_lease(blob.lease, request);
+    auto block_id = query.find(U("blockid"));
+    if (block_id == query.end() || blob.type != U("BlockBlob"))
+    {
+      throw mock_error(status_codes::BadRequest, U("InvalidQueryParameterValue"));
+    }
+
+    blob.uncommitted_blocks[block_id->second].assign(body.begin(), body.end());
+    response.set_status_code(status_codes::Created);
+    return 0;
+  }
+
+  if (existing == container->second.blobs.end() || (existing->second.etag.empty() && comp != U("blocklist")))
+  {
+    throw mock_error(status_codes::NotFound, U("BlobNotFound"));
+  }
+
+  mock_blob& blob = existing->second;
+
+  if (request.method() == methods::PUT && comp == U("blocklist"))
+  {
+    check_lease(blob.lease, request);
+    if (!blob.etag.empty())
+    {
+      check_etag(blob.etag, request);
+    }
+
+    put_block_list(blob, body);
+    for (const auto& h : property_headers)
+    {
+      utility::string_t value = header(request, h.first);
+      if (!value.empty())
+      {
+        blob.properties[h.second] = value;
+      }
+    }
+
+    touch(blob.etag, blob.last_modified);
+    response.set_status_code(status_codes::Created);
+    response.headers().add(U("ETag"), blob.etag);
+    response.headers().add(U("Last-Modified"), blob.last_modified);
+    return 0;
+  }
+
+  if (request.method() == methods::GET && comp == U("blocklist"))
+  {
+    utility::string_t filter = query.count(U("blocklisttype")) ? query.find(U("blocklisttype"))->second : U("committed");
+    utility::ostringstream_t xml;
+    xml << U("<?xml version=\"1.0\" encoding=\"utf-8\"?><BlockList><CommittedBlocks>");
+    if (filter == U("committed") || filter == U("all"))
+    {
+      for (const auto& block : blob.committed_blocks)
+      {
+        xml << U("<Block><Name>") << block.first << U("</Name><Size>") << block.second << U("</Size></Block>");
+      }
+    }
+
+    xml << U("</CommittedBlocks><UncommittedBlocks>");
+    if (filter == U("uncommitted") || filter == U("all"))
+    {
+      for (const auto& block : blob.uncommitted_blocks)
+      {
+        xml << U("<Block><Name>") << block.first << U("</Name><Size>") << block.second.size() << U("</Size></Block>");
+      }
+    }
+
+    xml << U("</UncommittedBlocks></BlockList>");
+
+    size_t size = 0;
+    response.set_status_code(status_codes::OK);
+    if (!blob.etag.empty())
+    {
+      response.headers().add(U("ETag"), blob.etag);
+      response.headers().add(U("Last-Modified"), blob.last_modified);
+    }
+    response.headers().add(U("x-ms-blob-content-length"), to_string_t(blob.data.size()));
+    set_xml_body(response, xml.str(), size);
+    return size;
+  }
+
+  if ((request.method() == methods::GET || request.method() == methods::HEAD) && comp.empty())
+  {
+    check_etag(blob.etag, request);
+    if (request.method() == methods::HEAD)
+    {
+      response.set_status_code(status_codes::OK);
+      set_blob_headers(blob, response);
+      response.headers().set_content_length(blob.data.size());
+      return 0;
+    }
+
+    return get_blob(request, blob, response);
+  }
+
+  if (request.method() == methods::DEL && comp.empty())
+  {
+    check_lease(blob.lease, request);
+    check_etag(blob.etag, request);
+
+    utility::string_t delete_snapshots = header(request, U("x-ms-delete-snapshots"));
+    auto snapshots = container->second.snapshots.find(blob_name);
+    bool has_snapshots = snapshots != container->second.snapshots.end() && !snapshots->second.empty();
+    if (has_snapshots && delete_snapshots.empty())
+    {
+      throw mock_error(status_codes::Conflict, U("SnapshotsPresent"));
+    }
+
+    if (has_snapshots)
+    {
+      container->second.snapshots.erase(snapshots);
+    }
+
+    if (delete_snapshots != U("only"))
+    {
+      container->second.blobs.erase(existing);
+    }
+
+    response.set_status_code(status_codes::Accepted);
+    return 0;
+  }
+
+  if (request.method() == methods::PUT && comp == U("snapshot"))
+  {
+    utility::string_t snapshot_time = utility::datetime::utc_now().to_string(utility::datetime::ISO_8601);
+    mock_blob& snapshot = container->second.snapshots[blob_name][snapshot_time];
+    snapshot = blob;
+    snapshot.lease = mock_lease();
+    snapshot.uncommitted_blocks.clear();
+
+    response.set_status_code(status_codes::Created);
+    response.headers().add(U("x-ms-snapshot"), snapshot_time);
+    response.headers().add(U("ETag"), blob.etag);
+    response.headers().add(U("Last-Modified"), blob.last_modified);
+    return 0;
+  }
+
+  if (request.method() == methods::PUT && comp == U("page"))
+  {
+    check_lease(blob.lease, request);
+    check_etag(blob.etag, request);
+
+    utility::size64_t start = 0;
+    utility::size64_t end = 0;
+    if (blob.type != U("PageBlob") || !parse_request_range(request, start, end) ||
+      start % page_size != 0 || (end + 1) % page_size != 0 || end >= blob.data.size())
+    {
+      throw mock_error(status_codes::RequestedRangeNotSatisfiable, U("InvalidPageRange"));
+    }
+
+    bool clear = header(request, U("x-ms-page-write")) == U("clear");
+    if (!clear && body.size() != end - start + 1)
+    {
+      throw mock_error(status_codes::BadRequest, U("InvalidHeaderValue"));
+    }
+
+    for (utility::size64_t offset = start; offset <= end; offset++)
+    {
+      blob.data[static_cast<size_t>(offset)] = clear ? 0 : body[static_cast<size_t>(offset - start)];
+    }
+
+    for (utility::size64_t page = start / page_size; page <= end / page_size; page++)
+    {
+      blob.written_pages[static_cast<size_t>(page)] = !clear;
+    }
+
+    touch(blob.etag, blob.last_modified);
+    response.set_status_code(status_codes::Created);
+    response.headers().add(U("ETag"), blob.etag);
+    response.headers().add(U("Last-Modified"), blob.last_modified);
+    response.headers().add(U("x-ms-blob-sequence-number"), U("0"));
+    return 0;
+  }
+
+  if (request.method() == methods::GET && comp == U("pagelist"))
+  {
+    utility::ostringstream_t xml;
+    xml << U("<?xml version=\"1.0\" encoding=\"utf-8\"?><PageList>");
+    write_page_ranges(xml, U("PageRange"), blob.written_pages);
+    xml << U("</PageList>");
+
+    size_t size = 0;
+    response.set_status_code(status_codes::OK);
+    response.headers().add(U("ETag"), blob.etag);
+    response.headers().add(U("Last-Modified"), blob.last_modified);
+    response.headers().add(U("x-ms-blob-content-length"), to_string_t(blob.data.size()));
+    set_xml_body(response, xml.str(), size);
+    return size;
+  }
+
+  if (request.method() == methods::PUT && comp == U("appendblock"))
+  {
+    check_lease(blob.lease, request);
+    check_etag(blob.etag, request);
+    if (blob.type != U("AppendBlob"))
+    {
+      throw mock_error(status_codes::Conflict, U("InvalidBlobType"));
+    }
+
+    utility::string_t position = header(request, U("x-ms-blob-condition-appendpos"));
+    if (!position.empty() && to_size(position) != blob.data.size())
+    {
+      throw mock_error(status_codes::PreconditionFailed, U("AppendPositionConditionNotMet"));
+    }
+
+    utility::string_t max_size = header(request, U("x-ms-blob-condition-maxsize"));
+    if (!max_size.empty() && blob.data.size() + body.size() > to_size(max_size))
+    {
+      throw mock_error(status_codes::PreconditionFailed, U("MaxBlobSizeConditionNotMet"));
+    }
+
+    utility::size64_t offset = blob.data.size();
+    blob.data.insert(blob.data.end(), body.begin(), body.end());
+    blob.committed_block_count++;
+
+    touch(blob.etag, blob.last_modified);
+    response.set_status_code(status_codes::Created);
+    response.headers().add(U("ETag"), blob.etag);
+    response.headers().add(U("Last-Modified"), blob.last_modified);
+    response.headers().add(U("x-ms-blob-append-offset"), to_string_t(offset));
+    response.headers().add(U("x-ms-blob-committed-block-count"), to_string_t(blob.committed_block_count));
+    return 0;
+  }
+
+  if (request.method() == methods::PUT && (comp == U("metadata") || comp == U("properties")))
+  {
+    check_lease(blob.lease, request);
+    check_etag(blob.etag, request);
+    if (comp == U("metadata"))
+    {
+      blob.metadata.clear();
+      for (const auto& h : request.headers())
+      {
+        if (h.first.compare(0, 10, U("x-ms-meta-")) == 0)
+        {
+          blob.metadata[h.first.substr(10)] = h.second;
+        }
+      }
+    }
+    else
+    {
+      blob.properties.clear();
+      for (const auto& h : property_headers)
+      {
+        utility::string_t value = header(request, h.first);
+        if (!value.empty())
+        {
+          blob.properties[h.second] = value;
+        }
+      }
+    }
+
+    touch(blob.etag, blob.last_modified);
+    response.set_status_code(status_codes::OK);
+    response.headers().add(U("ETag"), blob.etag);
+    response.headers().add(U("Last-Modified"), blob.last_modified);
+    return 0;
+  }
+
+  if (request.method() == methods::PUT && comp == U("lease"))
+  {
+    return lease(request, blob.lease, response);
+  }
+
+  throw mock_error(status_codes::BadRequest, U("UnsupportedOperation"));
+}
+
+///
+/// Reads or deletes a snapshot, snapshots can not be modified. The page list of a snapshot can be the difference
+/// with a previous snapshot, the pages whose content changed being listed as page ranges and the pages written in
+/// the previous snapshot only as clear ranges.
+///
+size_t mock_blob_service::service_state::process_snapshot(const http_request& request, const std::map<utility::string_t, utility::string_t>& query,
+  mock_container& container, const utility::string_t& blob_name, const utility::string_t& snapshot_time, const utility::string_t& comp, http_response& response)
+{
+  auto snapshots = container.snapshots.find(blob_name);
+  if (snapshots == container.snapshots.end() || !snapshots->second.count(snapshot_time))
+  {
+    throw mock_error(status_codes::NotFound, U("BlobNotFound"));
+  }
+
+  const mock_blob& snapshot = snapshots->second[snapshot_time];
+  if (request.method() == methods::GET && comp.empty())
+  {
+    return get_blob(request, snapshot, response);
+  }
+
+  if (request.method() == methods::HEAD && comp.empty())
+  {
+    response.set_status_code(status_codes::OK);
+    set_blob_headers(snapshot, response);
+    response.headers().set_content_length(snapshot.data.size());
+    return 0;
+  }
+
+  if (request.method() == methods::GET && comp == U("pagelist") && snapshot.type == U("PageBlob"))
+  {
+    std::vector<bool> changed = snapshot.written_pages;
+    std::vector<bool> cleared(snapshot.written_pages.size(), false);
+
+    auto previous_parameter = query.find(U("prevsnapshot"));
+    if (previous_parameter != query.end())
+    {
+      if (!snapshots->second.count(previous_parameter->second))
+      {
+        throw mock_error(status_codes::Conflict, U("PreviousSnapshotNotFound"));
+      }
+
+      const mock_blob& previous = snapshots->second[previous_parameter->second];
+      for (size_t page = 0; page < changed.size(); page++)
+      {
+        bool was_written = page < previous.written_pages.size() && previous.written_pages[page];
+        if (!snapshot.written_pages[page])
+        {
+          cleared[page] = was_written;
+          continue;
+        }
+
+        auto first = snapshot.data.begin() + static_cast<std::ptrdiff_t>(page * page_size);
+        changed[page] = !was_written || !std::equal(first, first + static_cast<std::ptrdiff_t>(page_size),
+          previous.data.begin() + static_cast<std::ptrdiff_t>(page * page_size));
+      }
+    }
+
+    utility::ostringstream_t xml;
+    xml << U("<?xml version=\"1.0\" encoding=\"utf-8\"?><PageList>");
+    write_page_ranges(xml, U("PageRange"), changed);
+    write_page_ranges(xml, U("ClearRange"), cleared);
+    xml << U("</PageList>");
+
+    size_t size = 0;
+    response.set_status_code(status_codes::OK);
+    response.headers().add(U("ETag"), snapshot.etag);
+    response.headers().add(U("Last-Modified"), snapshot.last_modified);
+    response.headers().add(U("x-ms-blob-content-length"), to_string_t(snapshot.data.size()));
+    set_xml_body(response, xml.str(), size);
+    return size;
+  }
+
+  if (request.method() == methods::DEL && comp.empty())
+  {
+    snapshots->second.erase(snapshot_time);
+    response.set_status_code(status_codes::Accepted);
+    return 0;
+  }
+
+  throw mock_error(status_codes::BadRequest, U("UnsupportedOperation"));
+}
+
+size_t mock_blob_service::service_state::list_containers(const std::map<utility::string_t, utility::string_t>& query, http_response& response)
+{
+  utility::string_t prefix = query.count(U("prefix")) ? query.find(U("prefix"))->second : utility::string_t();
+  utility::string_t marker = query.count(U("marker")) ? query.find(U("marker"))->second : utility::string_t();
+  size_t max_results = query.count(U("maxresults")) ? static_cast<size_t>(to_size(query.find(U("maxresults"))->second)) : default_max_results;
+
+  utility::ostringstream_t xml;
+  xml << U("<?xml version=\"1.0\" encoding=\"utf-8\"?><EnumerationResults ServiceEndpoint=\"") << xml_escape(endpoint) << U("\">")
+    << U("<Prefix>") << xml_escape(prefix) << U("</Prefix><Containers>");
+
+  size_t count = 0;
+  utility::string_t next_marker;
+  for (auto it = containers.lower_bound(std::max(prefix, marker)); it != containers.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+  {
+    if (count == max_results)
+    {
+      next_marker = it->first;
+      break;
+    }
+
+    xml << U("<Container><Name>") << xml_escape(it->first) << U("</Name><Properties><Last-Modified>") << it->second.last_modified
+      << U("</Last-Modified><Etag>") << it->second.etag << U("</Etag></Properties></Container>");
+    count++;
+  }
+
+  xml << U("</Containers><NextMarker>") << xml_escape(next_marker) << U("</NextMarker></EnumerationResults>");
+
+  size_t size = 0;
+  response.set_status_code(status_codes::OK);
+  set_xml_body(response, xml.str(), size);
+  return size;
+}
+
+size_t mock_blob_service::service_state::list_blobs(const mock_container& container, const utility::string_t& container_name,
+  const std::map<utility::string_t, utility::string_t>& query, http_response& response)
+{
+  utility::string_t prefix = query.count(U("prefix")) ? query.find(U("prefix"))->second : utility::string_t();
+  utility::string_t marker = query.count(U("marker")) ? query.find(U("marker"))->second : utility::string_t();
+  utility::string_t delimiter = query.count(U("delimiter")) ? query.find(U("delimiter"))->second : utility::string_t();
+  size_t max_results = query.count(U("maxresults")) ? static_cast<size_t>(to_size(query.find(U("maxresults"))->second)) : default_max_results;
+  bool include_metadata = query.count(U("include")) && query.find(U("include"))->second.find(U("metadata")) != utility::string_t::npos;
+  bool include_copy = query.count(U("include")) && query.find(U("include"))->second.find(U("copy")) != utility::string_t::npos;
+  bool include_snapshots = query.count(U("include")) && query.find(U("include"))->second.find(U("snapshots")) != utility::string_t::npos;
+
+  utility::ostringstream_t xml;
+  auto write_blob = [&](const utility::string_t& name, const utility::string_t& snapshot_time, const mock_blob& blob)
+  {
+    xml << U("<Blob><Name>") << xml_escape(name) << U("</Name>");
+    if (!snapshot_time.empty())
+    {
+      xml << U("<Snapshot>") << snapshot_time << U("</Snapshot>");
+    }
+
+    xml << U("<Properties><Last-Modified>") << blob.last_modified
+      << U("</Last-Modified><Etag>") << blob.etag << U("</Etag><Content-Length>") << blob.data.size() << U("</Content-Length>");
+    for (const auto& property : blob.properties)
+    {
+      if (property.first.compare(0, 10, U("x-ms-copy-")) != 0)
+      {
+        xml << U("<") << property.first << U(">") << xml_escape(property.second) << U("</") << property.first << U(">");
+      }
+    }
+
+    if (include_copy)
+    {
+      for (const auto& p : copy_properties)
+      {
+        auto property = blob.properties.find(p.first);
+        if (property != blob.properties.end())
+        {
+          xml << U("<") << p.second << U(">") << xml_escape(property->second) << U("</") << p.second << U(">");
+        }
+      }
+    }
+
+    xml << U("<BlobType>") << blob.type << U("</BlobType><LeaseStatus>") << (blob.lease.active() ? U("locked") : U("unlocked"))
+      << U("</LeaseStatus><LeaseState>") << (blob.lease.active() ? U("leased") : U("available")) << U("</LeaseState></Properties>");
+
+    if (include_metadata)
+    {
+      xml << U("<Metadata>");
+      for (const auto& metadata : blob.metadata)
+      {
+        xml << U("<") << metadata.first << U(">") << xml_escape(metadata.second) << U("</") << metadata.first << U(">");
+      }
+      xml << U("</Metadata>");
+    }
+
+    xml << U("</Blob>");
+  };
+
+  xml << U("<?xml version=\"1.0\" encoding=\"utf-8\"?><EnumerationResults ServiceEndpoint=\"") << xml_escape(endpoint)
+    << U("\" ContainerName=\"") << xml_escape(container_name) << U("\"><Prefix>") << xml_escape(prefix) << U("</Prefix>")
+    << U("<Delimiter>") << xml_escape(delimiter) << U("</Delimiter><Blobs>");
+
+  // The markers are opaque like the service's: the encoded name of the blob or directory the next page starts at,
+  // followed, when the page starts within the entries of a blob, by '!' and the snapshot to resume at, none for the blob itself
+  auto make_marker = [](const utility::string_t& name, bool within_blob, const utility::string_t& snapshot_time)
+  {
+    std::string encoded_name = utility::conversions::to_utf8string(name);
+    utility::string_t next = utility::conversions::to_base64(std::vector<unsigned char>(encoded_name.cbegin(), encoded_name.cend()));
+    return within_blob ? next + U("!") + snapshot_time : next;
+  };
+
+  utility::string_t marker_name;
+  utility::string_t marker_snapshot;
+  bool marker_within_blob = false;
+  if (!marker.empty())
+  {
+    size_t separator = marker.find(U('!'));
+    std::vector<unsigned char> decoded_name;
+    try
+    {
+      decoded_name = utility::conversions::from_base64(marker.substr(0, separator));
+    }
+    catch (const std::exception&)
+    {
+      throw mock_error(status_codes::BadRequest, U("InvalidQueryParameterValue"));
+    }
+
+    marker_name = utility::conversions::to_string_t(std::string(decoded_name.cbegin(), decoded_name.cend()));
+    if (separator != utility::string_t::npos)
+    {
+      marker_within_blob = true;
+      marker_snapshot = marker.substr(separator + 1);
+    }
+  }
+
+  size_t count = 0;
+  utility::string_t next_marker;
+  utility::string_t last_directory;
+  for (auto it = container.blobs.lower_bound(std::max(prefix, marker_name)); it != container.blobs.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+  {
+    const mock_blob& blob = it->second;
+    if (blob.etag.empty())
+    {
+      // Blobs with only uncommitted blocks are not listed
+      continue;
+    }
+
+    utility::string_t directory;
+    if (!delimiter.empty())
+    {
+      size_t position = it->first.find(delimiter, prefix.size());
+      if (position != utility::string_t::npos)
+      {
+        directory = it->first.substr(0, position + delimiter.size());
+      }
+    }
+
+    // A marker pointing to a virtual directory resumes after all its blobs
+    if (!directory.empty() && (directory == last_directory || directory == marker_name))
+    {
+      continue;
+    }
+
+    if (!directory.empty())
+    {
+      if (count == max_results)
+      {
+        next_marker = make_marker(directory, false, utility::string_t());
+        break;
+      }
+
+      count++;
+      last_directory = directory;
+      xml << U("<BlobPrefix><Name>") << xml_escape(directory) << U("</Name></BlobPrefix>");
+      continue;
+    }
+
+    // The snapshots of a blob are listed before it, oldest first, and each of them counts towards the page size,
+    // so a page can end between the snapshots of a blob and the blob itself
+    auto snapshots = container.snapshots.find(it->first);
+    if (include_snapshots && snapshots != container.snapshots.end())
+    {
+      auto snapshot = snapshots->second.begin();
+      if (marker_within_blob && it->first == marker_name)
+      {
+        snapshot = marker_snapshot.empty() ? snapshots->second.end() : snapshots->second.lower_bound(marker_snapshot);
+      }
+
+      for (; snapshot != snapshots->second.end() && count < max_results; ++snapshot)
+      {
+        count++;
+        write_blob(it->first, snapshot->first, snapshot->second);
+      }
+
+      if (snapshot != snapshots->second.end())
+      {
+        next_marker = make_marker(it->first, true, snapshot->first);
+        break;
+      }
+    }
+
+    if (count == max_results)
+    {
+      next_marker = make_marker(it->first, true, utility::string_t());
+      break;
+    }
+
+    count++;
+    write_blob(it->first, utility::string_t(), blob);
+  }
+
+  xml << U("</Blobs><NextMarker>") << xml_escape(next_marker) << U("</NextMarker></EnumerationResults>");
+
+  size_t size = 0;
+  response.set_status_code(status_codes::OK);
+  set_xml_body(response, xml.str(), size);
+  return size;
+}
+
+size_t mock_blob_service::service_state::get_blob(const http_request& request, const mock_blob& blob, http_response& response)
+{
+  utility::size64_t start = 0;
+  utility::size64_t end = blob.data.size() == 0 ? 0 : blob.data.size() - 1;
+  bool ranged = parse_request_range(request, start, end);
+  if (ranged)
+  {
+    if (start >= blob.data.size())
+    {
+      throw mock_error(status_codes::RequestedRangeNotSatisfiable, U("InvalidRange"));
+    }
+
+    end = std::min<utility::size64_t>(end, blob.data.size() - 1);
+  }
+
+  set_blob_headers(blob, response);
+
+  std::vector<unsigned char> content;
+  if (!blob.data.empty())
+  {
+    content.assign(blob.data.begin() + static_cast<std::ptrdiff_t>(start), blob.data.begin() + static_cast<std::ptrdiff_t>(end) + 1);
+  }
+
+  size_t size = content.size();
+  if (ranged)
+  {
+    response.set_status_code(status_codes::PartialContent);
+    response.headers().add(U("Content-Range"), U("bytes ") + to_string_t(start) + U("-") + to_string_t(end) + U("/") + to_string_t(blob.data.size()));
+
+    // The MD5 of the whole blob does not apply to a range, it is returned in its own header
+    auto md5 = blob.properties.find(U("Content-MD5"));
+    if (md5 != blob.properties.end())
+    {
+      response.headers().remove(U("Content-MD5"));
+      response.headers().add(U("x-ms-blob-content-md5"), md5->second);
+    }
+  }
+  else
+  {
+    response.set_status_code(status_codes::OK);
+  }
+
+  utility::string_t content_type = response.headers().content_type();
+  response.set_body(std::move(content));
+  if (!content_type.empty())
+  {
+    response.headers().set_content_type(content_type);
+  }
+
+  return size;
+}
+
+///
+/// Acquires, renews, releases or breaks the lease of a container or a blob
+///
+size_t mock_blob_service::service_state::lease(const http_request& request, mock_lease& lease, http_response& response)
+{
+  utility::string_t action = header(request, U("x-ms-lease-action"));
+  utility::string_t lease_id = header(request, U("x-ms-lease-id"));
+
+  if (action == U("acquire"))
+  {
+    utility::string_t proposed_id = header(request, U("x-ms-proposed-lease-id"));
+    if (lease.active() && proposed_id != lease.id)
+    {
+      throw mock_error(status_codes::Conflict, U("LeaseAlreadyPresent"));
+    }
+
+    utility::string_t duration = header(request, U("x-ms-lease-duration"));
+    lease.infinite = duration.empty() || duration == U("-1");
+    lease.duration = std::chrono::seconds(lease.infinite ? 0 : static_cast<long long>(to_size(duration)));
+    lease.expiry = std::chrono::steady_clock::now() + lease.duration;
+    lease.id = proposed_id.empty() ? utility::uuid_to_string(utility::new_uuid()) : proposed_id;
+
+    response.set_status_code(status_codes::Created);
+    response.headers().add(U("x-ms-lease-id"), lease.id);
+    return 0;
+  }
+
+  if (action == U("renew") || action == U("release"))
+  {
+    if (lease.id.empty() || lease_id != lease.id)
+    {
+      throw mock_error(status_codes::Conflict, U("LeaseIdMismatchWithLeaseOperation"));
+    }
+
+    if (action == U("release"))
+    {
+      lease = mock_lease();
+    }
+    else if (!lease.infinite)
+    {
+      // Renewing restarts the lease with its original duration
+      lease.expiry = std::chrono::steady_clock::now() + lease.duration;
+    }
+
+    response.set_status_code(status_codes::OK);
+    response.headers().add(U("x-ms-lease-id"), lease_id);
+    return 0;
+  }
+
+  if (action == U("break"))
+  {
+    if (lease.id.empty())
+    {
+      throw mock_error(status_codes::Conflict, U("LeaseNotPresentWithLeaseOperation"));
+    }
+
+    lease = mock_lease();
+    response.set_status_code(status_codes::Accepted);
+    response.headers().add(U("x-ms-lease-time"), U("0"));
+    return 0;
+  }
+
+  throw mock_error(status_codes::BadRequest, U("InvalidHeaderValue"));
+}
+
+///
+/// Commits a block list. Every entry is taken from the uncommitted or committed blocks as requested,
+/// and the uncommitted blocks that are not part of the list are discarded.
+///
+void mock_blob_service::service_state::put_block_list(mock_blob& blob, const std::vector<unsigned char>& body)
+{
+  std::string xml(body.begin(), body.end());
+
+  // Offsets of the currently committed blocks, to reuse their data
+  std::map<utility::string_t, std::pair<size_t, size_t>> committed;
+  size_t offset = 0;
+  for (const auto& block : blob.committed_blocks)
+  {
+    committed[block.first] = std::make_pair(offset, static_cast<size_t>(block.second));
+    offset += static_cast<size_t>(block.second);
+  }
+
+  // The entries are read in document order, whatever their kind
+  std::vector<std::pair<std::string, utility::string_t>> entries;
+  for (size_t position = xml.find('<'); position != std::string::npos; position = xml.find('<', position + 1))
+  {
+    for (const char* kind : { "Latest", "Committed", "Uncommitted" })
+    {
+      std::string open = std::string("<") + kind + ">";
+      if (xml.compare(position, open.size(), open) == 0)
+      {
+        size_t end = xml.find("</", position);
+        entries.push_back(std::make_pair(std::string(kind),
+          utility::conversions::to_string_t(xml.substr(position + open.size(), end - position - open.size()))));
+      }
+    }
+  }
+
+  std::vector<uint8_t> data;
+  std::vector<std::pair<utility::string_t, utility::size64_t>> blocks;
+  for (const auto& entry : entries)
+  {
+    auto uncommitted = blob.uncommitted_blocks.find(entry.second);
+    auto existing = committed.find(entry.second);
+    bool use_uncommitted = uncommitted != blob.uncommitted_blocks.end() && entry.first != "Committed";
+    bool use_committed = existing != committed.end() && entry.first != "Uncommitted";
+
+    if (use_uncommitted)
+    {
+      data.insert(data.end(), uncommitted->second.begin(), uncommitted->second.end());
+      blocks.push_back(std::make_pair(entry.second, static_cast<utility::size64_t>(uncommitted->second.size())));
+    }
+    else if (use_committed)
+    {
+      data.insert(data.end(), blob.data.begin() + static_cast<std::ptrdiff_t>(existing->second.first),
+        blob.data.begin() + static_cast<std::ptrdiff_t>(existing->second.first + existing->second.second));
+      blocks.push_back(std::make_pair(entry.second, static_cast<utility::size64_t>(existing->second.second)));
+    }
+    else
+    {
+      throw mock_error(status_codes::BadRequest, U("InvalidBlockList"));
+    }
+  }
+
+  blob.type = U("BlockBlob");
+  blob.data.swap(data);
+  blob.committed_blocks.swap(blocks);
+  blob.uncommitted_blocks.clear();
+}
+
+///
+/// Copies a blob of this service synchronously, the copy is reported as completed right away
+///
+void mock_blob_service::service_state::copy_blob(mock_blob& target, const utility::string_t& source)
+{
+  web::uri source_uri(source);
+  std::vector<utility::string_t> segments = web::uri::split_path(source_uri.path());
+  if (segments.size() < 3 || web::uri::decode(segments[0]) != account_name)
+  {
+    throw mock_error(status_codes::BadRequest, U("InvalidHeaderValue"));
+  }
+
+  utility::string_t blob_name;
+  for (size_t i = 2; i < segments.size(); i++)
+  {
+    blob_name += (i > 2 ? U("/") : U("")) + web::uri::decode(segments[i]);
+  }
+
+  auto container = containers.find(web::uri::decode(segments[1]));
+  if (container == containers.end() || !container->second.blobs.count(blob_name) || container->second.blobs[blob_name].etag.empty())
+  {
+    throw mock_error(status_codes::NotFound, U("CannotVerifyCopySource"));
+  }
+
+  mock_lease lease = target.lease;
+  target = container->second.blobs[blob_name];
+  target.lease = lease;
+  target.uncommitted_blocks.clear();
+  target.copy_id = utility::uuid_to_string(utility::new_uuid());
+  target.properties[U("x-ms-copy-id")] = target.copy_id;
+  target.properties[U("x-ms-copy-source")] = source;
+  target.properties[U("x-ms-copy-status")] = U("success");
+  target.properties[U("x-ms-copy-progress")] = to_string_t(target.data.size()) + U("/") + to_string_t(target.data.size());
+}
+
+void mock_blob_service::service_state::touch(utility::string_t& etag, utility::string_t& last_modified)
+{
+  utility::ostringstream_t value;
+  value << U("\"0x8D") << std::hex << std::uppercase << ++etag_counter << U("\"");
+  etag = value.str();
+  last_modified = utility::datetime::utc_now().to_string(utility::datetime::RFC_1123);
+}
+
+void mock_blob_service::service_state::set_blob_headers(const mock_blob& blob, http_response& response)
+{
+  response.headers().add(U("ETag"), blob.etag);
+  response.headers().add(U("Last-Modified"), blob.last_modified);
+  response.headers().add(U("x-ms-blob-type"), blob.type);
+  response.headers().add(U("Accept-Ranges"), U("bytes"));
+  response.headers().add(U("x-ms-lease-status"), blob.lease.active() ? U("locked") : U("unlocked"));
+  response.headers().add(U("x-ms-lease-state"), blob.lease.active() ? U("leased") : U("available"));
+  if (blob.lease.active())
+  {
+    response.headers().add(U("x-ms-lease-duration"), blob.lease.infinite ? U("infinite") : U("fixed"));
+  }
+
+  if (blob.type == U("AppendBlob"))
+  {
+    response.headers().add(U("x-ms-blob-committed-block-count"), to_string_t(blob.committed_block_count));
+  }
+
+  for (const auto& property : blob.properties)
+  {
+    response.headers().add(property.first, property.second);
+  }
+
+  for (const auto& metadata : blob.metadata)
+  {
+    response.headers().add(U("x-ms-meta-") + metadata.first, metadata.second);
+  }
+}
+
+void mock_blob_service::service_state::set_xml_body(http_response& response, const utility::string_t& xml, size_t& size)
+{
+  std::string body = utility::conversions::to_utf8string(xml);
+  size = body.size();
+  response.set_body(std::move(body), "application/xml");
+}
@@ -0,0 +1,40 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#pragma once
+class mock_blob_service
+{
+public:
+  explicit mock_blob_service(const utility::string_t& endpoint);
+  ~mock_blob_service();
+
+  void set_latency(std::chrono::microseconds latency);
+  void set_bandwidth(utility::size64_t bytes_per_second);
+  void set_error_rate(double probability, web::http::status_code status_code);
+
+  void open();
+  void close();
+
+  utility::string_t connection_string() const;
+
+private:
+  mock_blob_service(const mock_blob_service&);
+  mock_blob_service& operator=(const mock_blob_service&);
+
+  struct service_state;
+
+  std::shared_ptr<service_state> m_state;
+};
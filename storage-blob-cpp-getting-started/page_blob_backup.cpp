@@ -0,0 +1,178 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "task_util.h"
+#include "concurrency_controller.h"
+#include "mapped_file.h"
+#include "page_blob_backup.h"
+
+using namespace azure::storage;
+
+namespace
+{
+  struct backup_state
+  {
+    backup_state() : next(0), bytes(0), requests(0) {}
+
+    std::atomic<size_t> next;
+    std::atomic<utility::size64_t> bytes;
+    std::atomic<size_t> requests;
+    std::shared_ptr<mapped_file> file;
+    // The offset and the length of the ranges to download, split in requests of at most the range size
+    std::vector<std::pair<utility::size64_t, utility::size64_t>> ranges;
+  };
+
+  void add_range(backup_state& state, int64_t start_offset, int64_t end_offset, size_t range_size)
+  {
+    utility::size64_t end = static_cast<utility::size64_t>(end_offset) + 1;
+    for (utility::size64_t offset = static_cast<utility::size64_t>(start_offset); offset < end; offset += range_size)
+    {
+      state.ranges.push_back(std::make_pair(offset, std::min<utility::size64_t>(range_size, end - offset)));
+    }
+  }
+}
+
+page_backup::page_backup()
+  : size(0), changed_ranges(0), cleared_ranges(0)
+{
+}
+
+///
+/// Creates a backup downloading up to 'parallelism' ranges of at most 'range_size' bytes at once
+///
+page_blob_backup::page_blob_backup(size_t range_size, size_t parallelism)
+  : m_range_size(range_size), m_parallelism(parallelism)
+{
+}
+
+///
+/// Lets a controller shared with other range reads choose the number of ranges in flight
+///
+void page_blob_backup::set_controller(std::shared_ptr<concurrency_controller> controller)
+{
+  m_controller = controller;
+}
+
+///
+/// Backs up a page blob to a local sparse file through a new snapshot of the blob, whose time is returned. Without
+/// a previous snapshot, the file is created with the size of the blob and the written pages of the snapshot are
+/// downloaded. With the snapshot of the previous backup, the file must hold that backup: the pages changed between
+/// the two snapshots are downloaded into it, and the pages cleared meanwhile are deallocated from it, so a daily
+/// backup of a disk moves the pages written that day only. The ranges are downloaded concurrently, each straight
+/// into its place in the file mapped in memory. When the backup fails, the new snapshot is deleted, and the
+/// backup can be run again from the same previous snapshot, as it rewrites every page changed since then.
+/// The previous snapshot is left to the caller, who can delete it once the new backup succeeded.
+///
+page_backup page_blob_backup::backup(cloud_page_blob blob, const utility::string_t& file_name, const utility::string_t& previous_snapshot) const
+{
+  std::shared_ptr<backup_state> state = std::make_shared<backup_state>();
+  std::shared_ptr<concurrency_controller> controller = m_controller;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  page_backup result;
+  result.snapshot_time = blob.create_snapshot().snapshot_time();
+  state->requests++;
+
+  cloud_page_blob snapshot = blob.container().get_page_blob_reference(blob.name(), result.snapshot_time);
+  try
+  {
+    snapshot.download_attributes();
+    state->requests++;
+    result.size = snapshot.properties().size();
+
+    if (previous_snapshot.empty())
+    {
+      std::vector<page_range> ranges = snapshot.download_page_ranges();
+      state->requests++;
+
+      state->file = mapped_file::create(file_name, result.size);
+      for (const page_range& range : ranges)
+      {
+        add_range(*state, range.start_offset(), range.end_offset(), m_range_size);
+        result.changed_ranges++;
+      }
+    }
+    else
+    {
+      std::vector<page_diff_range> ranges = snapshot.download_page_ranges_diff(previous_snapshot);
+      state->requests++;
+
+      state->file = mapped_file::open_for_update(file_name, result.size);
+      for (const page_diff_range& range : ranges)
+      {
+        if (range.is_cleared_rage())
+        {
+          state->file->clear(range.start_offset(), range.end_offset() - range.start_offset() + 1);
+          result.cleared_ranges++;
+        }
+        else
+        {
+          add_range(*state, range.start_offset(), range.end_offset(), m_range_size);
+          result.changed_ranges++;
+        }
+      }
+    }
+
+    concurrency_controller::run_workers(controller, m_parallelism, [snapshot, state, controller]() -> pplx::task<bool>
+    {
+      size_t index = state->next++;
+      if (index >= state->ranges.size())
+      {
+        return pplx::task_from_result(false);
+      }
+
+      utility::size64_t offset = state->ranges[index].first;
+      utility::size64_t length = state->ranges[index].second;
+      concurrency::streams::rawptr_buffer<uint8_t> buffer(state->file->data() + offset, static_cast<size_t>(length), std::ios::out);
+      concurrency::streams::ostream range_stream(buffer);
+
+      // Every request uses its own reference so concurrent responses do not update the same blob properties
+      cloud_blob range_blob = snapshot.container().get_blob_reference(snapshot.name(), snapshot.snapshot_time());
+      return range_blob.download_range_to_stream_async(range_stream, offset, length, access_condition(), blob_request_options(), concurrency_controller::context_for(controller))
+        .then([state, range_stream, length](pplx::task<void> download)
+      {
+        range_stream.close();
+        download.get();
+
+        state->bytes += length;
+        state->requests++;
+        return true;
+      });
+    }).wait();
+
+    state->file->flush();
+  }
+  catch (const std::exception&)
+  {
+    // The snapshot can only be the base of the next backup once the file matches it
+    try
+    {
+      snapshot.delete_blob();
+    }
+    catch (const azure::storage::storage_exception&)
+    {
+    }
+
+    throw;
+  }
+
+  result.stats.bytes = state->bytes;
+  result.stats.skipped_bytes = result.size - state->bytes;
+  result.stats.requests = state->requests;
+  result.stats.seconds = task_util::seconds_since(start);
+  return result;
+}
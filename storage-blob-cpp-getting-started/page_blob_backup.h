@@ -0,0 +1,46 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+using namespace azure::storage;
+
+#pragma once
+
+struct page_backup
+{
+  page_backup();
+
+  utility::string_t snapshot_time;
+  utility::size64_t size;
+  size_t changed_ranges;
+  size_t cleared_ranges;
+  transfer_stats stats;
+};
+
+class page_blob_backup
+{
+public:
+  page_blob_backup(size_t range_size, size_t parallelism);
+
+  page_backup backup(cloud_page_blob blob, const utility::string_t& file_name, const utility::string_t& previous_snapshot) const;
+
+  void set_controller(std::shared_ptr<concurrency_controller> controller);
+
+private:
+  size_t m_range_size;
+  size_t m_parallelism;
+  std::shared_ptr<concurrency_controller> m_controller;
+};
@@ -0,0 +1,427 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "task_util.h"
+#include "concurrency_controller.h"
+#include "request_tracer.h"
+#include "mapped_file.h"
+#include "md5.h"
+#include "integrity_pipeline.h"
+#include "block_journal.h"
+#include "parallel_block_uploader.h"
+
+using namespace azure::storage;
+
+namespace
+{
+  ///
+  /// Generates the id of a block of a resumable upload from its position and the start of its MD5. The ids never
+  /// match the ones of upload_file, so its uncommitted blocks are not taken for resume points, but have the same
+  /// length, which the service requires of all the blocks of a blob.
+  ///
+  utility::string_t resumable_block_id(size_t index, const md5_hash::digest& md5)
+  {
+    std::ostringstream id;
+    id << "r" << std::setw(5) << std::setfill('0') << index;
+
+    std::string position = id.str();
+    std::vector<unsigned char> raw_id(position.cbegin(), position.cend());
+    raw_id.insert(raw_id.end(), md5.begin(), md5.begin() + 6);
+    return utility::conversions::to_base64(raw_id);
+  }
+
+  ///
+  /// Hashes the blocks to upload on an integrity pipeline, a few blocks ahead of the ones being sent, so the MD5
+  /// of a block is usually ready when a worker picks it up. The blocks are hashed in the order they are added.
+  ///
+  struct block_hashes
+  {
+    block_hashes(std::shared_ptr<mapped_file> file, std::shared_ptr<integrity_pipeline> pipeline, size_t block_size, size_t lookahead)
+      : file(file), pipeline(pipeline), block_size(block_size), lookahead(lookahead)
+    {
+    }
+
+    ///
+    /// Queues a block on the pipeline. The hash holds the file, so it stays mapped until the block is hashed even
+    /// when the upload has failed in the meantime.
+    ///
+    pplx::task<block_digest> hash(utility::size64_t offset, size_t length)
+    {
+      std::shared_ptr<mapped_file> mapped = file;
+      return pipeline->hash_async(file->data() + offset, length).then([mapped](block_digest digest)
+      {
+        return digest;
+      });
+    }
+
+    pplx::task<block_digest> get(size_t position)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      size_t end = std::min(indexes.size(), position + lookahead + 1);
+      while (digests.size() < end)
+      {
+        utility::size64_t offset = static_cast<utility::size64_t>(indexes[digests.size()]) * block_size;
+        size_t length = static_cast<size_t>(std::min<utility::size64_t>(block_size, file->size() - offset));
+        digests.push_back(hash(offset, length));
+      }
+
+      return digests[position];
+    }
+
+    std::shared_ptr<mapped_file> file;
+    std::shared_ptr<integrity_pipeline> pipeline;
+    size_t block_size;
+    size_t lookahead;
+    std::vector<size_t> indexes;
+    std::mutex mutex;
+    std::vector<pplx::task<block_digest>> digests;
+  };
+
+  struct upload_state
+  {
+    upload_state() : block_count(0), next_block(0), bytes(0), requests(0) {}
+
+    std::shared_ptr<mapped_file> file;
+    std::unique_ptr<block_hashes> hashes;
+    size_t block_count;
+    std::atomic<size_t> next_block;
+    std::atomic<utility::size64_t> bytes;
+    std::atomic<size_t> requests;
+  };
+
+  struct resumable_upload_state
+  {
+    resumable_upload_state(const utility::string_t& journal_file_name)
+      : journal(journal_file_name), block_count(0), next_block(0), bytes(0), skipped_bytes(0), requests(0)
+    {
+    }
+
+    std::shared_ptr<mapped_file> file;
+    std::unique_ptr<block_hashes> hashes;
+    block_journal journal;
+    std::vector<block_journal_entry> journaled;
+    std::vector<md5_hash::digest> block_md5;
+    size_t block_count;
+    std::atomic<size_t> next_block;
+    std::atomic<utility::size64_t> bytes;
+    std::atomic<utility::size64_t> skipped_bytes;
+    std::atomic<size_t> requests;
+  };
+}
+
+parallel_block_uploader::parallel_block_uploader(size_t block_size, size_t parallelism)
+  : m_block_size(block_size), m_parallelism(parallelism)
+{
+}
+
+///
+/// Lets a controller shared with other block uploads choose the number of requests in flight, instead of the
+/// fixed value given at construction, which is still used for the hashes computed ahead. The block size stays
+/// fixed: the block ids and the journal of a resumable upload depend on it.
+///
+void parallel_block_uploader::set_controller(std::shared_ptr<concurrency_controller> controller)
+{
+  m_controller = controller;
+}
+
+///
+/// Hashes the blocks on a pipeline shared with other transfers, instead of starting threads for every upload
+///
+void parallel_block_uploader::set_pipeline(std::shared_ptr<integrity_pipeline> pipeline)
+{
+  m_pipeline = pipeline;
+}
+
+///
+/// Records the blocks sent, the block lists committed and the block lists read to resume on a tracer
+///
+void parallel_block_uploader::set_tracer(std::shared_ptr<request_tracer> tracer)
+{
+  m_tracer = tracer;
+}
+
+///
+/// Generates the id of the block at the given position. All the block ids in a blob must have the same length,
+/// so the index is zero padded before being encoded.
+///
+utility::string_t parallel_block_uploader::block_id(size_t index)
+{
+  std::ostringstream id;
+  id << "block-" << std::setw(6) << std::setfill('0') << index;
+
+  std::string raw_id = id.str();
+  return utility::conversions::to_base64(std::vector<unsigned char>(raw_id.cbegin(), raw_id.cend()));
+}
+
+///
+/// Uploads a file to a block blob and waits for the upload to complete.
+///
+transfer_stats parallel_block_uploader::upload_file(cloud_block_blob block_blob, const utility::string_t& file_name) const
+{
+  return upload_file_async(block_blob, file_name).get();
+}
+
+///
+/// Uploads a file to a block blob. The file is mapped in memory and split in fixed size blocks, each block
+/// is sent straight from the mapping and up to 'parallelism' blocks are uploaded at the same time.
+/// The pages of a block are released once it is uploaded, so the memory used stays around
+/// parallelism * block_size whatever the size of the file. Every block is sent with its MD5, computed
+/// ahead of time on an integrity pipeline, so the service rejects a block corrupted on the way.
+/// Once every block has been uploaded, the ordered block list is committed.
+///
+pplx::task<transfer_stats> parallel_block_uploader::upload_file_async(cloud_block_blob block_blob, const utility::string_t& file_name) const
+{
+  std::shared_ptr<upload_state> state = std::make_shared<upload_state>();
+  state->file = mapped_file::open(file_name);
+
+  size_t block_size = m_block_size;
+  state->block_count = static_cast<size_t>((state->file->size() + block_size - 1) / block_size);
+  if (state->block_count > task_util::max_block_count)
+  {
+    throw std::runtime_error("The file has too many blocks, use a larger block size");
+  }
+
+  std::shared_ptr<integrity_pipeline> pipeline = m_pipeline ? m_pipeline : integrity_pipeline::create_default();
+  state->hashes.reset(new block_hashes(state->file, pipeline, block_size, 2 * m_parallelism));
+  for (size_t index = 0; index < state->block_count; index++)
+  {
+    state->hashes->indexes.push_back(index);
+  }
+
+  std::shared_ptr<concurrency_controller> controller = m_controller;
+  std::shared_ptr<request_tracer> tracer = m_tracer;
+  auto step = [block_blob, state, block_size, controller, tracer]() -> pplx::task<bool>
+  {
+    size_t index = state->next_block++;
+    if (index >= state->block_count)
+    {
+      return pplx::task_from_result(false);
+    }
+
+    utility::size64_t offset = static_cast<utility::size64_t>(index) * block_size;
+    utility::size64_t length = std::min<utility::size64_t>(block_size, state->file->size() - offset);
+
+    return state->hashes->get(index).then([block_blob, state, controller, tracer, index, offset, length](block_digest digest)
+    {
+      concurrency::streams::istream block_stream = state->file->view(offset, length);
+      return block_blob.upload_block_async(block_id(index), block_stream, digest.content_md5(), access_condition(), blob_request_options(),
+        request_tracer::context_for(tracer, U("upload_block"), concurrency_controller::context_for(controller))).then([state, block_stream, offset, length](pplx::task<void> upload)
+      {
+        block_stream.close();
+        upload.get();
+
+        state->file->release(offset, length);
+        state->bytes += length;
+        state->requests++;
+        return true;
+      });
+    });
+  };
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  return concurrency_controller::run_workers(controller, m_parallelism, step).then([block_blob, state, tracer]() mutable
+  {
+    std::vector<block_list_item> blocks;
+    blocks.reserve(state->block_count);
+    for (size_t index = 0; index < state->block_count; index++)
+    {
+      blocks.push_back(block_list_item(block_id(index)));
+    }
+
+    return block_blob.upload_block_list_async(blocks, access_condition(), blob_request_options(), request_tracer::context_for(tracer, U("upload_block_list")));
+  }).then([state, start]()
+  {
+    transfer_stats stats;
+    stats.bytes = state->bytes;
+    stats.requests = state->requests + 1;
+    stats.seconds = task_util::seconds_since(start);
+    return stats;
+  });
+}
+
+///
+/// Uploads a file to a block blob, resuming a previous attempt if any, and waits for the upload to complete.
+///
+transfer_stats parallel_block_uploader::upload_file_resumable(cloud_block_blob block_blob, const utility::string_t& file_name, const utility::string_t& journal_file_name) const
+{
+  return upload_file_resumable_async(block_blob, file_name, journal_file_name).get();
+}
+
+///
+/// Uploads a file to a block blob like upload_file_async, and records every uploaded block with its offset and MD5
+/// in a journal file, which starts with the size of the file and the block size. If the upload fails, calling this
+/// again with the same journal and block size only sends the blocks that are missing: a journaled block is skipped
+/// when the file still has the same content at its offset and the service still lists it (committed or not). The
+/// block ids are derived from the position and the MD5 of the blocks, so the blocks left by upload_file or by an
+/// upload of other content never match. Every block is sent with its MD5 so the service rejects corrupted blocks.
+/// The journal is deleted once the block list is committed.
+///
+pplx::task<transfer_stats> parallel_block_uploader::upload_file_resumable_async(cloud_block_blob block_blob, const utility::string_t& file_name,
+  const utility::string_t& journal_file_name) const
+{
+  std::shared_ptr<resumable_upload_state> state = std::make_shared<resumable_upload_state>(journal_file_name);
+  state->file = mapped_file::open(file_name);
+
+  size_t block_size = m_block_size;
+  state->block_count = static_cast<size_t>((state->file->size() + block_size - 1) / block_size);
+  if (state->block_count > task_util::max_block_count)
+  {
+    throw std::runtime_error("The file has too many blocks, use a larger block size");
+  }
+
+  state->journaled = state->journal.open(state->file->size(), block_size);
+  state->block_md5.resize(state->block_count);
+  std::shared_ptr<integrity_pipeline> pipeline = m_pipeline ? m_pipeline : integrity_pipeline::create_default();
+  state->hashes.reset(new block_hashes(state->file, pipeline, block_size, 2 * m_parallelism));
+
+  size_t parallelism = m_parallelism;
+  std::shared_ptr<concurrency_controller> controller = m_controller;
+  std::shared_ptr<request_tracer> tracer = m_tracer;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  return block_blob.download_block_list_async(block_listing_filter::all, access_condition(), blob_request_options(), request_tracer::context_for(tracer, U("download_block_list")))
+    .then([](pplx::task<std::vector<block_list_item>> listing)
+  {
+    try
+    {
+      return listing.get();
+    }
+    catch (const azure::storage::storage_exception& e)
+    {
+      // Nothing was uploaded yet
+      if (e.result().http_status_code() == web::http::status_codes::NotFound)
+      {
+        return std::vector<block_list_item>();
+      }
+
+      throw;
+    }
+  }).then([state, block_size](std::vector<block_list_item> service_blocks)
+  {
+    state->requests++;
+
+    std::map<utility::string_t, utility::size64_t> uploaded;
+    for (const block_list_item& block : service_blocks)
+    {
+      uploaded[block.id()] = block.size();
+    }
+
+    // The journaled blocks the service still has are hashed again on the pipeline, to check the file did not change
+    std::vector<const block_journal_entry*> candidates;
+    std::vector<pplx::task<block_digest>> digests;
+    for (const block_journal_entry& entry : state->journaled)
+    {
+      utility::size64_t offset = static_cast<utility::size64_t>(entry.index) * block_size;
+      if (entry.index >= state->block_count || entry.offset != offset ||
+        entry.length != std::min<utility::size64_t>(block_size, state->file->size() - offset))
+      {
+        continue;
+      }
+
+      auto block = uploaded.find(resumable_block_id(entry.index, entry.md5));
+      if (block != uploaded.end() && block->second == entry.length)
+      {
+        candidates.push_back(&entry);
+        digests.push_back(state->hashes->hash(offset, entry.length));
+      }
+    }
+
+    return pplx::when_all(digests.begin(), digests.end()).then([state, candidates](std::vector<block_digest> candidate_digests)
+    {
+      std::vector<bool> pending(state->block_count, true);
+      for (size_t i = 0; i < candidates.size(); i++)
+      {
+        const block_journal_entry& entry = *candidates[i];
+        if (candidate_digests[i].md5 == entry.md5)
+        {
+          pending[entry.index] = false;
+          state->block_md5[entry.index] = entry.md5;
+          state->skipped_bytes += entry.length;
+          state->file->release(entry.offset, entry.length);
+        }
+      }
+
+      for (size_t index = 0; index < state->block_count; index++)
+      {
+        if (pending[index])
+        {
+          state->hashes->indexes.push_back(index);
+        }
+      }
+    });
+  }).then([block_blob, state, block_size, parallelism, controller, tracer]()
+  {
+    auto step = [block_blob, state, block_size, controller, tracer]() -> pplx::task<bool>
+    {
+      size_t position = state->next_block++;
+      if (position >= state->hashes->indexes.size())
+      {
+        return pplx::task_from_result(false);
+      }
+
+      size_t index = state->hashes->indexes[position];
+
+      block_journal_entry entry;
+      entry.index = static_cast<uint32_t>(index);
+      entry.offset = static_cast<utility::size64_t>(index) * block_size;
+      entry.length = static_cast<uint32_t>(std::min<utility::size64_t>(block_size, state->file->size() - entry.offset));
+
+      return state->hashes->get(position).then([block_blob, state, controller, tracer, entry](block_digest digest) mutable
+      {
+        entry.md5 = digest.md5;
+        state->block_md5[entry.index] = digest.md5;
+
+        concurrency::streams::istream block_stream = state->file->view(entry.offset, entry.length);
+        return block_blob.upload_block_async(resumable_block_id(entry.index, entry.md5), block_stream, digest.content_md5(), access_condition(), blob_request_options(),
+          request_tracer::context_for(tracer, U("upload_block"), concurrency_controller::context_for(controller))).then([state, block_stream, entry](pplx::task<void> upload)
+        {
+          block_stream.close();
+          upload.get();
+
+          state->journal.record(entry);
+          state->file->release(entry.offset, entry.length);
+          state->bytes += entry.length;
+          state->requests++;
+          return true;
+        });
+      });
+    };
+
+    return concurrency_controller::run_workers(controller, parallelism, step);
+  }).then([block_blob, state, tracer]() mutable
+  {
+    std::vector<block_list_item> blocks;
+    blocks.reserve(state->block_count);
+    for (size_t index = 0; index < state->block_count; index++)
+    {
+      blocks.push_back(block_list_item(resumable_block_id(index, state->block_md5[index])));
+    }
+
+    return block_blob.upload_block_list_async(blocks, access_condition(), blob_request_options(), request_tracer::context_for(tracer, U("upload_block_list")));
+  }).then([state, start]()
+  {
+    state->journal.remove();
+
+    transfer_stats stats;
+    stats.bytes = state->bytes;
+    stats.skipped_bytes = state->skipped_bytes;
+    stats.requests = state->requests + 1;
+    stats.seconds = task_util::seconds_since(start);
+    return stats;
+  });
+}
@@ -0,0 +1,43 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+using namespace azure::storage;
+
+#pragma once
+class parallel_block_uploader
+{
+public:
+  parallel_block_uploader(size_t block_size, size_t parallelism);
+
+  transfer_stats upload_file(cloud_block_blob block_blob, const utility::string_t& file_name) const;
+  pplx::task<transfer_stats> upload_file_async(cloud_block_blob block_blob, const utility::string_t& file_name) const;
+
+  transfer_stats upload_file_resumable(cloud_block_blob block_blob, const utility::string_t& file_name, const utility::string_t& journal_file_name) const;
+  pplx::task<transfer_stats> upload_file_resumable_async(cloud_block_blob block_blob, const utility::string_t& file_name, const utility::string_t& journal_file_name) const;
+
+  void set_controller(std::shared_ptr<concurrency_controller> controller);
+  void set_pipeline(std::shared_ptr<integrity_pipeline> pipeline);
+  void set_tracer(std::shared_ptr<request_tracer> tracer);
+
+  static utility::string_t block_id(size_t index);
+
+private:
+  size_t m_block_size;
+  size_t m_parallelism;
+  std::shared_ptr<concurrency_controller> m_controller;
+  std::shared_ptr<integrity_pipeline> m_pipeline;
+  std::shared_ptr<request_tracer> m_tracer;
+};
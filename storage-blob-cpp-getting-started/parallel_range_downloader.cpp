@@ -0,0 +1,134 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "task_util.h"
+#include "concurrency_controller.h"
+#include "request_tracer.h"
+#include "mapped_file.h"
+#include "parallel_range_downloader.h"
+
+using namespace azure::storage;
+
+namespace
+{
+  struct download_state
+  {
+    download_state() : next_offset(0), bytes(0), requests(0) {}
+
+    std::shared_ptr<mapped_file> file;
+    access_condition condition;
+    std::atomic<utility::size64_t> next_offset;
+    std::atomic<utility::size64_t> bytes;
+    std::atomic<size_t> requests;
+  };
+}
+
+parallel_range_downloader::parallel_range_downloader(size_t range_size, size_t parallelism)
+  : m_range_size(range_size), m_parallelism(parallelism)
+{
+}
+
+///
+/// Lets a controller shared with other range reads choose the number of ranges in flight and their size.
+/// The ranges stay at most as large as the range size given at construction.
+///
+void parallel_range_downloader::set_controller(std::shared_ptr<concurrency_controller> controller)
+{
+  m_controller = controller;
+}
+
+///
+/// Records the properties read before each download and its range reads on a tracer
+///
+void parallel_range_downloader::set_tracer(std::shared_ptr<request_tracer> tracer)
+{
+  m_tracer = tracer;
+}
+
+///
+/// Downloads a blob to a file and waits for the download to complete.
+///
+transfer_stats parallel_range_downloader::download_to_file(cloud_blob blob, const utility::string_t& file_name) const
+{
+  return download_to_file_async(blob, file_name).get();
+}
+
+///
+/// Downloads a blob to a file using concurrent range requests. The file is allocated with the size of the blob
+/// and mapped in memory, and every range is written by the storage client straight into its place in the mapping.
+/// The whole blob is never buffered, so memory use does not grow with the blob size.
+/// All the ranges are requested with the ETag read at the start, so a blob modified mid-download fails the
+/// download instead of producing a file mixing two versions.
+///
+pplx::task<transfer_stats> parallel_range_downloader::download_to_file_async(cloud_blob blob, const utility::string_t& file_name) const
+{
+  std::shared_ptr<download_state> state = std::make_shared<download_state>();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  size_t range_size = m_range_size;
+  size_t parallelism = m_parallelism;
+  std::shared_ptr<concurrency_controller> controller = m_controller;
+  std::shared_ptr<request_tracer> tracer = m_tracer;
+
+  return blob.download_attributes_async(access_condition(), blob_request_options(), request_tracer::context_for(tracer, U("download_attributes")))
+    .then([blob, file_name, state, range_size, parallelism, controller, tracer]() mutable
+  {
+    state->requests++;
+    state->file = mapped_file::create(file_name, blob.properties().size());
+    state->condition = access_condition::generate_if_match_condition(blob.properties().etag());
+
+    auto step = [blob, state, range_size, controller, tracer]() -> pplx::task<bool>
+    {
+      size_t request_size = controller ? std::max<size_t>(1, std::min(range_size, controller->block_size())) : range_size;
+
+      utility::size64_t size = state->file->size();
+      utility::size64_t offset = state->next_offset.fetch_add(request_size);
+      if (offset >= size)
+      {
+        return pplx::task_from_result(false);
+      }
+
+      utility::size64_t length = std::min<utility::size64_t>(request_size, size - offset);
+      concurrency::streams::rawptr_buffer<uint8_t> buffer(state->file->data() + offset, static_cast<size_t>(length), std::ios::out);
+      concurrency::streams::ostream range_stream(buffer);
+
+      // Every request uses its own reference so concurrent responses do not update the same blob properties
+      cloud_blob range_blob = blob.container().get_blob_reference(blob.name(), blob.snapshot_time());
+      return range_blob.download_range_to_stream_async(range_stream, offset, length, state->condition, blob_request_options(),
+        request_tracer::context_for(tracer, U("download_range"), concurrency_controller::context_for(controller)))
+        .then([state, range_stream, length](pplx::task<void> download)
+      {
+        range_stream.close();
+        download.get();
+
+        state->bytes += length;
+        state->requests++;
+        return true;
+      });
+    };
+
+    return concurrency_controller::run_workers(controller, parallelism, step);
+  }).then([state, start]()
+  {
+    state->file->flush();
+
+    transfer_stats stats;
+    stats.bytes = state->bytes;
+    stats.requests = state->requests;
+    stats.seconds = task_util::seconds_since(start);
+    return stats;
+  });
+}
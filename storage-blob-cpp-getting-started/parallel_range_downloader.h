@@ -0,0 +1,36 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+using namespace azure::storage;
+
+#pragma once
+class parallel_range_downloader
+{
+public:
+  parallel_range_downloader(size_t range_size, size_t parallelism);
+
+  transfer_stats download_to_file(cloud_blob blob, const utility::string_t& file_name) const;
+  pplx::task<transfer_stats> download_to_file_async(cloud_blob blob, const utility::string_t& file_name) const;
+
+  void set_controller(std::shared_ptr<concurrency_controller> controller);
+  void set_tracer(std::shared_ptr<request_tracer> tracer);
+
+private:
+  size_t m_range_size;
+  size_t m_parallelism;
+  std::shared_ptr<concurrency_controller> m_controller;
+  std::shared_ptr<request_tracer> m_tracer;
+};
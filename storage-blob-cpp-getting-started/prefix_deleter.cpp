@@ -0,0 +1,233 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "task_util.h"
+#include "concurrency_controller.h"
+#include "prefix_deleter.h"
+
+using namespace azure::storage;
+
+namespace
+{
+  struct deleter_state
+  {
+    deleter_state() : next(0), blobs(0), snapshots(0), missing(0), failed(0), requests(0) {}
+
+    // Built once for every request of the deletion, the client defaults applying to it
+    blob_request_options options;
+    std::atomic<size_t> next;
+    std::atomic<size_t> blobs;
+    std::atomic<size_t> snapshots;
+    std::atomic<size_t> missing;
+    std::atomic<size_t> failed;
+    std::atomic<size_t> requests;
+  };
+
+  // A base blob to delete, with the number of its snapshots that were listed
+  struct listed_blob
+  {
+    cloud_blob blob;
+    size_t snapshots;
+  };
+
+  pplx::task<list_blob_item_segment> list_page(const cloud_blob_container& container, const utility::string_t& prefix, const continuation_token& token,
+    const blob_request_options& options)
+  {
+    return container.list_blobs_segmented_async(prefix, true, blob_listing_details::snapshots, task_util::max_listing_results, token, options,
+      operation_context());
+  }
+}
+
+delete_stats::delete_stats()
+  : blobs(0), snapshots(0), missing(0), failed(0), requests(0), seconds(0), complete(false)
+{
+}
+
+///
+/// Returns the number of blobs and snapshots deleted per second
+///
+double delete_stats::deletes_per_second() const
+{
+  return seconds > 0 ? (blobs + snapshots) / seconds : 0;
+}
+
+///
+/// Creates a deleter sending up to 'parallelism' delete requests at once
+///
+prefix_deleter::prefix_deleter(size_t parallelism)
+  : m_parallelism(parallelism)
+{
+}
+
+///
+/// Lets a controller shared with other deletions choose the number of delete requests in flight
+///
+void prefix_deleter::set_controller(std::shared_ptr<concurrency_controller> controller)
+{
+  m_controller = controller;
+}
+
+///
+/// Deletes every blob under the prefix with its snapshots
+///
+delete_stats prefix_deleter::delete_prefix(cloud_blob_container container, const utility::string_t& prefix) const
+{
+  return delete_prefix(container, prefix, continuation_token(), nullptr);
+}
+
+///
+/// Deletes every blob under the prefix with its snapshots, starting from the page of the listing the token points
+/// to. The blobs are listed with their snapshots, a page at a time, and the next page is requested while the blobs
+/// of the current one are deleted. Each blob is deleted together with its snapshots by a single request, the
+/// snapshots only being counted. Blobs already gone count as missing, so a deletion can be run again over the same
+/// pages. After each page whose blobs are all deleted, the checkpoint is called with the token of the next page.
+/// When some blobs of a page can not be deleted, the deletion stops after that page, and its token is returned to
+/// resume from.
+///
+delete_stats prefix_deleter::delete_prefix(cloud_blob_container container, const utility::string_t& prefix, const continuation_token& resume_token,
+  std::function<void(const continuation_token&)> checkpoint) const
+{
+  std::shared_ptr<deleter_state> state = std::make_shared<deleter_state>();
+  std::shared_ptr<concurrency_controller> controller = m_controller;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  delete_stats stats;
+  stats.resume_token = resume_token;
+
+  // The snapshots of a blob are listed before it, and may end a page when the blob starts the next one
+  std::unordered_map<utility::string_t, size_t> listed_snapshots;
+
+  pplx::task<list_blob_item_segment> listing = list_page(container, prefix, resume_token, state->options);
+  while (true)
+  {
+    list_blob_item_segment segment = listing.get();
+    state->requests++;
+
+    std::vector<listed_blob> blobs;
+    for (const list_blob_item& item : segment.results())
+    {
+      if (!item.is_blob())
+      {
+        continue;
+      }
+
+      cloud_blob blob = item.as_blob();
+      if (blob.is_snapshot())
+      {
+        listed_snapshots[blob.name()]++;
+        continue;
+      }
+
+      listed_blob listed;
+      listed.blob = blob;
+      listed.snapshots = 0;
+      auto snapshots = listed_snapshots.find(blob.name());
+      if (snapshots != listed_snapshots.end())
+      {
+        listed.snapshots = snapshots->second;
+        listed_snapshots.erase(snapshots);
+      }
+
+      blobs.push_back(listed);
+    }
+
+    continuation_token token = segment.continuation_token();
+    if (!token.empty())
+    {
+      listing = list_page(container, prefix, token, state->options);
+    }
+
+    size_t failed_before = state->failed;
+    state->next = 0;
+    concurrency_controller::run_workers(controller, m_parallelism, [&]() -> pplx::task<bool>
+    {
+      size_t index = state->next++;
+      if (index >= blobs.size())
+      {
+        return pplx::task_from_result(false);
+      }
+
+      cloud_blob blob = blobs[index].blob;
+      size_t snapshots = blobs[index].snapshots;
+      return blob.delete_blob_async(delete_snapshots_option::include_snapshots, access_condition(), state->options,
+        concurrency_controller::context_for(controller)).then([state, snapshots](pplx::task<void> deleted)
+      {
+        state->requests++;
+        try
+        {
+          deleted.get();
+          state->blobs++;
+          state->snapshots += snapshots;
+        }
+        catch (const azure::storage::storage_exception& e)
+        {
+          if (e.result().http_status_code() == web::http::status_codes::NotFound)
+          {
+            state->missing++;
+          }
+          else
+          {
+            state->failed++;
+          }
+        }
+
+        return true;
+      });
+    }).wait();
+
+    if (state->failed != failed_before)
+    {
+      // The page is listed again on resume, without the blobs deleted meanwhile. The next page requested ahead
+      // is not needed, its outcome is only observed.
+      if (!token.empty())
+      {
+        listing.then([](pplx::task<list_blob_item_segment> abandoned)
+        {
+          try
+          {
+            abandoned.get();
+          }
+          catch (const std::exception&)
+          {
+          }
+        });
+      }
+
+      break;
+    }
+
+    stats.resume_token = token;
+    if (checkpoint)
+    {
+      checkpoint(token);
+    }
+
+    if (token.empty())
+    {
+      stats.complete = true;
+      break;
+    }
+  }
+
+  stats.blobs = state->blobs;
+  stats.snapshots = state->snapshots;
+  stats.missing = state->missing;
+  stats.failed = state->failed;
+  stats.requests = state->requests;
+  stats.seconds = task_util::seconds_since(start);
+  return stats;
+}
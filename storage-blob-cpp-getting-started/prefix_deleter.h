@@ -0,0 +1,52 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+
+using namespace azure::storage;
+
+#pragma once
+
+struct delete_stats
+{
+  delete_stats();
+
+  double deletes_per_second() const;
+
+  size_t blobs;
+  size_t snapshots;
+  size_t missing;
+  size_t failed;
+  size_t requests;
+  double seconds;
+  bool complete;
+  continuation_token resume_token;
+};
+
+class prefix_deleter
+{
+public:
+  explicit prefix_deleter(size_t parallelism);
+
+  delete_stats delete_prefix(cloud_blob_container container, const utility::string_t& prefix) const;
+  delete_stats delete_prefix(cloud_blob_container container, const utility::string_t& prefix, const continuation_token& resume_token,
+    std::function<void(const continuation_token&)> checkpoint) const;
+
+  void set_controller(std::shared_ptr<concurrency_controller> controller);
+
+private:
+  size_t m_parallelism;
+  std::shared_ptr<concurrency_controller> m_controller;
+};
@@ -0,0 +1,635 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "request_tracer.h"
+
+using namespace azure::storage;
+
+namespace
+{
+  // Largest number of operation names, the operations beyond it are counted together under the last one
+  const size_t max_operations = 64;
+
+  // Upper bounds of the histogram buckets in seconds, the default buckets of the Prometheus clients
+  const size_t bound_count = 11;
+  const double bucket_bounds[bound_count] = { 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+
+  // Responses are counted by status class, the first class counts the attempts that got no response
+  const size_t status_class_count = 6;
+  const char* const status_classes[status_class_count] = { "none", "1xx", "2xx", "3xx", "4xx", "5xx" };
+
+  std::atomic<uint64_t> next_tracer_id(0);
+
+  ///
+  /// Adds to a counter only ever updated by the current thread, so no ordering with other memory is needed
+  ///
+  void add(std::atomic<uint64_t>& counter, uint64_t value)
+  {
+    counter.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  uint64_t to_microseconds(std::chrono::steady_clock::duration duration)
+  {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+  }
+
+  struct trace_histogram
+  {
+    trace_histogram() : sum_microseconds(0)
+    {
+      for (std::atomic<uint64_t>& bucket : buckets)
+      {
+        bucket = 0;
+      }
+    }
+
+    void record(std::chrono::steady_clock::duration duration)
+    {
+      double seconds = std::chrono::duration<double>(duration).count();
+      add(buckets[std::lower_bound(bucket_bounds, bucket_bounds + bound_count, seconds) - bucket_bounds], 1);
+      add(sum_microseconds, to_microseconds(duration));
+    }
+
+    std::atomic<uint64_t> buckets[bound_count + 1];
+    std::atomic<uint64_t> sum_microseconds;
+  };
+
+  struct operation_counters
+  {
+    operation_counters() : retries(0), failures(0), bytes_sent(0), bytes_received(0)
+    {
+      for (std::atomic<uint64_t>& responses_of_class : responses)
+      {
+        responses_of_class = 0;
+      }
+    }
+
+    std::atomic<uint64_t> responses[status_class_count];
+    std::atomic<uint64_t> retries;
+    std::atomic<uint64_t> failures;
+    std::atomic<uint64_t> bytes_sent;
+    std::atomic<uint64_t> bytes_received;
+    trace_histogram time_to_first_byte;
+    trace_histogram transfer;
+    trace_histogram duration;
+  };
+
+  // The counters of one thread. Only that thread updates them, so the updates never contend with each other.
+  struct thread_shard
+  {
+    operation_counters operations[max_operations];
+  };
+
+  struct histogram_totals
+  {
+    histogram_totals() : count(0), sum_microseconds(0)
+    {
+      buckets.fill(0);
+    }
+
+    void add(const trace_histogram& histogram)
+    {
+      for (size_t i = 0; i < buckets.size(); i++)
+      {
+        uint64_t bucket = histogram.buckets[i].load(std::memory_order_relaxed);
+        buckets[i] += bucket;
+        count += bucket;
+      }
+
+      sum_microseconds += histogram.sum_microseconds.load(std::memory_order_relaxed);
+    }
+
+    std::array<uint64_t, bound_count + 1> buckets;
+    uint64_t count;
+    uint64_t sum_microseconds;
+  };
+
+  struct operation_totals
+  {
+    operation_totals() : retries(0), failures(0), bytes_sent(0), bytes_received(0)
+    {
+      responses.fill(0);
+    }
+
+    void add(const operation_counters& counters)
+    {
+      for (size_t i = 0; i < status_class_count; i++)
+      {
+        responses[i] += counters.responses[i].load(std::memory_order_relaxed);
+      }
+
+      retries += counters.retries.load(std::memory_order_relaxed);
+      failures += counters.failures.load(std::memory_order_relaxed);
+      bytes_sent += counters.bytes_sent.load(std::memory_order_relaxed);
+      bytes_received += counters.bytes_received.load(std::memory_order_relaxed);
+      time_to_first_byte.add(counters.time_to_first_byte);
+      transfer.add(counters.transfer);
+      duration.add(counters.duration);
+    }
+
+    std::array<uint64_t, status_class_count> responses;
+    uint64_t retries;
+    uint64_t failures;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    histogram_totals time_to_first_byte;
+    histogram_totals transfer;
+    histogram_totals duration;
+  };
+
+  // The times of the attempts of one operation
+  struct request_timing
+  {
+    request_timing() : attempts(0), responded(false) {}
+
+    std::chrono::steady_clock::time_point sent;
+    std::chrono::steady_clock::time_point received;
+    size_t attempts;
+    bool responded;
+  };
+
+  typedef std::vector<std::pair<utility::string_t, operation_totals>> tracer_totals;
+
+  utility::string_t prometheus_label(const utility::string_t& value)
+  {
+    utility::string_t escaped;
+    for (utility::char_t c : value)
+    {
+      if (c == U('\\') || c == U('"'))
+      {
+        escaped += U('\\');
+      }
+
+      if (c == U('\n'))
+      {
+        escaped += U("\\n");
+        continue;
+      }
+
+      escaped += c;
+    }
+
+    return escaped;
+  }
+
+  void write_counter(utility::ostringstream_t& text, const utility::string_t& name, const utility::string_t& help, const tracer_totals& totals,
+    std::function<uint64_t(const operation_totals&)> value)
+  {
+    text << U("# HELP ") << name << U(" ") << help << U("\n# TYPE ") << name << U(" counter\n");
+    for (const auto& operation : totals)
+    {
+      text << name << U("{operation=\"") << prometheus_label(operation.first) << U("\"} ") << value(operation.second) << U("\n");
+    }
+  }
+
+  void write_histogram(utility::ostringstream_t& text, const utility::string_t& name, const utility::string_t& help, const tracer_totals& totals,
+    std::function<const histogram_totals&(const operation_totals&)> histogram_of)
+  {
+    text << U("# HELP ") << name << U(" ") << help << U("\n# TYPE ") << name << U(" histogram\n");
+    for (const auto& operation : totals)
+    {
+      const histogram_totals& histogram = histogram_of(operation.second);
+      if (histogram.count == 0)
+      {
+        continue;
+      }
+
+      utility::string_t label = U("operation=\"") + prometheus_label(operation.first) + U("\"");
+      uint64_t cumulative = 0;
+      for (size_t i = 0; i < bound_count; i++)
+      {
+        cumulative += histogram.buckets[i];
+        text << name << U("_bucket{") << label << U(",le=\"") << bucket_bounds[i] << U("\"} ") << cumulative << U("\n");
+      }
+
+      text << name << U("_bucket{") << label << U(",le=\"+Inf\"} ") << histogram.count << U("\n");
+      text << name << U("_sum{") << label << U("} ") << histogram.sum_microseconds / 1e6 << U("\n");
+      text << name << U("_count{") << label << U("} ") << histogram.count << U("\n");
+    }
+  }
+
+  web::json::value json_attribute(const utility::string_t& key, const utility::string_t& value)
+  {
+    web::json::value attribute = web::json::value::object();
+    attribute[U("key")] = web::json::value::string(key);
+    attribute[U("value")] = web::json::value::object();
+    attribute[U("value")][U("stringValue")] = web::json::value::string(value);
+    return attribute;
+  }
+
+  web::json::value json_counter(const utility::string_t& name, const utility::string_t& unit, const tracer_totals& totals,
+    std::function<uint64_t(const operation_totals&)> value)
+  {
+    std::vector<web::json::value> points;
+    for (const auto& operation : totals)
+    {
+      web::json::value point = web::json::value::object();
+      point[U("attributes")] = web::json::value::array(std::vector<web::json::value>(1, json_attribute(U("operation"), operation.first)));
+      point[U("asInt")] = web::json::value::number(value(operation.second));
+      points.push_back(point);
+    }
+
+    web::json::value metric = web::json::value::object();
+    metric[U("name")] = web::json::value::string(name);
+    metric[U("unit")] = web::json::value::string(unit);
+    metric[U("sum")] = web::json::value::object();
+    metric[U("sum")][U("aggregationTemporality")] = web::json::value::number(2);
+    metric[U("sum")][U("isMonotonic")] = web::json::value::boolean(true);
+    metric[U("sum")][U("dataPoints")] = web::json::value::array(points);
+    return metric;
+  }
+
+  web::json::value json_histogram(const utility::string_t& name, const tracer_totals& totals,
+    std::function<const histogram_totals&(const operation_totals&)> histogram_of)
+  {
+    std::vector<web::json::value> bounds;
+    for (double bound : bucket_bounds)
+    {
+      bounds.push_back(web::json::value::number(bound));
+    }
+
+    std::vector<web::json::value> points;
+    for (const auto& operation : totals)
+    {
+      const histogram_totals& histogram = histogram_of(operation.second);
+      if (histogram.count == 0)
+      {
+        continue;
+      }
+
+      std::vector<web::json::value> counts;
+      for (uint64_t bucket : histogram.buckets)
+      {
+        counts.push_back(web::json::value::number(bucket));
+      }
+
+      web::json::value point = web::json::value::object();
+      point[U("attributes")] = web::json::value::array(std::vector<web::json::value>(1, json_attribute(U("operation"), operation.first)));
+      point[U("count")] = web::json::value::number(histogram.count);
+      point[U("sum")] = web::json::value::number(histogram.sum_microseconds / 1e6);
+      point[U("bucketCounts")] = web::json::value::array(counts);
+      point[U("explicitBounds")] = web::json::value::array(bounds);
+      points.push_back(point);
+    }
+
+    web::json::value metric = web::json::value::object();
+    metric[U("name")] = web::json::value::string(name);
+    metric[U("unit")] = web::json::value::string(U("s"));
+    metric[U("histogram")] = web::json::value::object();
+    metric[U("histogram")][U("aggregationTemporality")] = web::json::value::number(2);
+    metric[U("histogram")][U("dataPoints")] = web::json::value::array(points);
+    return metric;
+  }
+}
+
+struct request_tracer::tracer_state
+{
+  tracer_state() : id(next_tracer_id++), operation_count(0)
+  {
+    operations[max_operations - 1] = U("other");
+  }
+
+  ///
+  /// Returns the index of the counters of an operation. The names already known are found without the lock.
+  ///
+  size_t operation_index(const utility::string_t& operation)
+  {
+    size_t count = operation_count.load(std::memory_order_acquire);
+    for (size_t index = 0; index < count; index++)
+    {
+      if (operations[index] == operation)
+      {
+        return index;
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    count = operation_count.load(std::memory_order_relaxed);
+    for (size_t index = 0; index < count; index++)
+    {
+      if (operations[index] == operation)
+      {
+        return index;
+      }
+    }
+
+    if (count == max_operations - 1)
+    {
+      return count;
+    }
+
+    operations[count] = operation;
+    operation_count.store(count + 1, std::memory_order_release);
+    return count;
+  }
+
+  ///
+  /// Returns the counters of the calling thread, created the first time the thread records anything. Each thread
+  /// keeps its own shard of every tracer it used, and finds it again without the lock.
+  ///
+  thread_shard& shard()
+  {
+    static thread_local std::vector<std::pair<uint64_t, thread_shard*>> thread_shards;
+    for (const auto& thread_shard_of_tracer : thread_shards)
+    {
+      if (thread_shard_of_tracer.first == id)
+      {
+        return *thread_shard_of_tracer.second;
+      }
+    }
+
+    std::unique_ptr<thread_shard> created(new thread_shard());
+    thread_shard* result = created.get();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      shards.push_back(std::move(created));
+    }
+
+    thread_shards.push_back(std::make_pair(id, result));
+    return *result;
+  }
+
+  ///
+  /// Adds up the counters of every thread, for each operation that was used
+  ///
+  tracer_totals totals() const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    tracer_totals result;
+    size_t count = operation_count.load(std::memory_order_acquire);
+    for (size_t index = 0; index < max_operations; index++)
+    {
+      if (index >= count && index != max_operations - 1)
+      {
+        continue;
+      }
+
+      operation_totals operation;
+      for (const auto& thread_shard_counters : shards)
+      {
+        operation.add(thread_shard_counters->operations[index]);
+      }
+
+      if (index < count || operation.time_to_first_byte.count > 0 || operation.duration.count > 0)
+      {
+        result.push_back(std::make_pair(operations[index], operation));
+      }
+    }
+
+    return result;
+  }
+
+  ///
+  /// Adds the tracing callbacks to a context, calling the callbacks it already had after them
+  ///
+  static operation_context attach(std::shared_ptr<tracer_state> state, size_t index, std::shared_ptr<request_timing> timing, operation_context context)
+  {
+    std::function<void(web::http::http_request&, operation_context)> sending = context.sending_request();
+    context.set_sending_request([state, index, timing, sending](web::http::http_request& request, operation_context context)
+    {
+      operation_counters& counters = state->shard().operations[index];
+      if (timing->attempts++ > 0)
+      {
+        add(counters.retries, 1);
+        if (!timing->responded)
+        {
+          add(counters.responses[0], 1);
+        }
+      }
+
+      add(counters.bytes_sent, request.headers().content_length());
+      timing->responded = false;
+      timing->sent = std::chrono::steady_clock::now();
+
+      if (sending)
+      {
+        sending(request, context);
+      }
+    });
+
+    std::function<void(web::http::http_request&, const web::http::http_response&, operation_context)> received = context.response_received();
+    context.set_response_received([state, index, timing, received](web::http::http_request& request, const web::http::http_response& response, operation_context context)
+    {
+      timing->received = std::chrono::steady_clock::now();
+      timing->responded = true;
+
+      operation_counters& counters = state->shard().operations[index];
+      counters.time_to_first_byte.record(timing->received - timing->sent);
+
+      size_t status_class = static_cast<size_t>(response.status_code() / 100);
+      add(counters.responses[status_class < status_class_count ? status_class : 0], 1);
+      add(counters.bytes_received, response.headers().content_length());
+
+      if (received)
+      {
+        received(request, response, context);
+      }
+    });
+
+    return context;
+  }
+
+  uint64_t id;
+  mutable std::mutex mutex;
+  std::array<utility::string_t, max_operations> operations;
+  std::atomic<size_t> operation_count;
+  std::vector<std::unique_ptr<thread_shard>> shards;
+};
+
+request_tracer::request_tracer()
+  : m_state(std::make_shared<tracer_state>())
+{
+}
+
+///
+/// Creates a context recording the requests of one operation under the given name
+///
+operation_context request_tracer::create_context(const utility::string_t& operation) const
+{
+  return create_context(operation, operation_context());
+}
+
+///
+/// Adds the recording of the requests of one operation to an existing context, which keeps its own callbacks.
+/// For every attempt, the time from sending the request to receiving the response headers is recorded with the
+/// status class of the response and the bytes declared by the request and the response. The HTTP client does not
+/// report the name resolution and the connection setup separately, so they are part of the time to first byte.
+/// Every attempt after the first one counts as a retry. The recording only updates counters of the calling
+/// thread, without any lock, so it adds a few atomic increments to each request.
+///
+operation_context request_tracer::create_context(const utility::string_t& operation, operation_context context) const
+{
+  return tracer_state::attach(m_state, m_state->operation_index(operation), std::make_shared<request_timing>(), context);
+}
+
+///
+/// Returns the context to send a request of an operation with: the given one, recording the request on the tracer
+/// when there is one
+///
+operation_context request_tracer::context_for(const std::shared_ptr<request_tracer>& tracer, const utility::string_t& operation, operation_context context)
+{
+  return tracer ? tracer->create_context(operation, context) : context;
+}
+
+///
+/// Runs an operation with a tracing context and records, besides the requests, its whole duration, the time from
+/// the response headers of its last attempt to its end, which is the transfer of the response body, and whether it
+/// failed after its retries.
+///
+pplx::task<void> request_tracer::trace_async(const utility::string_t& operation, std::function<pplx::task<void>(operation_context)> run) const
+{
+  std::shared_ptr<tracer_state> state = m_state;
+  size_t index = state->operation_index(operation);
+  std::shared_ptr<request_timing> timing = std::make_shared<request_timing>();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  pplx::task<void> traced;
+  try
+  {
+    traced = run(tracer_state::attach(state, index, timing, operation_context()));
+  }
+  catch (...)
+  {
+    add(state->shard().operations[index].failures, 1);
+    return pplx::task_from_exception<void>(std::current_exception());
+  }
+
+  return traced.then([state, index, timing, start](pplx::task<void> completed)
+  {
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    operation_counters& counters = state->shard().operations[index];
+    counters.duration.record(end - start);
+    if (timing->responded)
+    {
+      counters.transfer.record(end - timing->received);
+    }
+    else if (timing->attempts > 0)
+    {
+      add(counters.responses[0], 1);
+    }
+
+    try
+    {
+      completed.get();
+    }
+    catch (...)
+    {
+      add(counters.failures, 1);
+      throw;
+    }
+  });
+}
+
+///
+/// Writes the counters and histograms of every operation in the Prometheus text format
+///
+utility::string_t request_tracer::to_prometheus() const
+{
+  tracer_totals totals = m_state->totals();
+
+  utility::ostringstream_t text;
+  text << U("# HELP blob_responses_total Attempts of the requests to the blob service, by status class of their response.\n")
+    << U("# TYPE blob_responses_total counter\n");
+  for (const auto& operation : totals)
+  {
+    for (size_t i = 0; i < status_class_count; i++)
+    {
+      if (operation.second.responses[i] > 0)
+      {
+        text << U("blob_responses_total{operation=\"") << prometheus_label(operation.first) << U("\",status=\"")
+          << utility::conversions::to_string_t(status_classes[i]) << U("\"} ") << operation.second.responses[i] << U("\n");
+      }
+    }
+  }
+
+  write_counter(text, U("blob_retries_total"), U("Requests sent again after a failed attempt."), totals,
+    [](const operation_totals& operation) { return operation.retries; });
+  write_counter(text, U("blob_operation_failures_total"), U("Traced operations that failed after their retries."), totals,
+    [](const operation_totals& operation) { return operation.failures; });
+  write_counter(text, U("blob_sent_bytes_total"), U("Bytes of the request bodies."), totals,
+    [](const operation_totals& operation) { return operation.bytes_sent; });
+  write_counter(text, U("blob_received_bytes_total"), U("Bytes of the response bodies."), totals,
+    [](const operation_totals& operation) { return operation.bytes_received; });
+  write_histogram(text, U("blob_time_to_first_byte_seconds"), U("Time from sending a request to receiving its response headers, connection setup included."), totals,
+    [](const operation_totals& operation) -> const histogram_totals& { return operation.time_to_first_byte; });
+  write_histogram(text, U("blob_transfer_seconds"), U("Time from the response headers to the end of a traced operation."), totals,
+    [](const operation_totals& operation) -> const histogram_totals& { return operation.transfer; });
+  write_histogram(text, U("blob_operation_duration_seconds"), U("Time of a traced operation, retries included."), totals,
+    [](const operation_totals& operation) -> const histogram_totals& { return operation.duration; });
+
+  return text.str();
+}
+
+///
+/// Returns the counters and histograms of every operation as JSON shaped like the OpenTelemetry metrics data model,
+/// with cumulative sums and explicit bucket histograms
+///
+web::json::value request_tracer::to_json() const
+{
+  tracer_totals totals = m_state->totals();
+
+  std::vector<web::json::value> metrics;
+
+  std::vector<web::json::value> response_points;
+  for (const auto& operation : totals)
+  {
+    for (size_t i = 0; i < status_class_count; i++)
+    {
+      if (operation.second.responses[i] > 0)
+      {
+        std::vector<web::json::value> attributes;
+        attributes.push_back(json_attribute(U("operation"), operation.first));
+        attributes.push_back(json_attribute(U("http.status_class"), utility::conversions::to_string_t(status_classes[i])));
+
+        web::json::value point = web::json::value::object();
+        point[U("attributes")] = web::json::value::array(attributes);
+        point[U("asInt")] = web::json::value::number(operation.second.responses[i]);
+        response_points.push_back(point);
+      }
+    }
+  }
+
+  web::json::value responses = json_counter(U("blob.responses"), U("{response}"), tracer_totals(), nullptr);
+  responses[U("sum")][U("dataPoints")] = web::json::value::array(response_points);
+  metrics.push_back(responses);
+
+  metrics.push_back(json_counter(U("blob.retries"), U("{request}"), totals, [](const operation_totals& operation) { return operation.retries; }));
+  metrics.push_back(json_counter(U("blob.operation.failures"), U("{operation}"), totals, [](const operation_totals& operation) { return operation.failures; }));
+  metrics.push_back(json_counter(U("blob.sent"), U("By"), totals, [](const operation_totals& operation) { return operation.bytes_sent; }));
+  metrics.push_back(json_counter(U("blob.received"), U("By"), totals, [](const operation_totals& operation) { return operation.bytes_received; }));
+  metrics.push_back(json_histogram(U("blob.time_to_first_byte"), totals,
+    [](const operation_totals& operation) -> const histogram_totals& { return operation.time_to_first_byte; }));
+  metrics.push_back(json_histogram(U("blob.transfer"), totals,
+    [](const operation_totals& operation) -> const histogram_totals& { return operation.transfer; }));
+  metrics.push_back(json_histogram(U("blob.operation.duration"), totals,
+    [](const operation_totals& operation) -> const histogram_totals& { return operation.duration; }));
+
+  web::json::value scope = web::json::value::object();
+  scope[U("scope")] = web::json::value::object();
+  scope[U("scope")][U("name")] = web::json::value::string(U("request_tracer"));
+  scope[U("metrics")] = web::json::value::array(metrics);
+
+  web::json::value resource = web::json::value::object();
+  resource[U("resource")] = web::json::value::object();
+  resource[U("resource")][U("attributes")] = web::json::value::array(std::vector<web::json::value>(1, json_attribute(U("service.name"), U("storage-blob-cpp-getting-started"))));
+  resource[U("scopeMetrics")] = web::json::value::array(std::vector<web::json::value>(1, scope));
+
+  web::json::value result = web::json::value::object();
+  result[U("resourceMetrics")] = web::json::value::array(std::vector<web::json::value>(1, resource));
+  return result;
+}
@@ -0,0 +1,41 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+using namespace azure::storage;
+
+#pragma once
+class request_tracer
+{
+public:
+  request_tracer();
+
+  operation_context create_context(const utility::string_t& operation) const;
+  operation_context create_context(const utility::string_t& operation, operation_context context) const;
+  pplx::task<void> trace_async(const utility::string_t& operation, std::function<pplx::task<void>(operation_context)> run) const;
+
+  static operation_context context_for(const std::shared_ptr<request_tracer>& tracer, const utility::string_t& operation, operation_context context = operation_context());
+
+  utility::string_t to_prometheus() const;
+  web::json::value to_json() const;
+
+private:
+  request_tracer(const request_tracer&);
+  request_tracer& operator=(const request_tracer&);
+
+  struct tracer_state;
+
+  std::shared_ptr<tracer_state> m_state;
+};
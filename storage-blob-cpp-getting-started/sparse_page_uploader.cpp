@@ -0,0 +1,271 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "task_util.h"
+#include "concurrency_controller.h"
+#include "request_tracer.h"
+#include "mapped_file.h"
+#include "md5.h"
+#include "integrity_pipeline.h"
+#include "sparse_page_uploader.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPARSE_PAGE_UPLOADER_SSE2
+#endif
+
+using namespace azure::storage;
+
+namespace
+{
+  struct upload_state
+  {
+    upload_state() : full_pages_size(0), scan_position(0), tail_sent(true), bytes(0), skipped_bytes(0), requests(0) {}
+
+    std::mutex mutex;
+    std::shared_ptr<mapped_file> file;
+    utility::size64_t full_pages_size;
+    utility::size64_t scan_position;
+    std::vector<uint8_t> tail;
+    bool tail_sent;
+    std::atomic<utility::size64_t> bytes;
+    std::atomic<utility::size64_t> skipped_bytes;
+    std::atomic<size_t> requests;
+    std::shared_ptr<integrity_pipeline> pipeline;
+  };
+
+  ///
+  /// Finds the next run of contiguous non-zero pages in the mapped file, up to max_length bytes. Zero pages
+  /// are skipped since a new page blob already reads as zeros, and their memory is released right away.
+  /// Must be called with the state lock held.
+  ///
+  bool next_run(upload_state& state, size_t max_length, utility::size64_t& offset, utility::size64_t& length)
+  {
+    const uint8_t* data = state.file->data();
+    utility::size64_t zeros_start = state.scan_position;
+    length = 0;
+
+    while (state.scan_position < state.full_pages_size && length < max_length)
+    {
+      if (sparse_page_uploader::is_zero_page(data + state.scan_position))
+      {
+        if (length > 0)
+        {
+          break;
+        }
+
+        state.skipped_bytes += sparse_page_uploader::page_size;
+      }
+      else
+      {
+        if (length == 0)
+        {
+          offset = state.scan_position;
+        }
+
+        length += sparse_page_uploader::page_size;
+      }
+
+      state.scan_position += sparse_page_uploader::page_size;
+    }
+
+    utility::size64_t zeros_end = length > 0 ? offset : state.scan_position;
+    state.file->release(zeros_start, zeros_end - zeros_start);
+
+    return length > 0;
+  }
+}
+
+const size_t sparse_page_uploader::page_size;
+
+sparse_page_uploader::sparse_page_uploader(size_t max_request_size, size_t parallelism)
+  : m_max_request_size(max_request_size - max_request_size % page_size), m_parallelism(parallelism)
+{
+  if (m_max_request_size == 0)
+  {
+    throw std::invalid_argument("The request size must be at least one page");
+  }
+}
+
+///
+/// Lets a controller shared with other page writes choose the number of writes in flight and their size.
+/// The write size stays at most the maximum request size given at construction, in whole pages.
+///
+void sparse_page_uploader::set_controller(std::shared_ptr<concurrency_controller> controller)
+{
+  m_controller = controller;
+}
+
+///
+/// Hashes the writes on a pipeline shared with other transfers, instead of one started for every upload
+///
+void sparse_page_uploader::set_pipeline(std::shared_ptr<integrity_pipeline> pipeline)
+{
+  m_pipeline = pipeline;
+}
+
+///
+/// Records the creation of the page blobs and their page writes on a tracer
+///
+void sparse_page_uploader::set_tracer(std::shared_ptr<request_tracer> tracer)
+{
+  m_tracer = tracer;
+}
+
+///
+/// Rounds a size up to the next multiple of the page size
+///
+utility::size64_t sparse_page_uploader::aligned_size(utility::size64_t size)
+{
+  return (size + page_size - 1) / page_size * page_size;
+}
+
+///
+/// Checks whether a 512 byte page only contains zeros
+///
+bool sparse_page_uploader::is_zero_page(const uint8_t* page)
+{
+#ifdef SPARSE_PAGE_UPLOADER_SSE2
+  __m128i accumulator = _mm_setzero_si128();
+  for (size_t i = 0; i < page_size; i += 16)
+  {
+    accumulator = _mm_or_si128(accumulator, _mm_loadu_si128(reinterpret_cast<const __m128i*>(page + i)));
+  }
+
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(accumulator, _mm_setzero_si128())) == 0xFFFF;
+#else
+  uint64_t accumulator = 0;
+  for (size_t i = 0; i < page_size; i += sizeof(uint64_t))
+  {
+    uint64_t word;
+    std::memcpy(&word, page + i, sizeof(word));
+    accumulator |= word;
+  }
+
+  return accumulator == 0;
+#endif
+}
+
+///
+/// Uploads a file to a page blob and waits for the upload to complete.
+///
+transfer_stats sparse_page_uploader::upload_file(cloud_page_blob page_blob, const utility::string_t& file_name) const
+{
+  return upload_file_async(page_blob, file_name).get();
+}
+
+///
+/// Creates a page blob with the size of the file, rounded up to whole pages, and uploads the file content.
+/// Contiguous non-zero pages are coalesced in writes of up to max_request_size bytes, all-zero pages are not
+/// sent at all, and up to 'parallelism' writes are in flight at once. Each write is sent with its MD5, computed
+/// on an integrity pipeline while the other writes are being sent. The file is mapped in memory and
+/// the writes are sent straight from the mapping, except for a trailing partial page which is padded
+/// with zeros in a separate buffer since page writes must be a multiple of the page size.
+///
+pplx::task<transfer_stats> sparse_page_uploader::upload_file_async(cloud_page_blob page_blob, const utility::string_t& file_name) const
+{
+  std::shared_ptr<upload_state> state = std::make_shared<upload_state>();
+  state->file = mapped_file::open(file_name);
+  state->pipeline = m_pipeline ? m_pipeline : integrity_pipeline::create_default();
+
+  utility::size64_t file_size = state->file->size();
+  state->full_pages_size = file_size - file_size % page_size;
+  if (state->full_pages_size < file_size)
+  {
+    // Only a partial last page is sent from its own buffer
+    state->tail.assign(page_size, 0);
+    std::memcpy(state->tail.data(), state->file->data() + state->full_pages_size, static_cast<size_t>(file_size - state->full_pages_size));
+    state->tail_sent = is_zero_page(state->tail.data());
+    if (state->tail_sent)
+    {
+      state->skipped_bytes += page_size;
+    }
+  }
+
+  size_t max_request_size = m_max_request_size;
+  size_t parallelism = m_parallelism;
+  std::shared_ptr<concurrency_controller> controller = m_controller;
+  std::shared_ptr<request_tracer> tracer = m_tracer;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  return page_blob.create_async(aligned_size(file_size), 0, access_condition(), blob_request_options(), request_tracer::context_for(tracer, U("create_page_blob")))
+    .then([page_blob, state, max_request_size, parallelism, controller, tracer]()
+  {
+    state->requests++;
+
+    auto step = [page_blob, state, max_request_size, controller, tracer]() -> pplx::task<bool>
+    {
+      size_t request_size = max_request_size;
+      if (controller)
+      {
+        request_size = std::max(page_size, std::min(request_size, controller->block_size() - controller->block_size() % page_size));
+      }
+
+      utility::size64_t offset = 0;
+      utility::size64_t length = 0;
+      concurrency::streams::istream page_stream;
+      const uint8_t* data;
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (next_run(*state, request_size, offset, length))
+        {
+          page_stream = state->file->view(offset, length);
+          data = state->file->data() + offset;
+        }
+        else if (!state->tail_sent)
+        {
+          state->tail_sent = true;
+          offset = state->full_pages_size;
+          length = page_size;
+          page_stream = concurrency::streams::bytestream::open_istream(state->tail);
+          data = state->tail.data();
+        }
+        else
+        {
+          return pplx::task_from_result(false);
+        }
+      }
+
+      return state->pipeline->hash_async(data, static_cast<size_t>(length)).then([page_blob, state, controller, tracer, page_stream, offset, length](block_digest digest)
+      {
+        // Every request uses its own reference so concurrent responses do not update the same blob properties
+        cloud_page_blob range_blob = page_blob.container().get_page_blob_reference(page_blob.name());
+        return range_blob.upload_pages_async(page_stream, static_cast<int64_t>(offset), digest.content_md5(), access_condition(), blob_request_options(),
+          request_tracer::context_for(tracer, U("upload_pages"), concurrency_controller::context_for(controller))).then([state, page_stream, offset, length](pplx::task<void> upload)
+        {
+          page_stream.close();
+          upload.get();
+
+          state->file->release(offset, length);
+          state->bytes += length;
+          state->requests++;
+          return true;
+        });
+      });
+    };
+
+    return concurrency_controller::run_workers(controller, parallelism, step);
+  }).then([state, start]()
+  {
+    transfer_stats stats;
+    stats.bytes = state->bytes;
+    stats.skipped_bytes = state->skipped_bytes;
+    stats.requests = state->requests;
+    stats.seconds = task_util::seconds_since(start);
+    return stats;
+  });
+}
@@ -0,0 +1,43 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+using namespace azure::storage;
+
+#pragma once
+class sparse_page_uploader
+{
+public:
+  sparse_page_uploader(size_t max_request_size, size_t parallelism);
+
+  transfer_stats upload_file(cloud_page_blob page_blob, const utility::string_t& file_name) const;
+  pplx::task<transfer_stats> upload_file_async(cloud_page_blob page_blob, const utility::string_t& file_name) const;
+
+  static const size_t page_size = 512;
+
+  void set_controller(std::shared_ptr<concurrency_controller> controller);
+  void set_pipeline(std::shared_ptr<integrity_pipeline> pipeline);
+  void set_tracer(std::shared_ptr<request_tracer> tracer);
+
+  static utility::size64_t aligned_size(utility::size64_t size);
+  static bool is_zero_page(const uint8_t* page);
+
+private:
+  size_t m_max_request_size;
+  size_t m_parallelism;
+  std::shared_ptr<concurrency_controller> m_controller;
+  std::shared_ptr<integrity_pipeline> m_pipeline;
+  std::shared_ptr<request_tracer> m_tracer;
+};
@@ -23,11 +23,34 @@
 #pragma once
 
 #define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
+#define NOMINMAX                        // Keep std::min and std::max usable
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 #include <stdio.h>
 #include <ctime>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
 
 #include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <functional>
+#include <thread>
+#include <future>
+#include <random>
+#include <map>
+#include <array>
+#include <set>
+#include <unordered_map>
+#include <list>
 #include "was/storage_account.h"
 #include "was/queue.h"
 #include "was/blob.h"
@@ -15,14 +15,24 @@
 //----------------------------------------------------------------------------------
 
 #include "stdafx.h"
+#include "md5.h"
+#include "integrity_pipeline.h"
+#include "concurrency_controller.h"
+#include "request_tracer.h"
+#include "client_context.h"
 #include "blob_basic.h"
 #include "blob_advanced.h"
+#include "task_util.h"
+#include "mock_blob_service.h"
 
 using namespace azure::storage;
 
-void run_storage_blob_samples(utility::string_t storage_connection_string);
+void run_storage_blob_samples(utility::string_t storage_connection_string, bool json_metrics);
+void run_storage_blob_samples_concurrently(utility::string_t storage_connection_string, bool json_metrics);
+bool compare_sequential_and_concurrent(utility::string_t storage_connection_string, double max_ratio);
+void print_metrics(const client_context& context, bool json_metrics);
 
-int main()
+int main(int argc, char* argv[])
 {
   // *************************************************************************************************************************
   // Instructions: This sample can be run using either the Azure Storage Emulator that installs as part of the Windows Azure SDK (in Windows only) - or by
@@ -40,13 +50,98 @@ int main()
   //         the App.Config file. See http://go.microsoft.com/fwlink/?LinkId=325277 for more information
   //      3. Set breakpoints and run the project using F10. 
   // 
+  // Pass --concurrent on the command line to run the independent samples at the same time.
+  // Pass --compare to run the independent samples one after another, then at the same time, and check that the
+  // concurrent run takes about as long as the slowest sample; the process exits with an error otherwise.
+  // Pass --connection-string <connection string> to use another account or emulator without rebuilding.
+  // Pass --mock to run the samples offline against an in-process blob service on http://127.0.0.1:10000, which can
+  // simulate a slow or unreliable network with --mock-latency-ms <ms>, --mock-bandwidth <bytes per second>
+  // and --mock-error-rate <fraction of the requests failing with 503>.
+  // The requests are traced and their metrics printed at the end in the Prometheus text format, or as
+  // OpenTelemetry-style JSON with --metrics-json.
+  // 
   // *************************************************************************************************************************
 
-  const utility::string_t storage_connection_string(U("UseDevelopmentStorage=true"));
+  utility::string_t storage_connection_string(U("UseDevelopmentStorage=true"));
+
+  bool concurrent = false;
+  bool compare = false;
+  bool mock = false;
+  bool json_metrics = false;
+  long long mock_latency_ms = 0;
+  utility::size64_t mock_bandwidth = 0;
+  double mock_error_rate = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string argument(argv[i]);
+    bool has_value = i + 1 < argc;
+    if (argument == "--concurrent")
+    {
+      concurrent = true;
+    }
+    else if (argument == "--compare")
+    {
+      compare = true;
+    }
+    else if (argument == "--mock")
+    {
+      mock = true;
+    }
+    else if (argument == "--metrics-json")
+    {
+      json_metrics = true;
+    }
+    else if (argument == "--connection-string" && has_value)
+    {
+      storage_connection_string = utility::conversions::to_string_t(argv[++i]);
+    }
+    else if (argument == "--mock-latency-ms" && has_value)
+    {
+      mock_latency_ms = std::atoll(argv[++i]);
+    }
+    else if (argument == "--mock-bandwidth" && has_value)
+    {
+      mock_bandwidth = std::strtoull(argv[++i], nullptr, 10);
+    }
+    else if (argument == "--mock-error-rate" && has_value)
+    {
+      mock_error_rate = std::atof(argv[++i]);
+    }
+  }
+
+  // The mock service is kept alive until the samples are done
+  std::unique_ptr<mock_blob_service> mock_service;
+  if (mock)
+  {
+    mock_service.reset(new mock_blob_service(U("http://127.0.0.1:10000")));
+    mock_service->set_latency(std::chrono::milliseconds(mock_latency_ms));
+    mock_service->set_bandwidth(mock_bandwidth);
+    mock_service->set_error_rate(mock_error_rate, web::http::status_codes::ServiceUnavailable);
+    mock_service->open();
+
+    storage_connection_string = mock_service->connection_string();
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
   try
   {
-    run_storage_blob_samples(storage_connection_string);
+    if (compare)
+    {
+      // The samples also compute locally, so the concurrent run may take half as long again as the slowest one
+      return compare_sequential_and_concurrent(storage_connection_string, 1.5) ? 0 : 1;
+    }
+
+    if (concurrent)
+    {
+      run_storage_blob_samples_concurrently(storage_connection_string, json_metrics);
+    }
+    else
+    {
+      run_storage_blob_samples(storage_connection_string, json_metrics);
+    }
+
+    ucout << U("Samples completed in ") << task_util::seconds_since(start) << U(" s") << std::endl;
   }
   catch (const azure::storage::storage_exception& e)
   {
@@ -61,46 +156,215 @@ int main()
 /// Blob storage stores unstructured data such as text, binary data, documents or media files.
 /// Blobs can be accessed from anywhere in the world via HTTP or HTTPS.
 ///
-void run_storage_blob_samples(utility::string_t storage_connection_string)
+void run_storage_blob_samples(utility::string_t storage_connection_string, bool json_metrics)
 {
-  // Parse the connection string
-  cloud_storage_account storage_account = cloud_storage_account::parse(storage_connection_string);
-
-  cloud_blob_client blob_client = storage_account.create_cloud_blob_client();
+  // Parse the connection string once, all the samples share the same client and request options
+  client_context context(storage_connection_string);
 
   // basic operations with block blobs
-  blob_basic::block_blob_operations(blob_client);
+  blob_basic::block_blob_operations(context);
 
   //basic operations with append blobs
-  blob_basic::append_blob_operations(blob_client);
+  blob_basic::append_blob_operations(context);
 
   // list containers
-  blob_advanced::list_containers(blob_client);
+  blob_advanced::list_containers(context);
 
   // copy blobs
-  blob_advanced::copy_blob(blob_client);
+  blob_advanced::copy_blob(context);
 
   // file upload with blocks
-  blob_advanced::file_upload_with_blocks(blob_client);
+  blob_advanced::file_upload_with_blocks(context);
+
+  // directory tree synchronization
+  blob_advanced::sync_directory(context);
+
+  // cached range reads
+  blob_advanced::cached_range_reads(context);
+
+#ifdef BUILD_GZIP_TRANSFER
+  // compressed upload and download
+  blob_advanced::compressed_upload(context);
+#endif
+
+  // delete the blobs under a prefix
+  blob_advanced::delete_by_prefix(context);
 
   // lease blob for exclusive access
-  blob_advanced::lease_blob(blob_client);
+  blob_advanced::lease_blob(context);
 
   // lease container for exclusive access
-  blob_advanced::lease_container(blob_client);
+  blob_advanced::lease_container(context);
 
   // page blob operations
-  blob_advanced::page_blob_operations(blob_client);
+  blob_advanced::page_blob_operations(context);
 
   // set cors rules for the blob service
-  blob_advanced::set_cors_rules(blob_client);
+  blob_advanced::set_cors_rules(context);
 
   // set service properties for the blob service
-  blob_advanced::set_service_properties(blob_client);
+  blob_advanced::set_service_properties(context);
 
   // set container and blob metadata and properties
-  blob_advanced::set_metadata_and_properties(blob_client);
+  blob_advanced::set_metadata_and_properties(context);
 
   // set container permissions
-  blob_advanced::set_container_acl(blob_client);
+  blob_advanced::set_container_acl(context);
+
+  print_metrics(context, json_metrics);
+}
+
+typedef void (*sample_function)(const client_context&);
+
+///
+/// Returns the samples that work on their own container, so they can run at the same time
+///
+std::vector<std::pair<utility::string_t, sample_function>> independent_samples()
+{
+  std::vector<std::pair<utility::string_t, sample_function>> samples;
+  samples.push_back(std::make_pair(U("block blob operations"), blob_basic::block_blob_operations));
+  samples.push_back(std::make_pair(U("append blob operations"), blob_basic::append_blob_operations));
+  samples.push_back(std::make_pair(U("list containers"), blob_advanced::list_containers));
+  samples.push_back(std::make_pair(U("copy blob"), blob_advanced::copy_blob));
+  samples.push_back(std::make_pair(U("file upload with blocks"), blob_advanced::file_upload_with_blocks));
+  samples.push_back(std::make_pair(U("sync directory"), blob_advanced::sync_directory));
+  samples.push_back(std::make_pair(U("cached range reads"), blob_advanced::cached_range_reads));
+#ifdef BUILD_GZIP_TRANSFER
+  samples.push_back(std::make_pair(U("compressed upload"), blob_advanced::compressed_upload));
+#endif
+  samples.push_back(std::make_pair(U("delete by prefix"), blob_advanced::delete_by_prefix));
+  samples.push_back(std::make_pair(U("lease blob"), blob_advanced::lease_blob));
+  samples.push_back(std::make_pair(U("lease container"), blob_advanced::lease_container));
+  samples.push_back(std::make_pair(U("page blob operations"), blob_advanced::page_blob_operations));
+  samples.push_back(std::make_pair(U("metadata and properties"), blob_advanced::set_metadata_and_properties));
+  samples.push_back(std::make_pair(U("container acl"), blob_advanced::set_container_acl));
+  return samples;
+}
+
+///
+/// Runs one sample and reports how long it took, in seconds. Errors are reported so that a failing sample
+/// does not stop the others.
+///
+double run_sample(const utility::string_t& name, sample_function sample, const client_context& context)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  try
+  {
+    sample(context);
+    ucout << U("Sample ") << name << U(" completed in ") << task_util::seconds_since(start) << U(" s") << std::endl;
+  }
+  catch (const azure::storage::storage_exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("Sample ") << name << U(" failed.") << std::endl;
+  }
+  catch (const std::exception& e)
+  {
+    ucout << U("Error:") << e.what() << std::endl << U("Sample ") << name << U(" failed.") << std::endl;
+  }
+
+  return task_util::seconds_since(start);
+}
+
+///
+/// Runs one sample on a thread of its own. The samples are kept as the blocking calls a getting-started guide
+/// shows, rather than rewritten as chains of tasks, so they run on dedicated threads: on the thread pool, they
+/// would take the threads their own requests complete on.
+///
+std::future<double> run_sample_async(const utility::string_t& name, sample_function sample, const client_context& context)
+{
+  // The context outlives the samples, which are all waited for before it goes out of scope
+  return std::async(std::launch::async, [name, sample, &context]()
+  {
+    return run_sample(name, sample, context);
+  });
+}
+
+///
+/// Starts the independent samples at the same time and waits for all of them
+///
+void run_independent_samples_concurrently(const client_context& context)
+{
+  std::vector<std::future<double>> samples;
+  for (const auto& sample : independent_samples())
+  {
+    samples.push_back(run_sample_async(sample.first, sample.second, context));
+  }
+
+  for (std::future<double>& sample : samples)
+  {
+    sample.wait();
+  }
+}
+
+///
+/// Runs the same samples as run_storage_blob_samples, but every sample that works on its own container is
+/// started at the same time on a thread of its own, so the total time is close to the time of the slowest one.
+/// The samples that change the service properties of the account run afterwards, one after another,
+/// since they read, modify and restore the same settings. The output of the concurrent samples is interleaved.
+///
+void run_storage_blob_samples_concurrently(utility::string_t storage_connection_string, bool json_metrics)
+{
+  // Parse the connection string once, all the samples share the same client and request options
+  client_context context(storage_connection_string);
+
+  run_independent_samples_concurrently(context);
+
+  // set cors rules for the blob service
+  blob_advanced::set_cors_rules(context);
+
+  // set service properties for the blob service
+  blob_advanced::set_service_properties(context);
+
+  print_metrics(context, json_metrics);
+}
+
+///
+/// Runs the independent samples one after another, then all at the same time, and checks that the concurrent run
+/// takes about as long as the slowest sample, at most 'max_ratio' times as long, rather than the sum of them all.
+/// Best run against the in-process service with some latency, so the time of the samples is the time of their
+/// requests.
+///
+bool compare_sequential_and_concurrent(utility::string_t storage_connection_string, double max_ratio)
+{
+  client_context context(storage_connection_string);
+
+  double sequential_seconds = 0;
+  double slowest_seconds = 0;
+  for (const auto& sample : independent_samples())
+  {
+    double seconds = run_sample(sample.first, sample.second, context);
+    sequential_seconds += seconds;
+    slowest_seconds = std::max(slowest_seconds, seconds);
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  run_independent_samples_concurrently(context);
+  double concurrent_seconds = task_util::seconds_since(start);
+
+  bool passed = concurrent_seconds < sequential_seconds && concurrent_seconds <= max_ratio * slowest_seconds;
+  ucout << U("Sequential run: ") << sequential_seconds << U(" s, slowest sample: ") << slowest_seconds << U(" s, concurrent run: ")
+    << concurrent_seconds << U(" s") << std::endl;
+  ucout << (passed ? U("The concurrent run takes about as long as the slowest sample.") : U("The concurrent run is slower than expected."))
+    << std::endl;
+  return passed;
+}
+
+///
+/// Prints the state of the concurrency controllers and the metrics of the requests traced by the samples
+///
+void print_metrics(const client_context& context, bool json_metrics)
+{
+  ucout << U("Block upload controller: ") << context.block_controller()->to_json().serialize() << std::endl;
+  ucout << U("Page write controller: ") << context.page_controller()->to_json().serialize() << std::endl;
+  ucout << U("Range read controller: ") << context.range_controller()->to_json().serialize() << std::endl;
+  ucout << U("Delete controller: ") << context.delete_controller()->to_json().serialize() << std::endl;
+
+  if (json_metrics)
+  {
+    ucout << U("Request metrics: ") << context.tracer()->to_json().serialize() << std::endl;
+  }
+  else
+  {
+    ucout << U("Request metrics:") << std::endl << context.tracer()->to_prometheus();
+  }
 }
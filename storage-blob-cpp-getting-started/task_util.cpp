@@ -0,0 +1,119 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#include "stdafx.h"
+#include "task_util.h"
+
+transfer_stats::transfer_stats()
+  : bytes(0), skipped_bytes(0), requests(0), seconds(0)
+{
+}
+
+double transfer_stats::megabytes_per_second() const
+{
+  return seconds > 0 ? static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds : 0;
+}
+
+double transfer_stats::requests_per_second() const
+{
+  return seconds > 0 ? static_cast<double>(requests) / seconds : 0;
+}
+
+///
+/// Runs a single worker: keeps calling the step until it reports that there is no more work,
+/// or until any worker of the same group has failed.
+///
+static pplx::task<void> run_worker(std::function<pplx::task<bool>()> step, std::shared_ptr<std::atomic<bool>> failed)
+{
+  if (*failed)
+  {
+    return pplx::task_from_result();
+  }
+
+  pplx::task<bool> next;
+  try
+  {
+    next = step();
+  }
+  catch (...)
+  {
+    *failed = true;
+    return pplx::task_from_exception<void>(std::current_exception());
+  }
+
+  return next.then([step, failed](pplx::task<bool> completed) -> pplx::task<void>
+  {
+    bool more;
+    try
+    {
+      more = completed.get();
+    }
+    catch (...)
+    {
+      *failed = true;
+      throw;
+    }
+
+    return more ? run_worker(step, failed) : pplx::task_from_result();
+  });
+}
+
+///
+/// Runs the same step on a fixed number of concurrent workers. Each worker waits for its previous
+/// step to complete before starting the next one, so at most 'workers' steps are ever in flight.
+/// The returned task completes when every worker has run out of work, and fails with the first error.
+///
+pplx::task<void> task_util::run_workers(size_t workers, std::function<pplx::task<bool>()> step)
+{
+  std::shared_ptr<std::atomic<bool>> failed = std::make_shared<std::atomic<bool>>(false);
+
+  size_t count = workers > 0 ? workers : 1;
+
+  std::vector<pplx::task<void>> tasks;
+  tasks.reserve(count);
+  for (size_t i = 0; i < count; i++)
+  {
+    tasks.push_back(run_worker(step, failed));
+  }
+
+  return pplx::when_all(tasks.begin(), tasks.end());
+}
+
+///
+/// Returns the number of seconds elapsed since the given point in time
+///
+double task_util::seconds_since(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+///
+/// Prints the throughput of a completed transfer
+///
+void task_util::print_stats(const utility::string_t& operation, const transfer_stats& stats)
+{
+  utility::ostringstream_t message;
+  message << operation << U(": ") << stats.bytes << U(" bytes in ") << stats.requests << U(" requests, ")
+    << std::fixed << std::setprecision(3) << stats.seconds << U(" s, ")
+    << std::setprecision(2) << stats.megabytes_per_second() << U(" MB/s, ")
+    << stats.requests_per_second() << U(" requests/s");
+  if (stats.skipped_bytes > 0)
+  {
+    message << U(", ") << stats.skipped_bytes << U(" bytes skipped");
+  }
+
+  ucout << message.str() << std::endl;
+}
@@ -0,0 +1,41 @@
+//----------------------------------------------------------------------------------
+// Microsoft Developer & Platform Evangelism
+//
+// Copyright (c) Microsoft Corporation. All rights reserved.
+//
+// THIS CODE AND INFORMATION ARE PROVIDED "AS IS" WITHOUT WARRANTY OF ANY KIND, 
+// EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE IMPLIED WARRANTIES 
+// OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR PURPOSE.
+//----------------------------------------------------------------------------------
+// The example companies, organizations, products, domain names,
+// e-mail addresses, logos, people, places, and events depicted
+// herein are fictitious.  No association with any real company,
+// organization, product, domain name, email address, logo, person,
+// places, or events is intended or should be inferred.
+//----------------------------------------------------------------------------------
+
+#pragma once
+
+struct transfer_stats
+{
+  transfer_stats();
+
+  double megabytes_per_second() const;
+  double requests_per_second() const;
+
+  utility::size64_t bytes;
+  utility::size64_t skipped_bytes;
+  size_t requests;
+  double seconds;
+};
+
+class task_util
+{
+public:
+  static const int max_listing_results = 5000;
+  static const size_t max_block_count = 50000;
+
+  static pplx::task<void> run_workers(size_t workers, std::function<pplx::task<bool>()> step);
+  static double seconds_since(std::chrono::steady_clock::time_point start);
+  static void print_stats(const utility::string_t& operation, const transfer_stats& stats);
+};